@@ -0,0 +1,284 @@
+// Measures the generated parsers of one backend against google::protobuf::util::JsonStringToMessage on a deterministic
+// corpus. Every result is printed as one json object per line, so runs can be diffed or loaded into other tools.
+// Cycles and branch misses per json token are reported when the kernel grants access to hardware counters, null
+// otherwise.
+//
+// usage: protog_bench_<backend> [-n messages] [-p passes] [-s seed] [-o results.json]
+
+#include <getopt.h>
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <google/protobuf/arena.h>
+#include <google/protobuf/util/json_util.h>
+
+#include "corpus.h"
+#include "bidrequest_parser.pb.h"
+#include "messages.pb.h"
+#include "nestedmessage_parser.pb.h"
+#include "openrtb.pb.h"
+
+#ifndef PROTOG_BENCH_BACKEND
+#define PROTOG_BENCH_BACKEND "unknown"
+#endif
+
+// counts heap allocations done through operator new, which covers protobuf messages and strings
+static size_t allocations = 0;
+
+void *operator new(size_t size) {
+    ++allocations;
+    if (void *ptr = malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    free(ptr);
+}
+
+namespace {
+
+// hardware counter of the calling thread, invalid where perf events are not available (containers, some VMs)
+class Counter {
+public:
+    explicit Counter(uint64_t config) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd_ = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+    ~Counter() {
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+    }
+
+    void start() {
+        if (fd_ >= 0) {
+            ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    // the counted events, or -1 if the counter is not available
+    double stop() {
+        uint64_t value;
+        if (fd_ < 0 || ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0) != 0 || read(fd_, &value, sizeof(value)) != sizeof(value)) {
+            return -1;
+        }
+        return static_cast<double>(value);
+    }
+
+private:
+    int fd_;
+};
+
+// keys, scalar values and the brackets of objects and arrays, which is roughly one parser callback each
+size_t countTokens(const std::string &json) {
+    size_t tokens = 0;
+    for (size_t i = 0; i < json.size(); ++i) {
+        const char ch = json[i];
+        if (ch == '"') {
+            ++tokens;
+            for (++i; i < json.size() && json[i] != '"'; ++i) {
+                i += json[i] == '\\' ? 1 : 0;
+            }
+        } else if (ch == '{' || ch == '}' || ch == '[' || ch == ']') {
+            ++tokens;
+        } else if (ch != ':' && ch != ',' && ch != ' ' && ch != '\n' && ch != '\t' && ch != '\r') {
+            ++tokens;
+            while (i + 1 < json.size() && !strchr(",:]} \n\t\r", json[i + 1])) {
+                ++i;
+            }
+        }
+    }
+    return tokens;
+}
+
+struct Result {
+    size_t messages = 0;
+    size_t bytes = 0;
+    size_t tokens = 0;
+    double cycles = -1;
+    double branchMisses = -1;
+    double seconds = 0;
+    double p50 = 0; // microseconds
+    double p99 = 0;
+    double allocationsPerMessage = 0;
+};
+
+struct Options {
+    size_t messages = 2000;
+    int passes = 5;
+    unsigned seed = 42;
+    FILE *out = stdout;
+};
+
+// one untimed pass to warm up caches and pools, then every message is timed on its own
+template <typename F>
+Result measure(const std::vector<std::string> &corpus, int passes, F parse) {
+    for (const auto &json : corpus) {
+        parse(json);
+    }
+    std::vector<double> latencies;
+    latencies.reserve(corpus.size() * passes);
+    Result res;
+    Counter cycles(PERF_COUNT_HW_CPU_CYCLES);
+    Counter branchMisses(PERF_COUNT_HW_BRANCH_MISSES);
+    const size_t allocationsBefore = allocations;
+    cycles.start();
+    branchMisses.start();
+    for (int pass = 0; pass < passes; ++pass) {
+        for (const auto &json : corpus) {
+            const auto start = std::chrono::steady_clock::now();
+            parse(json);
+            const std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+            latencies.push_back(elapsed.count());
+            res.bytes += json.size();
+        }
+    }
+    res.branchMisses = branchMisses.stop();
+    res.cycles = cycles.stop();
+    for (const auto &json : corpus) {
+        res.tokens += countTokens(json) * passes;
+    }
+    res.messages = latencies.size();
+    res.allocationsPerMessage = static_cast<double>(allocations - allocationsBefore) / res.messages;
+    for (double latency : latencies) {
+        res.seconds += latency / 1e6;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    res.p50 = latencies[latencies.size() / 2];
+    res.p99 = latencies[latencies.size() * 99 / 100];
+    return res;
+}
+
+// per token value of a counter as json, null if the counter was not available
+std::string perToken(double count, size_t tokens) {
+    if (count < 0) {
+        return "null";
+    }
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.3f", count / tokens);
+    return buf;
+}
+
+void report(const Options &options, const char *schema, const char *parser, const Result &res) {
+    fprintf(options.out,
+            "{\"backend\":\"%s\",\"schema\":\"%s\",\"parser\":\"%s\",\"messages\":%zu,\"bytes\":%zu,"
+            "\"mb_per_s\":%.2f,\"msgs_per_s\":%.0f,\"p50_us\":%.3f,\"p99_us\":%.3f,\"allocs_per_msg\":%.2f,"
+            "\"ns_per_token\":%.2f,\"cycles_per_token\":%s,\"branch_misses_per_token\":%s}\n",
+            PROTOG_BENCH_BACKEND, schema, parser, res.messages, res.bytes, res.bytes / res.seconds / 1e6,
+            res.messages / res.seconds, res.p50, res.p99, res.allocationsPerMessage, res.seconds * 1e9 / res.tokens,
+            perToken(res.cycles, res.tokens).c_str(), perToken(res.branchMisses, res.tokens).c_str());
+    fflush(options.out);
+}
+
+template <typename Msg, typename Easy, typename EasyArena>
+void run(const Options &options, const char *schema, const std::vector<std::string> &corpus, Easy easy,
+         EasyArena easyArena) {
+    report(options, schema, "protog", measure(corpus, options.passes, [&](const std::string &json) {
+        Msg msg = easy(json.data(), json.size());
+    }));
+
+    // the arena keeps its initial block across Reset, so steady state parsing does not hit the heap for messages
+    std::vector<char> block(1 << 20);
+    google::protobuf::ArenaOptions arenaOptions;
+    arenaOptions.initial_block = block.data();
+    arenaOptions.initial_block_size = block.size();
+    google::protobuf::Arena arena(arenaOptions);
+    report(options, schema, "protog_arena", measure(corpus, options.passes, [&](const std::string &json) {
+        easyArena(&arena, json.data(), json.size());
+        arena.Reset();
+    }));
+
+    report(options, schema, "json_util", measure(corpus, options.passes, [&](const std::string &json) {
+        Msg msg;
+        if (!google::protobuf::util::JsonStringToMessage(json, &msg).ok()) {
+            fprintf(stderr, "JsonStringToMessage failed for %s\n", json.c_str());
+            exit(1);
+        }
+    }));
+}
+
+} // anonymous namespace
+
+int main(int argc, char **argv) {
+    Options options;
+    int c;
+    while ((c = getopt(argc, argv, "n:p:s:o:")) != -1) {
+        switch (c) {
+        case 'n':
+            options.messages = strtoul(optarg, nullptr, 10);
+            break;
+        case 'p':
+            options.passes = atoi(optarg);
+            break;
+        case 's':
+            options.seed = strtoul(optarg, nullptr, 10);
+            break;
+        case 'o':
+            options.out = fopen(optarg, "a");
+            if (!options.out) {
+                perror(optarg);
+                return 1;
+            }
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n messages] [-p passes] [-s seed] [-o results.json]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (options.messages == 0 || options.passes <= 0) {
+        fprintf(stderr, "messages and passes have to be positive\n");
+        return 1;
+    }
+
+    protog::bench::Corpus corpus(options.seed);
+    std::vector<std::string> bidRequests;
+    std::vector<std::string> nestedMessages;
+    for (size_t i = 0; i < options.messages; ++i) {
+        bidRequests.push_back(corpus.bidRequest(i));
+        nestedMessages.push_back(corpus.nestedMessage(i));
+    }
+
+    using protog::bench::BidRequest;
+    using protog::test::NestedMessage;
+    run<BidRequest>(options, "BidRequest", bidRequests,
+                    [](const char *buf, size_t len) { return protog::bench::bidrequest_parser_easy(buf, len); },
+                    [](google::protobuf::Arena *arena, const char *buf, size_t len) {
+                        return protog::bench::bidrequest_parser_easy_arena(arena, buf, len);
+                    });
+    run<NestedMessage>(options, "NestedMessage", nestedMessages,
+                       [](const char *buf, size_t len) { return protog::test::nestedmessage_parser_easy(buf, len); },
+                       [](google::protobuf::Arena *arena, const char *buf, size_t len) {
+                           return protog::test::nestedmessage_parser_easy_arena(arena, buf, len);
+                       });
+
+    if (options.out != stdout) {
+        fclose(options.out);
+    }
+    return 0;
+}
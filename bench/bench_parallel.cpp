@@ -0,0 +1,90 @@
+// Compares parsing one large newline delimited buffer through the streaming on_chunk path on a single thread with
+// nestedmessage_parser_parallel on an increasing number of threads.
+//
+// usage: protog_parallel_bench [records]
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "corpus.h"
+#include "messages.pb.h"
+#include "nestedmessage_parser.pb.h"
+
+using protog::test::NestedMessage;
+
+static const size_t CHUNK_SIZE = 1 << 20;
+static const int RUNS = 5;
+
+static std::string make_corpus(size_t records) {
+    protog::bench::Corpus corpus(42);
+    std::string out;
+    for (size_t i = 0; i < records; ++i) {
+        out += corpus.nestedMessage(i) + "\n";
+    }
+    return out;
+}
+
+// best of RUNS, in seconds
+template <typename F>
+static double measure(F f) {
+    double best = 1e300;
+    for (int i = 0; i < RUNS; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        f();
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+    }
+    return best;
+}
+
+int main(int argc, char **argv) {
+    const size_t records = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200000;
+    std::string corpus = make_corpus(records);
+    const double mb = corpus.size() / 1e6;
+
+    size_t parsed = 0;
+    const double single = measure([&]() {
+        // keeps the messages like the parallel path does
+        google::protobuf::RepeatedPtrField<NestedMessage> msgs;
+        NestedMessage msg;
+        auto state = nestedmessage_stream_init(msg, [&msgs](NestedMessage &m) { msgs.Add()->Swap(&m); });
+        for (size_t i = 0; i < corpus.size(); i += CHUNK_SIZE) {
+            if (nestedmessage_parser_on_chunk(state, &corpus[i], std::min(CHUNK_SIZE, corpus.size() - i)) != 0) {
+                fprintf(stderr, "on_chunk failed\n");
+                exit(1);
+            }
+        }
+        nestedmessage_parser_complete(state);
+        nestedmessage_parser_free(state);
+        parsed = msgs.size();
+    });
+    if (parsed != records) {
+        fprintf(stderr, "parsed %zu of %zu records\n", parsed, records);
+        return 1;
+    }
+    printf("mode\tthreads\tseconds\tMB/s\tspeedup\n");
+    printf("on_chunk\t1\t%.4f\t%.1f\t1.00\n", single, mb / single);
+
+    const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned threads = 1; ; threads = std::min(threads * 2, cores)) {
+        const double seconds = measure([&]() {
+            google::protobuf::RepeatedPtrField<NestedMessage> msgs;
+            std::string error;
+            if (nestedmessage_parser_parallel(corpus.data(), corpus.size(), msgs, threads, &error) != 0 ||
+                static_cast<size_t>(msgs.size()) != records) {
+                fprintf(stderr, "parallel parsing failed: %s\n", error.c_str());
+                exit(1);
+            }
+        });
+        printf("parallel\t%u\t%.4f\t%.1f\t%.2f\n", threads, seconds, mb / seconds, single / seconds);
+        if (threads == cores) {
+            break;
+        }
+    }
+    return 0;
+}
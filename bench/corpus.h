@@ -0,0 +1,100 @@
+#pragma once
+
+// Deterministic json corpus generators for the benchmarks. The same seed always yields the same documents, so
+// results of different protog versions stay comparable.
+
+#include <stdio.h>
+
+#include <random>
+#include <string>
+
+namespace protog {
+namespace bench {
+
+class Corpus {
+public:
+    explicit Corpus(unsigned seed) : rng_(seed) {}
+
+    // protog.test.NestedMessage
+    std::string nestedMessage(size_t i) {
+        std::string out = R"*({"id":"record-)*" + std::to_string(i) + R"*(","my_inner":{"a":"inner \"quoted\"","b":[)*";
+        for (int j = range(0, 8); j > 0; --j) {
+            out += number(-1e6, 1e6) + (j > 1 ? "," : "");
+        }
+        out += R"*(]},"my_list":[)*";
+        for (int j = range(0, 8); j > 0; --j) {
+            out += R"*({"a":"item","b":[)*" + number(-1e6, 1e6) + "]}" + (j > 1 ? "," : "");
+        }
+        return out + "]}";
+    }
+
+    // protog.bench.BidRequest
+    std::string bidRequest(size_t i) {
+        std::string out = R"*({"id":")*" + hex(32) + R"*(","imp":[)*";
+        for (int j = range(1, 3); j > 0; --j) {
+            out += R"*({"id":")*" + std::to_string(j) + R"*(","tagid":"slot-)*" + std::to_string(range(1, 500)) + "\"";
+            if (range(0, 3) > 0) {
+                const int w = pick({300, 320, 728, 160, 970});
+                const int h = pick({250, 50, 90, 600});
+                out += R"*(,"banner":{"w":)*" + std::to_string(w) + R"*(,"h":)*" + std::to_string(h) +
+                       R"*(,"pos":1,"format":[{"w":)*" + std::to_string(w) + R"*(,"h":)*" + std::to_string(h) +
+                       R"*(},{"w":300,"h":250}],"btype":[1,4]})*";
+            } else {
+                out += R"*(,"video":{"mimes":["video/mp4","video/webm"],"minduration":5,"maxduration":30,)*"
+                       R"*("protocols":[2,3,5,6],"w":640,"h":480})*";
+            }
+            out += R"*(,"bidfloor":)*" + number(0.01, 5) + R"*(,"bidfloorcur":"USD","secure":true})*" +
+                   (j > 1 ? "," : "");
+        }
+        out += R"*(],"site":{"id":")*" + std::to_string(range(1, 100000)) +
+               R"*(","name":"Example News – World","domain":"news.example.com","cat":["IAB12","IAB12-1"],)*"
+               R"*("page":"https://news.example.com/world/)*" + hex(12) +
+               R"*(.html?utm_source=feed&ref=home","publisher":{"id":")*" + std::to_string(range(1, 5000)) +
+               R"*(","name":"Example Media Group","domain":"example.com"}},)*";
+        out += R"*("device":{"ua":"Mozilla/5.0 (Linux; Android 13; Pixel 7) AppleWebKit/537.36 (KHTML, like Gecko) )*"
+               R"*(Chrome/118.0.0.0 Mobile Safari/537.36","geo":{"lat":)*" + number(-90, 90) + R"*(,"lon":)*" +
+               number(-180, 180) + R"*(,"country":"USA","region":"CA","city":"San Francisco","zip":"94107",)*"
+               R"*("type":2},"dnt":false,"ip":"192.168.)*" + std::to_string(range(0, 255)) + "." +
+               std::to_string(range(0, 255)) + R"*(","devicetype":4,"make":"Google","model":"Pixel 7",)*"
+               R"*("os":"Android","osv":"13","w":412,"h":915,"connectiontype":2,"ifa":")*" + uuid() + R"*("},)*";
+        out += R"*("user":{"id":")*" + hex(24) + R"*(","buyeruid":")*" + hex(16) + R"*(","yob":)*" +
+               std::to_string(range(1950, 2005)) + R"*(,"gender":"O"},)*";
+        out += R"*("test":false,"at":2,"tmax":)*" + std::to_string(pick({100, 120, 150, 200})) +
+               R"*(,"cur":["USD"],"bcat":["IAB25","IAB26","IAB7-39"],"badv":["competitor.example"],)*"
+               R"*("timestamp":)*" + std::to_string(1690000000000LL + static_cast<long long>(i) * 17) + "}";
+        return out;
+    }
+
+private:
+    int range(int min, int max) {
+        return std::uniform_int_distribution<int>(min, max)(rng_);
+    }
+
+    int pick(std::initializer_list<int> values) {
+        return values.begin()[range(0, static_cast<int>(values.size()) - 1)];
+    }
+
+    std::string number(double min, double max) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.6g", std::uniform_real_distribution<double>(min, max)(rng_));
+        return buf;
+    }
+
+    std::string hex(size_t len) {
+        static const char digits[] = "0123456789abcdef";
+        std::string out(len, '0');
+        for (auto &c : out) {
+            c = digits[range(0, 15)];
+        }
+        return out;
+    }
+
+    std::string uuid() {
+        return hex(8) + "-" + hex(4) + "-" + hex(4) + "-" + hex(4) + "-" + hex(12);
+    }
+
+    std::mt19937 rng_;
+};
+
+} // namespace bench
+} // namespace protog
@@ -0,0 +1,12 @@
+# Writes OUTPUT defining PROTOG_GENERATOR_VERSION as a hash of every protog source in SOURCE_DIR. It is part of the
+# cache key of the generated files, so any change of the code that generates them invalidates the cache, while
+# rebuilding the same sources keeps it.
+file(GLOB SOURCES RELATIVE ${SOURCE_DIR} ${SOURCE_DIR}/*.h ${SOURCE_DIR}/*.cpp)
+list(SORT SOURCES)
+set(HASHES "")
+foreach(SOURCE ${SOURCES})
+    file(SHA256 ${SOURCE_DIR}/${SOURCE} HASH)
+    set(HASHES "${HASHES}${SOURCE} ${HASH}\n")
+endforeach()
+string(SHA256 VERSION "${HASHES}")
+file(WRITE ${OUTPUT} "#define PROTOG_GENERATOR_VERSION \"${VERSION}\"\n")
@@ -0,0 +1,1039 @@
+#pragma once
+
+#include "parser.h"
+#include "writer.h"
+
+namespace protog {
+
+// Generates a self-contained recursive descent parser. Every object node of the graph gets its own function which
+// only accepts the keys and value types allowed at that position, so no generic tokenizer or callback dispatch sits
+// between the input bytes and the protobuf setters. Strings without escape sequences are copied straight from the
+// input buffer.
+struct FusedWriter : public Writer {
+    virtual ~FusedWriter() {}
+
+    // object parsers update the profiling counters of the parser state, the header-only parser has no such state
+    bool profiled = true;
+    // elements of the element path are passed to the callback of the parser state, see Graph::elementPath
+    bool elementCallbacks = true;
+
+    virtual void write(const Graph &graph, const char* proto_header) override {
+        auto name_lower = graph.root.desc->name();
+        std::transform(name_lower.begin(), name_lower.end(), name_lower.begin(), ::tolower);
+        const auto cpp_type = get_full_cpp_type_name(*graph.root.desc);
+        const auto res_name_prefix = name_lower + "_parser.pb";
+
+        const auto header_name = res_name_prefix + ".h";
+        FILE *header = openOutput();
+        printHeader(header, graph, name_lower.c_str(), cpp_type.c_str(), proto_header);
+        closeOutput(header, header_name);
+
+        const auto source_name = res_name_prefix + ".cc";
+        FILE *source = openOutput();
+        printSource(source, graph, name_lower.c_str(), cpp_type.c_str());
+        closeOutput(source, source_name);
+    }
+
+    void printSource(FILE *file, const Graph &graph, const char *t, const char *c) {
+        printSourceIncludes(file, t);
+        printNamespaceBegin(file, graph);
+        printTypeDefinition(file, graph, t, c);
+        fprintf(file, "namespace {\n\n");
+        printProfileImpl(file, graph, t);
+        printHintsImpl(file, graph, t);
+        printLexer(file, t, true, graph.elementNode != nullptr);
+        if (hasBytesFields(graph)) {
+            printBase64Impl(file, t);
+        }
+        printObjectParsers(file, graph, t);
+        printParseImpl(file, graph, t);
+        fprintf(file, "} // anonymous namespace\n\n");
+        printApiImpl(file, t, c);
+        printPoolImpl(file, graph, t, c);
+        printElementCallbackImpl(file, graph, t);
+        printProfileApiImpl(file, t);
+        printParallelImpl(file, t, c);
+        printFileImpl(file, t, c);
+        printNamespaceEnd(file, graph);
+    }
+
+    void printSourceIncludes(FILE *file, const char *t) {
+        fprintf(file, "#include \"%s_parser.pb.h\"\n\n", t);
+        fprintf(file, "#include <errno.h>\n");
+        fprintf(file, "#include <fcntl.h>\n");
+        fprintf(file, "#include <limits.h>\n");
+        fprintf(file, "#include <math.h>\n");
+        fprintf(file, "#include <stdint.h>\n");
+        fprintf(file, "#include <stdlib.h>\n");
+        fprintf(file, "#include <stdio.h>\n");
+        fprintf(file, "#include <string.h>\n");
+        fprintf(file, "#include <sys/mman.h>\n");
+        fprintf(file, "#include <sys/stat.h>\n");
+        fprintf(file, "#include <unistd.h>\n\n");
+        fprintf(file, "#if defined(__SSSE3__)\n");
+        fprintf(file, "#include <immintrin.h>\n");
+        fprintf(file, "#endif\n");
+        fprintf(file, "#if defined(PROTOG_PROFILE) && (defined(__x86_64__) || defined(__i386__))\n");
+        fprintf(file, "#include <x86intrin.h>\n");
+        fprintf(file, "#endif\n\n");
+        fprintf(file, "#include <algorithm>\n");
+        fprintf(file, "#include <atomic>\n");
+        fprintf(file, "#include <chrono>\n");
+        fprintf(file, "#include <stdexcept>\n");
+        fprintf(file, "#include <string>\n");
+        fprintf(file, "#include <thread>\n");
+        fprintf(file, "#include <vector>\n");
+        fprintf(file, "\n");
+    }
+
+    void printTypeDefinition(FILE *file, const Graph &graph, const char *t, const char *c) {
+        fprintf(file, "struct %s_parser_config_s : %s_parser_config {\n", t, t);
+        fprintf(file, "    bool stream = false; // accept multiple top-level values\n");
+        fprintf(file, "};\n");
+        fprintf(file, "\n");
+        fprintf(file, "// Tracks object boundaries across chunks in streaming mode.\n");
+        fprintf(file, "struct %s_parser_scan_s {\n", t);
+        fprintf(file, "    size_t offset = 0; // of the current chunk in the whole input\n");
+        fprintf(file, "    size_t begin = 0; // offset of the pending object in the whole input\n");
+        fprintf(file, "    size_t depth = 0;\n");
+        fprintf(file, "    bool inString = false;\n");
+        fprintf(file, "    bool escaped = false;\n");
+        fprintf(file, "};\n");
+        printProfileDefinition(file, graph, t);
+        fprintf(file, "struct %s_parser_state_s {\n", t);
+        fprintf(file, "    %s_parser_state_s(%s &req) : req(&req) { }\n\n", t, c);
+        fprintf(file, "    %s_parser_config_s config;\n", t);
+        fprintf(file, "    %s *req;\n", c);
+        fprintf(file, "    std::string buffer; // chunks are collected until complete is called, when streaming only the pending object\n");
+        fprintf(file, "    const char *error = nullptr;\n");
+        fprintf(file, "    size_t errorOffset = 0;\n");
+        fprintf(file, "    %s_parser_error_code errorCode = %s_parser_error_none;\n", t, t);
+        fprintf(file, "    size_t errorState = 0;\n");
+        fprintf(file, "    %s_parser_scan_s scan;\n", t);
+        fprintf(file, "    %s_stream_callback callback;\n", t);
+        if (graph.elementNode) {
+            fprintf(file, "    %s_element_callback elementCallback;\n", t);
+        }
+        fprintf(file, "#if defined(PROTOG_PROFILE)\n");
+        fprintf(file, "    %s_parser_profile_s profile;\n", t);
+        fprintf(file, "#endif\n");
+        fprintf(file, "\n");
+        fprintf(file, "    void reset() {\n");
+        fprintf(file, "        req->Clear();\n");
+        fprintf(file, "        buffer.clear();\n");
+        fprintf(file, "        scan = %s_parser_scan_s();\n", t);
+        fprintf(file, "        error = nullptr;\n");
+        fprintf(file, "        errorOffset = 0;\n");
+        fprintf(file, "        errorCode = %s_parser_error_none;\n", t);
+        fprintf(file, "        errorState = 0;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "};\n");
+        fprintf(file, "\n");
+    }
+
+    // profile adds the counters of the parser state to the lexer, views and the wire transcoder have no such state
+    void printLexer(FILE *file, const char *t, bool profile = false, bool elements = false) {
+        printNumberImpl(file, t);
+        printUtf8Impl(file, t);
+        fprintf(file, "struct %s_parser_lexer {\n", t);
+        fprintf(file, "    const char *begin;\n");
+        fprintf(file, "    const char *p;\n");
+        fprintf(file, "    const char *end;\n");
+        fprintf(file, "    const char *error;\n");
+        fprintf(file, "    int code; // class of the error, numbered like the error codes of the parser api\n");
+        fprintf(file, "    size_t state; // innermost object being parsed\n");
+        fprintf(file, "    bool checkInitialized;\n");
+        fprintf(file, "    bool allowComments;\n");
+        fprintf(file, "    bool done; // every field of the field mask has been parsed\n");
+        fprintf(file, "    size_t depth; // nesting of recursive messages\n");
+        if (profile) {
+            fprintf(file, "#if defined(PROTOG_PROFILE)\n");
+            fprintf(file, "    %s_parser_profile_s *profile;\n", t);
+            fprintf(file, "#endif\n");
+        }
+        if (elements) {
+            fprintf(file, "    const %s_element_callback *elementCallback; // null without a callback, see set_element_callback\n", t);
+        }
+        fprintf(file, "    std::string scratch;\n");
+        fprintf(file, "};\n");
+        fprintf(file, "\n");
+        fprintf(file, "static const size_t %s_parser_lex_max_depth = 1024; // bounds the native stack used by recursive messages\n", t);
+        fprintf(file, "\n");
+        fprintf(file, "enum %s_parser_lex_code {\n", t);
+        int number = 0;
+        for (const auto &code : getErrorCodes()) {
+            fprintf(file, "    %s_parser_lex_%s = %d,\n", t, code.first, ++number);
+        }
+        fprintf(file, "};\n");
+        fprintf(file, "\n");
+        fprintf(file, "%sbool %s_parser_lex_fail(%s_parser_lexer &lex, const char *error, int code = %s_parser_lex_syntax) {\n", linkage, t, t, t);
+        fprintf(file, "    if (!lex.error) {\n");
+        fprintf(file, "        lex.error = error;\n");
+        fprintf(file, "        lex.code = code;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    return false;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "// skips a comment starting at lex.p, an unterminated block comment runs to the end of the input\n");
+        fprintf(file, "%sbool %s_parser_lex_skip_comment(%s_parser_lexer &lex) {\n", linkage, t, t);
+        fprintf(file, "    if (lex.end - lex.p < 2 || (lex.p[1] != '/' && lex.p[1] != '*')) {\n");
+        fprintf(file, "        return false;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    if (lex.p[1] == '/') {\n");
+        fprintf(file, "        const void *nl = memchr(lex.p + 2, '\\n', lex.end - lex.p - 2);\n");
+        fprintf(file, "        lex.p = nl ? static_cast<const char *>(nl) : lex.end;\n");
+        fprintf(file, "        return true;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    for (const char *q = lex.p + 2; q + 1 < lex.end; ++q) {\n");
+        fprintf(file, "        if (q[0] == '*' && q[1] == '/') {\n");
+        fprintf(file, "            lex.p = q + 2;\n");
+        fprintf(file, "            return true;\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    lex.p = lex.end;\n");
+        fprintf(file, "    return true;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "%svoid %s_parser_lex_skip_ws(%s_parser_lexer &lex) {\n", inlineLinkage, t, t);
+        fprintf(file, "    do {\n");
+        fprintf(file, "        while (lex.p != lex.end && (*lex.p == ' ' || *lex.p == '\\n' || *lex.p == '\\r' || *lex.p == '\\t')) {\n");
+        fprintf(file, "            ++lex.p;\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "    } while (lex.allowComments && lex.p != lex.end && *lex.p == '/' && %s_parser_lex_skip_comment(lex));\n", t);
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "%sbool %s_parser_lex_peek(%s_parser_lexer &lex, char c) {\n", inlineLinkage, t, t);
+        fprintf(file, "    %s_parser_lex_skip_ws(lex);\n", t);
+        fprintf(file, "    return lex.p != lex.end && *lex.p == c;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "// a well-formed value where the schema wants another type is not a syntax error\n");
+        fprintf(file, "%sbool %s_parser_lex_unexpected(%s_parser_lexer &lex, bool isValue) {\n", linkage, t, t);
+        fprintf(file, "    const char ch = *lex.p;\n");
+        fprintf(file, "    if (isValue && (ch == '\"' || ch == '{' || ch == '[' || ch == 't' || ch == 'f' || ch == 'n' || ch == '-' ||\n");
+        fprintf(file, "                    (ch >= '0' && ch <= '9'))) {\n");
+        fprintf(file, "        return %s_parser_lex_fail(lex, \"value of the wrong type\", %s_parser_lex_type);\n", t, t);
+        fprintf(file, "    }\n");
+        fprintf(file, "    return %s_parser_lex_fail(lex, \"unallowed token at this point in JSON text\");\n", t);
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "%sbool %s_parser_lex_expect(%s_parser_lexer &lex, char c) {\n", inlineLinkage, t, t);
+        fprintf(file, "    %s_parser_lex_skip_ws(lex);\n", t);
+        fprintf(file, "    if (lex.p == lex.end) {\n");
+        fprintf(file, "        return %s_parser_lex_fail(lex, \"premature EOF\");\n", t);
+        fprintf(file, "    }\n");
+        fprintf(file, "    if (*lex.p != c) {\n");
+        fprintf(file, "        return %s_parser_lex_unexpected(lex, c == '{' || c == '[');\n", t);
+        fprintf(file, "    }\n");
+        fprintf(file, "    ++lex.p;\n");
+        fprintf(file, "    return true;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "%sbool %s_parser_lex_literal(%s_parser_lexer &lex, const char *lit, size_t litLen) {\n", inlineLinkage, t, t);
+        fprintf(file, "    if (static_cast<size_t>(lex.end - lex.p) < litLen || memcmp(lex.p, lit, litLen) != 0) {\n");
+        fprintf(file, "        return %s_parser_lex_fail(lex, \"invalid literal\");\n", t);
+        fprintf(file, "    }\n");
+        fprintf(file, "    lex.p += litLen;\n");
+        fprintf(file, "    return true;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "// validates the whole input up front, so strings can be taken as they are\n");
+        fprintf(file, "%sbool %s_parser_lex_check_utf8(%s_parser_lexer &lex) {\n", linkage, t, t);
+        fprintf(file, "    const size_t valid = %s_parser_utf8_check(lex.begin, lex.end - lex.begin);\n", t);
+        fprintf(file, "    if (valid == static_cast<size_t>(lex.end - lex.begin)) {\n");
+        fprintf(file, "        return true;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    lex.p = lex.begin + valid;\n");
+        fprintf(file, "    return %s_parser_lex_fail(lex, \"invalid bytes in UTF8 string.\", %s_parser_lex_utf8);\n", t, t);
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "%sint %s_parser_lex_hex(char c) {\n", linkage, t);
+        fprintf(file, "    if (c >= '0' && c <= '9') return c - '0';\n");
+        fprintf(file, "    if (c >= 'a' && c <= 'f') return c - 'a' + 10;\n");
+        fprintf(file, "    if (c >= 'A' && c <= 'F') return c - 'A' + 10;\n");
+        fprintf(file, "    return -1;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "%sbool %s_parser_lex_hex4(const char *q, const char *end, unsigned &cp) {\n", linkage, t);
+        fprintf(file, "    if (end - q < 4) {\n");
+        fprintf(file, "        return false;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    cp = 0;\n");
+        fprintf(file, "    for (int i = 0; i < 4; ++i) {\n");
+        fprintf(file, "        const int h = %s_parser_lex_hex(q[i]);\n", t);
+        fprintf(file, "        if (h < 0) {\n");
+        fprintf(file, "            return false;\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "        cp = (cp << 4) | static_cast<unsigned>(h);\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    return true;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "%svoid %s_parser_lex_put_utf8(std::string &out, unsigned cp) {\n", linkage, t);
+        fprintf(file, "    if (cp < 0x80) {\n");
+        fprintf(file, "        out += static_cast<char>(cp);\n");
+        fprintf(file, "    } else if (cp < 0x800) {\n");
+        fprintf(file, "        out += static_cast<char>(0xC0 | (cp >> 6));\n");
+        fprintf(file, "        out += static_cast<char>(0x80 | (cp & 0x3F));\n");
+        fprintf(file, "    } else if (cp < 0x10000) {\n");
+        fprintf(file, "        out += static_cast<char>(0xE0 | (cp >> 12));\n");
+        fprintf(file, "        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));\n");
+        fprintf(file, "        out += static_cast<char>(0x80 | (cp & 0x3F));\n");
+        fprintf(file, "    } else {\n");
+        fprintf(file, "        out += static_cast<char>(0xF0 | (cp >> 18));\n");
+        fprintf(file, "        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));\n");
+        fprintf(file, "        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));\n");
+        fprintf(file, "        out += static_cast<char>(0x80 | (cp & 0x3F));\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "// slow path for strings containing escape sequences, they get decoded into lex.scratch\n");
+        fprintf(file, "%sbool %s_parser_lex_string_escaped(%s_parser_lexer &lex, const char *start, const char *q,\n", linkage, t, t);
+        fprintf(file, "                                        const char *&v, size_t &vLen) {\n");
+        fprintf(file, "    std::string &out = lex.scratch;\n");
+        fprintf(file, "    out.assign(start, q - start);\n");
+        fprintf(file, "    while (q != lex.end && *q != '\"') {\n");
+        fprintf(file, "        const unsigned char ch = static_cast<unsigned char>(*q);\n");
+        fprintf(file, "        if (ch < 0x20) {\n");
+        fprintf(file, "            lex.p = q;\n");
+        fprintf(file, "            return %s_parser_lex_fail(lex, \"invalid character inside string.\");\n", t);
+        fprintf(file, "        }\n");
+        fprintf(file, "        if (ch != '\\\\') {\n");
+        fprintf(file, "            out += *q++;\n");
+        fprintf(file, "            continue;\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "        if (++q == lex.end) {\n");
+        fprintf(file, "            break;\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "        switch (*q++) {\n");
+        fprintf(file, "            case '\"': out += '\"'; break;\n");
+        fprintf(file, "            case '\\\\': out += '\\\\'; break;\n");
+        fprintf(file, "            case '/': out += '/'; break;\n");
+        fprintf(file, "            case 'b': out += '\\b'; break;\n");
+        fprintf(file, "            case 'f': out += '\\f'; break;\n");
+        fprintf(file, "            case 'n': out += '\\n'; break;\n");
+        fprintf(file, "            case 'r': out += '\\r'; break;\n");
+        fprintf(file, "            case 't': out += '\\t'; break;\n");
+        fprintf(file, "            case 'u': {\n");
+        fprintf(file, "                unsigned cp;\n");
+        fprintf(file, "                if (!%s_parser_lex_hex4(q, lex.end, cp)) {\n", t);
+        fprintf(file, "                    lex.p = q;\n");
+        fprintf(file, "                    return %s_parser_lex_fail(lex, \"invalid (non-hex) character occurs after '\\\\u' inside string.\");\n", t);
+        fprintf(file, "                }\n");
+        fprintf(file, "                q += 4;\n");
+        fprintf(file, "                if (cp >= 0xD800 && cp < 0xDC00 && lex.end - q >= 6 && q[0] == '\\\\' && q[1] == 'u') {\n");
+        fprintf(file, "                    unsigned lo;\n");
+        fprintf(file, "                    if (%s_parser_lex_hex4(q + 2, lex.end, lo) && lo >= 0xDC00 && lo < 0xE000) {\n", t);
+        fprintf(file, "                        cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);\n");
+        fprintf(file, "                        q += 6;\n");
+        fprintf(file, "                    }\n");
+        fprintf(file, "                }\n");
+        fprintf(file, "                %s_parser_lex_put_utf8(out, cp);\n", t);
+        fprintf(file, "                break;\n");
+        fprintf(file, "            }\n");
+        fprintf(file, "            default:\n");
+        fprintf(file, "                lex.p = q - 1;\n");
+        fprintf(file, "                return %s_parser_lex_fail(lex, \"inside a JSON string, a character was escaped which shouldn't be\");\n", t);
+        fprintf(file, "        }\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    if (q == lex.end) {\n");
+        fprintf(file, "        lex.p = q;\n");
+        fprintf(file, "        return %s_parser_lex_fail(lex, \"premature EOF\");\n", t);
+        fprintf(file, "    }\n");
+        fprintf(file, "    v = out.data();\n");
+        fprintf(file, "    vLen = out.size();\n");
+        fprintf(file, "    lex.p = q + 1;\n");
+        fprintf(file, "    return true;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "// strings without escape sequences are returned as pointers into the input buffer\n");
+        fprintf(file, "%sbool %s_parser_lex_string(%s_parser_lexer &lex, const char *&v, size_t &vLen, bool isKey = false) {\n", inlineLinkage, t, t);
+        fprintf(file, "    %s_parser_lex_skip_ws(lex);\n", t);
+        fprintf(file, "    if (lex.p == lex.end) {\n");
+        fprintf(file, "        return %s_parser_lex_fail(lex, \"premature EOF\");\n", t);
+        fprintf(file, "    }\n");
+        fprintf(file, "    if (*lex.p != '\"') {\n");
+        fprintf(file, "        return %s_parser_lex_unexpected(lex, !isKey);\n", t);
+        fprintf(file, "    }\n");
+        fprintf(file, "    ++lex.p;\n");
+        fprintf(file, "    const char *start = lex.p;\n");
+        fprintf(file, "    const char *q = start;\n");
+        fprintf(file, "    for (; q != lex.end; ++q) {\n");
+        fprintf(file, "        const unsigned char ch = static_cast<unsigned char>(*q);\n");
+        fprintf(file, "        if (ch == '\"') {\n");
+        fprintf(file, "            break;\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "        if (ch == '\\\\') {\n");
+        fprintf(file, "            return %s_parser_lex_string_escaped(lex, start, q, v, vLen);\n", t);
+        fprintf(file, "        }\n");
+        fprintf(file, "        if (ch < 0x20) {\n");
+        fprintf(file, "            lex.p = q;\n");
+        fprintf(file, "            return %s_parser_lex_fail(lex, \"invalid character inside string.\");\n", t);
+        fprintf(file, "        }\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    if (q == lex.end) {\n");
+        fprintf(file, "        lex.p = q;\n");
+        fprintf(file, "        return %s_parser_lex_fail(lex, \"premature EOF\");\n", t);
+        fprintf(file, "    }\n");
+        fprintf(file, "    v = start;\n");
+        fprintf(file, "    vLen = q - start;\n");
+        fprintf(file, "    lex.p = q + 1;\n");
+        fprintf(file, "    return true;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "%sbool %s_parser_lex_number(%s_parser_lexer &lex, const char *&num, size_t &numLen, bool &isInteger) {\n", linkage, t, t);
+        fprintf(file, "    %s_parser_lex_skip_ws(lex);\n", t);
+        fprintf(file, "    const char *q = lex.p;\n");
+        fprintf(file, "    isInteger = true;\n");
+        fprintf(file, "    if (q != lex.end && *q == '-') {\n");
+        fprintf(file, "        ++q;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    if (q == lex.end || *q < '0' || *q > '9') {\n");
+        fprintf(file, "        if (q == lex.end) {\n");
+        fprintf(file, "            return %s_parser_lex_fail(lex, \"premature EOF\");\n", t);
+        fprintf(file, "        }\n");
+        fprintf(file, "        return %s_parser_lex_unexpected(lex, q == lex.p);\n", t);
+        fprintf(file, "    }\n");
+        fprintf(file, "    if (*q == '0') {\n");
+        fprintf(file, "        ++q;\n");
+        fprintf(file, "    } else {\n");
+        fprintf(file, "        while (q != lex.end && *q >= '0' && *q <= '9') ++q;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    if (q != lex.end && *q == '.') {\n");
+        fprintf(file, "        isInteger = false;\n");
+        fprintf(file, "        ++q;\n");
+        fprintf(file, "        if (q == lex.end || *q < '0' || *q > '9') {\n");
+        fprintf(file, "            lex.p = q;\n");
+        fprintf(file, "            return %s_parser_lex_fail(lex, \"malformed number, a digit is required after the decimal point.\");\n", t);
+        fprintf(file, "        }\n");
+        fprintf(file, "        while (q != lex.end && *q >= '0' && *q <= '9') ++q;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    if (q != lex.end && (*q == 'e' || *q == 'E')) {\n");
+        fprintf(file, "        isInteger = false;\n");
+        fprintf(file, "        ++q;\n");
+        fprintf(file, "        if (q != lex.end && (*q == '+' || *q == '-')) {\n");
+        fprintf(file, "            ++q;\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "        if (q == lex.end || *q < '0' || *q > '9') {\n");
+        fprintf(file, "            lex.p = q;\n");
+        fprintf(file, "            return %s_parser_lex_fail(lex, \"malformed number, a digit is required after the exponent.\");\n", t);
+        fprintf(file, "        }\n");
+        fprintf(file, "        while (q != lex.end && *q >= '0' && *q <= '9') ++q;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    num = lex.p;\n");
+        fprintf(file, "    numLen = q - lex.p;\n");
+        fprintf(file, "    lex.p = q;\n");
+        fprintf(file, "    return true;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        for (const char *kind : {"int32", "int64", "uint32", "uint64"}) {
+            fprintf(file, "%sbool %s_parser_lex_%s(%s_parser_lexer &lex, %s_t &v) {\n", inlineLinkage, t, kind, t, kind);
+            fprintf(file, "    const char *num;\n");
+            fprintf(file, "    size_t numLen;\n");
+            fprintf(file, "    bool isInteger;\n");
+            fprintf(file, "    if (!%s_parser_lex_number(lex, num, numLen, isInteger)) {\n", t);
+            fprintf(file, "        return false;\n");
+            fprintf(file, "    }\n");
+            fprintf(file, "    if (!isInteger) {\n");
+            fprintf(file, "        lex.p = num;\n");
+            fprintf(file, "        return %s_parser_lex_fail(lex, \"state does not allow double\", %s_parser_lex_type);\n", t, t);
+            fprintf(file, "    }\n");
+            fprintf(file, "    if (!%s_parser_number_%s(num, numLen, v)) {\n", t, kind);
+            fprintf(file, "        lex.p = num;\n");
+            fprintf(file, "        return %s_parser_lex_fail(lex, \"integer out of range\", %s_parser_lex_range);\n", t, t);
+            fprintf(file, "    }\n");
+            fprintf(file, "    return true;\n");
+            fprintf(file, "}\n");
+            fprintf(file, "\n");
+        }
+        fprintf(file, "%sbool %s_parser_lex_double(%s_parser_lexer &lex, double &v) {\n", inlineLinkage, t, t);
+        fprintf(file, "    const char *num;\n");
+        fprintf(file, "    size_t numLen;\n");
+        fprintf(file, "    bool isInteger;\n");
+        fprintf(file, "    if (!%s_parser_lex_number(lex, num, numLen, isInteger)) {\n", t);
+        fprintf(file, "        return false;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    if (!%s_parser_number_double(num, numLen, v)) {\n", t);
+        fprintf(file, "        lex.p = num;\n");
+        fprintf(file, "        return %s_parser_lex_fail(lex, \"numeric (floating point) overflow\", %s_parser_lex_range);\n", t, t);
+        fprintf(file, "    }\n");
+        fprintf(file, "    return true;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "%sbool %s_parser_lex_boolean(%s_parser_lexer &lex, bool &v) {\n", inlineLinkage, t, t);
+        fprintf(file, "    %s_parser_lex_skip_ws(lex);\n", t);
+        fprintf(file, "    if (lex.p != lex.end && *lex.p == 't') {\n");
+        fprintf(file, "        v = true;\n");
+        fprintf(file, "        return %s_parser_lex_literal(lex, \"true\", 4);\n", t);
+        fprintf(file, "    }\n");
+        fprintf(file, "    if (lex.p != lex.end && *lex.p == 'f') {\n");
+        fprintf(file, "        v = false;\n");
+        fprintf(file, "        return %s_parser_lex_literal(lex, \"false\", 5);\n", t);
+        fprintf(file, "    }\n");
+        fprintf(file, "    int64_t i; // like the yajl backend, integers are accepted as booleans and anything but 0 is true\n");
+        fprintf(file, "    if (!%s_parser_lex_int64(lex, i)) {\n", t);
+        fprintf(file, "        return false;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    v = i != 0;\n");
+        fprintf(file, "    return true;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "%sbool %s_parser_lex_null(%s_parser_lexer &lex) {\n", inlineLinkage, t, t);
+        fprintf(file, "    return %s_parser_lex_literal(lex, \"null\", 4);\n", t);
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "%sbool %s_parser_lex_end_of_value(%s_parser_lexer &lex, bool &more, char close) {\n", linkage, t, t);
+        fprintf(file, "    %s_parser_lex_skip_ws(lex);\n", t);
+        fprintf(file, "    if (lex.p == lex.end) {\n");
+        fprintf(file, "        return %s_parser_lex_fail(lex, \"premature EOF\");\n", t);
+        fprintf(file, "    }\n");
+        fprintf(file, "    if (*lex.p == ',') {\n");
+        fprintf(file, "        ++lex.p;\n");
+        fprintf(file, "        more = true;\n");
+        fprintf(file, "        return true;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    if (*lex.p == close) {\n");
+        fprintf(file, "        ++lex.p;\n");
+        fprintf(file, "        more = false;\n");
+        fprintf(file, "        return true;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    return %s_parser_lex_fail(lex, close == '}' ? \"after key and value, inside map, I expect ',' or '}'\"\n", t);
+        fprintf(file, "                                               : \"after array element, I expect ',' or ']'\");\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        if (skipUnknown) {
+            fprintf(file, "// Moves past the next value without keeping it, but checks its syntax like any other value. Open objects\n");
+            fprintf(file, "// and arrays are tracked by the bracket that closes them, so both kinds have to match.\n");
+            fprintf(file, "%sbool %s_parser_lex_skip(%s_parser_lexer &lex) {\n", linkage, t, t);
+            fprintf(file, "    char close[%s_parser_lex_max_depth];\n", t);
+            fprintf(file, "    size_t depth = 0;\n");
+            fprintf(file, "    for (;;) {\n");
+            fprintf(file, "        %s_parser_lex_skip_ws(lex);\n", t);
+            fprintf(file, "        if (lex.p == lex.end) {\n");
+            fprintf(file, "            return %s_parser_lex_fail(lex, \"premature EOF\");\n", t);
+            fprintf(file, "        }\n");
+            fprintf(file, "        const char ch = *lex.p;\n");
+            fprintf(file, "        const char *v;\n");
+            fprintf(file, "        size_t vLen;\n");
+            fprintf(file, "        bool ok;\n");
+            fprintf(file, "        if (ch == '{' || ch == '[') {\n");
+            fprintf(file, "            if (depth == %s_parser_lex_max_depth) {\n", t);
+            fprintf(file, "                return %s_parser_lex_fail(lex, \"maximum nesting depth exceeded\", %s_parser_lex_depth);\n", t, t);
+            fprintf(file, "            }\n");
+            fprintf(file, "            close[depth++] = ch == '{' ? '}' : ']';\n");
+            fprintf(file, "            ++lex.p;\n");
+            fprintf(file, "            if (!%s_parser_lex_peek(lex, close[depth - 1])) {\n", t);
+            fprintf(file, "                if (ch == '{' && (!%s_parser_lex_string(lex, v, vLen, true) || !%s_parser_lex_expect(lex, ':'))) {\n", t, t);
+            fprintf(file, "                    return false;\n");
+            fprintf(file, "                }\n");
+            fprintf(file, "                continue; // first member or element\n");
+            fprintf(file, "            }\n");
+            fprintf(file, "            ++lex.p;\n");
+            fprintf(file, "            --depth;\n");
+            fprintf(file, "            ok = true;\n");
+            fprintf(file, "        } else if (ch == '\"') {\n");
+            fprintf(file, "            ok = %s_parser_lex_string(lex, v, vLen);\n", t);
+            fprintf(file, "        } else if (ch == 't') {\n");
+            fprintf(file, "            ok = %s_parser_lex_literal(lex, \"true\", 4);\n", t);
+            fprintf(file, "        } else if (ch == 'f') {\n");
+            fprintf(file, "            ok = %s_parser_lex_literal(lex, \"false\", 5);\n", t);
+            fprintf(file, "        } else if (ch == 'n') {\n");
+            fprintf(file, "            ok = %s_parser_lex_literal(lex, \"null\", 4);\n", t);
+            fprintf(file, "        } else {\n");
+            fprintf(file, "            bool isInteger;\n");
+            fprintf(file, "            ok = %s_parser_lex_number(lex, v, vLen, isInteger);\n", t);
+            fprintf(file, "        }\n");
+            fprintf(file, "        if (!ok) {\n");
+            fprintf(file, "            return false;\n");
+            fprintf(file, "        }\n");
+            fprintf(file, "        // after a complete value, either the next member or element follows or its container closes\n");
+            fprintf(file, "        for (;;) {\n");
+            fprintf(file, "            if (depth == 0) {\n");
+            fprintf(file, "                return true;\n");
+            fprintf(file, "            }\n");
+            fprintf(file, "            bool more;\n");
+            fprintf(file, "            if (!%s_parser_lex_end_of_value(lex, more, close[depth - 1])) {\n", t);
+            fprintf(file, "                return false;\n");
+            fprintf(file, "            }\n");
+            fprintf(file, "            if (more) {\n");
+            fprintf(file, "                break;\n");
+            fprintf(file, "            }\n");
+            fprintf(file, "            --depth;\n");
+            fprintf(file, "        }\n");
+            fprintf(file, "        if (close[depth - 1] == '}' && (!%s_parser_lex_string(lex, v, vLen, true) || !%s_parser_lex_expect(lex, ':'))) {\n", t, t);
+            fprintf(file, "            return false;\n");
+            fprintf(file, "        }\n");
+            fprintf(file, "    }\n");
+            fprintf(file, "}\n");
+            fprintf(file, "\n");
+        }
+    }
+
+    void printObjectParsers(FILE *file, const Graph &graph, const char *t) {
+        if (graph.shareTypes) { // shared object nodes may be called from anywhere, including themselves
+            for (const auto &node : graph.object_nodes) {
+                fprintf(file, "%sbool %s_parser_parse_%d(%s_parser_lexer &lex, %s *msg);\n", linkage, t, node->state, t,
+                        get_full_cpp_type_name(*getMessageDesc(*node)).c_str());
+            }
+            fprintf(file, "\n");
+        }
+        // object nodes are listed parents first, so walk them backwards to define callees before their callers
+        for (auto it = graph.object_nodes.rbegin(); it != graph.object_nodes.rend(); ++it) {
+            printObjectParser(file, graph, **it, t);
+        }
+    }
+
+    void printObjectParser(FILE *file, const Graph &graph, const Node &node, const char *t) {
+        const auto cpp_type = get_full_cpp_type_name(*getMessageDesc(node));
+        const bool earlyExit = !node.parent && hasEarlyExit(graph);
+        fprintf(file, "// map %s\n", node.full_name.c_str());
+        fprintf(file, "%sbool %s_parser_parse_%d(%s_parser_lexer &lex, %s *msg) {\n", linkage, t, node.state, t, cpp_type.c_str());
+        if (earlyExit) {
+            fprintf(file, "    uint64_t seen = 0;\n");
+        }
+        if (graph.recursive) {
+            printDepthCheck(file, t);
+        }
+        if (profiled) {
+            fprintf(file, "#if defined(PROTOG_PROFILE)\n");
+            fprintf(file, "    %s_parser_profile_scope profileScope(*lex.profile, %d);\n", t, node.state);
+            fprintf(file, "#endif\n");
+        }
+        fprintf(file, "    const size_t outer = lex.state;\n");
+        fprintf(file, "    lex.state = %d;\n", node.state);
+        fprintf(file, "    if (%s_parser_lex_peek(lex, '}')) {\n", t);
+        fprintf(file, "        ++lex.p;\n");
+        fprintf(file, "    } else {\n");
+        fprintf(file, "        bool more = true;\n");
+        fprintf(file, "        while (more) {\n");
+        fprintf(file, "            const char *key;\n");
+        fprintf(file, "            size_t keyLen;\n");
+        fprintf(file, "            if (!%s_parser_lex_string(lex, key, keyLen, true) || !%s_parser_lex_expect(lex, ':')) {\n", t, t);
+        fprintf(file, "                return false;\n");
+        fprintf(file, "            }\n");
+        printKeySwitch(file, node.children, "key", "keyLen", "            ", [&](const Node& child, const std::string& indent) {
+            printFieldValue(file, graph, child, t, indent);
+            if (earlyExit) {
+                const auto bit = std::find(node.children.begin(), node.children.end(), &child) - node.children.begin();
+                fprintf(file, "%sseen |= UINT64_C(%llu);\n", indent.c_str(), 1ull << bit);
+            }
+            fprintf(file, "%sgoto next;\n", indent.c_str());
+        });
+        if (skipUnknown) {
+            fprintf(file, "            if (!%s_parser_lex_skip(lex)) {\n", t);
+            fprintf(file, "                return false;\n");
+            fprintf(file, "            }\n");
+        } else {
+            fprintf(file, "            return %s_parser_lex_fail(lex, \"invalid key for %s\", %s_parser_lex_key);\n", t, node.full_name.c_str(), t);
+        }
+        if (!node.children.empty()) {
+            fprintf(file, "        next:\n");
+        }
+        if (earlyExit) {
+            fprintf(file, "            if (seen == UINT64_C(%llu)) {\n", static_cast<unsigned long long>(getEarlyExitMask(graph)));
+            fprintf(file, "                lex.done = true;\n");
+            fprintf(file, "                lex.state = outer;\n");
+            fprintf(file, "                return true;\n");
+            fprintf(file, "            }\n");
+        }
+        fprintf(file, "            if (!%s_parser_lex_end_of_value(lex, more, '}')) {\n", t);
+        fprintf(file, "                return false;\n");
+        fprintf(file, "            }\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "    }\n");
+        if (graph.fieldMask.empty()) { // required fields might not be part of the mask
+            fprintf(file, "    if (lex.checkInitialized && !msg->IsInitialized()) {\n");
+            fprintf(file, "        return %s_parser_lex_fail(lex, \"required field missing\", %s_parser_lex_required);\n", t, t);
+            fprintf(file, "    }\n");
+        }
+        if (graph.recursive) {
+            fprintf(file, "    --lex.depth;\n");
+        }
+        fprintf(file, "    lex.state = outer;\n");
+        fprintf(file, "    return true;\n");
+        fprintf(file, "}\n\n");
+    }
+
+    void printDepthCheck(FILE *file, const char *t) {
+        fprintf(file, "    if (++lex.depth > %s_parser_lex_max_depth) {\n", t);
+        fprintf(file, "        return %s_parser_lex_fail(lex, \"maximum nesting depth exceeded\", %s_parser_lex_depth);\n", t, t);
+        fprintf(file, "    }\n");
+    }
+
+    void printFieldValue(FILE *file, const Graph &graph, const Node &node, const char *t, const std::string &indent) {
+        const bool nullable = std::find(graph.null_nodes.begin(), graph.null_nodes.end(), &node) != graph.null_nodes.end();
+        auto inner = indent;
+        if (profiled) {
+            fprintf(file, "%sPROTOG_PROFILE_HIT(*lex.profile, %d);\n", indent.c_str(), node.state);
+        }
+        if (nullable) {
+            fprintf(file, "%sif (%s_parser_lex_peek(lex, 'n')) {\n", indent.c_str(), t);
+            fprintf(file, "%s    if (!%s_parser_lex_null(lex)) {\n", indent.c_str(), t);
+            fprintf(file, "%s        return false;\n", indent.c_str());
+            fprintf(file, "%s    }\n", indent.c_str());
+            fprintf(file, "%s    msg->clear_%s();\n", indent.c_str(), node.name.c_str());
+            fprintf(file, "%s} else {\n", indent.c_str());
+            inner += "    ";
+        }
+        if (node.type == NodeType::ARRAY) {
+            assert(node.children.size() == 1);
+            const char *i = inner.c_str();
+            fprintf(file, "%sif (!%s_parser_lex_expect(lex, '[')) {\n", i, t);
+            fprintf(file, "%s    return false;\n", i);
+            fprintf(file, "%s}\n", i);
+            fprintf(file, "%sif (%s_parser_lex_peek(lex, ']')) {\n", i, t);
+            fprintf(file, "%s    ++lex.p;\n", i);
+            fprintf(file, "%s} else {\n", i);
+            printReserveHint(file, graph, node, t, "msg", inner + "    ");
+            fprintf(file, "%s    bool more = true;\n", i);
+            fprintf(file, "%s    while (more) {\n", i);
+            printValue(file, graph, *node.children[0], t, inner + "        ");
+            fprintf(file, "%s        if (!%s_parser_lex_end_of_value(lex, more, ']')) {\n", i, t);
+            fprintf(file, "%s            return false;\n", i);
+            fprintf(file, "%s        }\n", i);
+            fprintf(file, "%s    }\n", i);
+            fprintf(file, "%s}\n", i);
+            printUpdateHint(file, graph, node, t, "msg", inner);
+        } else if (node.type == NodeType::MAP) {
+            assert(node.children.size() == 1);
+            const char *i = inner.c_str();
+            const auto keyType = getMapKeyType(getMapKey(node));
+            fprintf(file, "%sif (!%s_parser_lex_expect(lex, '{')) {\n", i, t);
+            fprintf(file, "%s    return false;\n", i);
+            fprintf(file, "%s}\n", i);
+            fprintf(file, "%sif (%s_parser_lex_peek(lex, '}')) {\n", i, t);
+            fprintf(file, "%s    ++lex.p;\n", i);
+            fprintf(file, "%s} else {\n", i);
+            fprintf(file, "%s    auto &map = *msg->mutable_%s();\n", i, node.name.c_str());
+            fprintf(file, "%s    %s mapKey;\n", i, keyType.c_str());
+            fprintf(file, "%s    bool more = true;\n", i);
+            fprintf(file, "%s    while (more) {\n", i);
+            fprintf(file, "%s        const char *key;\n", i);
+            fprintf(file, "%s        size_t keyLen;\n", i);
+            fprintf(file, "%s        if (!%s_parser_lex_string(lex, key, keyLen, true) || !%s_parser_lex_expect(lex, ':')) {\n", i, t, t);
+            fprintf(file, "%s            return false;\n", i);
+            fprintf(file, "%s        }\n", i);
+            printMapKey(file, getMapKey(node), t, "key", "keyLen", "mapKey", inner + "        ", [&](const std::string &indent) {
+                fprintf(file, "%sreturn %s_parser_lex_fail(lex, \"invalid map key\", %s_parser_lex_key);\n", indent.c_str(), t, t);
+            });
+            printValue(file, graph, *node.children[0], t, inner + "        ");
+            fprintf(file, "%s        if (!%s_parser_lex_end_of_value(lex, more, '}')) {\n", i, t);
+            fprintf(file, "%s            return false;\n", i);
+            fprintf(file, "%s        }\n", i);
+            fprintf(file, "%s    }\n", i);
+            fprintf(file, "%s}\n", i);
+        } else {
+            printValue(file, graph, node, t, inner);
+        }
+        if (nullable) {
+            fprintf(file, "%s}\n", indent.c_str());
+        }
+    }
+
+    // map values are built in place in the entry of the current key, see printFieldValue
+    void printValue(FILE *file, const Graph &graph, const Node &node, const char *t, const std::string &indent) {
+        const char *i = indent.c_str();
+        const char *name = node.name.c_str();
+        const bool repeated = node.field->is_repeated();
+        const bool mapValue = isMapValue(node);
+        const char *verb = repeated ? "add" : "set";
+        const auto setter = mapValue ? std::string("map[mapKey] = ") : std::string("msg->") + verb + "_" + name;
+        const auto target = mapValue ? std::string("&map[mapKey]") : std::string("msg->") + (repeated ? "add" : "mutable") + "_" + name + "()";
+        switch (node.type) {
+            case NodeType::BOOL:
+                fprintf(file, "%sbool v;\n", i);
+                fprintf(file, "%sif (!%s_parser_lex_boolean(lex, v)) {\n", i, t);
+                fprintf(file, "%s    return false;\n", i);
+                fprintf(file, "%s}\n", i);
+                fprintf(file, "%s%s(v);\n", i, setter.c_str());
+                break;
+            case NodeType::LONG:
+                fprintf(file, "%s%s_t v;\n", i, getNumberKind(*node.field));
+                fprintf(file, "%sif (!%s_parser_lex_%s(lex, v)) {\n", i, t, getNumberKind(*node.field));
+                fprintf(file, "%s    return false;\n", i);
+                fprintf(file, "%s}\n", i);
+                if (node.field->type() == FieldDescriptor::TYPE_ENUM) {
+                    const auto enum_type = get_full_cpp_type_name(*node.field->enum_type());
+                    fprintf(file, "%s%s(static_cast<%s>(v));\n", i, setter.c_str(), enum_type.c_str());
+                } else {
+                    fprintf(file, "%s%s(v);\n", i, setter.c_str());
+                }
+                break;
+            case NodeType::DOUBLE:
+                fprintf(file, "%sdouble v;\n", i);
+                fprintf(file, "%sif (!%s_parser_lex_double(lex, v)) {\n", i, t);
+                fprintf(file, "%s    return false;\n", i);
+                fprintf(file, "%s}\n", i);
+                fprintf(file, "%s%s(v);\n", i, setter.c_str());
+                break;
+            case NodeType::STRING:
+                fprintf(file, "%sconst char *v;\n", i);
+                fprintf(file, "%ssize_t vLen;\n", i);
+                fprintf(file, "%sif (!%s_parser_lex_string(lex, v, vLen)) {\n", i, t);
+                fprintf(file, "%s    return false;\n", i);
+                fprintf(file, "%s}\n", i);
+                if (node.field->type() == FieldDescriptor::TYPE_BYTES) {
+                    fprintf(file, "%sstd::string *bytes = %s;\n", i, target.c_str());
+                    if (!repeated) {
+                        fprintf(file, "%sbytes->clear();\n", i);
+                    }
+                    fprintf(file, "%sif (!%s_parser_base64_decode(v, vLen, *bytes)) {\n", i, t);
+                    fprintf(file, "%s    return %s_parser_lex_fail(lex, \"invalid base64 string\", %s_parser_lex_base64);\n", i, t, t);
+                    fprintf(file, "%s}\n", i);
+                } else {
+                    fprintf(file, "%s%sassign(v, vLen);\n", i, mapValue ? "map[mapKey]." : (target + "->").c_str());
+                }
+                break;
+            case NodeType::OUTSIDE_OBJECT:
+                assert(node.children.size() == 1);
+                fprintf(file, "%sif (!%s_parser_lex_expect(lex, '{') ||\n", i, t);
+                fprintf(file, "%s    !%s_parser_parse_%d(lex, %s)) {\n", i, t, node.children[0]->state, target.c_str());
+                fprintf(file, "%s    return false;\n", i);
+                fprintf(file, "%s}\n", i);
+                if (elementCallbacks && node.parent == graph.elementNode) {
+                    fprintf(file, "%sif (lex.elementCallback) {\n", i);
+                    fprintf(file, "%s    auto *elements = msg->mutable_%s();\n", i, name);
+                    fprintf(file, "%s    (*lex.elementCallback)(*elements->Mutable(elements->size() - 1));\n", i);
+                    fprintf(file, "%s    elements->RemoveLast();\n", i);
+                    fprintf(file, "%s}\n", i);
+                }
+                break;
+            default:
+                throw std::runtime_error("Unexpected node type for " + node.full_name);
+        }
+    }
+
+    void printParseImpl(FILE *file, const Graph &graph, const char *t) {
+        fprintf(file, "%sint %s_parser_impl_parse(%s_parser_state_s &state, const char *buf, size_t bufLen) {\n", linkage, t, t);
+        fprintf(file, "    %s_parser_lexer lex;\n", t);
+        fprintf(file, "    lex.begin = buf;\n");
+        fprintf(file, "    lex.p = buf;\n");
+        fprintf(file, "    lex.end = buf + bufLen;\n");
+        fprintf(file, "    lex.error = nullptr;\n");
+        fprintf(file, "    lex.code = %s_parser_error_none;\n", t);
+        fprintf(file, "    lex.state = 0;\n");
+        fprintf(file, "    lex.checkInitialized = state.config.checkInitialized;\n");
+        fprintf(file, "    lex.allowComments = state.config.allowComments;\n");
+        fprintf(file, "#if defined(PROTOG_PROFILE)\n");
+        fprintf(file, "    lex.profile = &state.profile;\n");
+        fprintf(file, "#endif\n");
+        if (graph.elementNode) {
+            fprintf(file, "    lex.elementCallback = state.elementCallback ? &state.elementCallback : nullptr;\n");
+        }
+        fprintf(file, "    lex.done = false;\n");
+        fprintf(file, "    lex.depth = 0;\n");
+        fprintf(file, "    if ((!state.config.validateUtf8 || %s_parser_lex_check_utf8(lex)) && %s_parser_lex_expect(lex, '{') &&\n", t, t);
+        fprintf(file, "        %s_parser_parse_1(lex, state.req)) {\n", t);
+        fprintf(file, "        if (lex.done || state.config.allowTrailingGarbage) {\n");
+        fprintf(file, "            return 0;\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "        %s_parser_lex_skip_ws(lex);\n", t);
+        fprintf(file, "        if (lex.p == lex.end) {\n");
+        fprintf(file, "            return 0;\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "        %s_parser_lex_fail(lex, \"trailing garbage\");\n", t);
+        fprintf(file, "    }\n");
+        fprintf(file, "    state.error = lex.error;\n");
+        fprintf(file, "    state.errorOffset = lex.p - lex.begin;\n");
+        fprintf(file, "    state.errorCode = static_cast<%s_parser_error_code>(lex.code);\n", t);
+        fprintf(file, "    state.errorState = lex.state;\n");
+        fprintf(file, "    return 1;\n");
+        fprintf(file, "}\n\n");
+        fprintf(file, "// Scans a chunk for complete top-level objects and parses each of them as soon as it is closed. Objects within\n");
+        fprintf(file, "// the chunk are parsed in place, only an object spanning chunks is collected in the buffer.\n");
+        fprintf(file, "%sint %s_parser_impl_stream(%s_parser_state_s &state, const char *chunk, size_t chunkLen) {\n", linkage, t, t);
+        fprintf(file, "    if (state.error) {\n");
+        fprintf(file, "        return 1;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    %s_parser_scan_s &scan = state.scan;\n", t);
+        fprintf(file, "    size_t begin = 0; // of the pending object in the chunk, unless it started in an earlier one\n");
+        fprintf(file, "    for (size_t i = 0; i < chunkLen; ++i) {\n");
+        fprintf(file, "        const char ch = chunk[i];\n");
+        fprintf(file, "        if (scan.depth == 0) {\n");
+        fprintf(file, "            if (ch == '{') {\n");
+        fprintf(file, "                begin = i;\n");
+        fprintf(file, "                scan.begin = scan.offset + i;\n");
+        fprintf(file, "                scan.depth = 1;\n");
+        fprintf(file, "            } else if (ch != ' ' && ch != '\\n' && ch != '\\r' && ch != '\\t') {\n");
+        fprintf(file, "                state.error = \"unallowed token at this point in JSON text\";\n");
+        fprintf(file, "                state.errorOffset = scan.offset + i;\n");
+        fprintf(file, "                state.errorCode = %s_parser_error_syntax;\n", t);
+        fprintf(file, "                return 1;\n");
+        fprintf(file, "            }\n");
+        fprintf(file, "        } else if (scan.inString) {\n");
+        fprintf(file, "            if (scan.escaped) {\n");
+        fprintf(file, "                scan.escaped = false;\n");
+        fprintf(file, "            } else if (ch == '\\\\') {\n");
+        fprintf(file, "                scan.escaped = true;\n");
+        fprintf(file, "            } else if (ch == '\"') {\n");
+        fprintf(file, "                scan.inString = false;\n");
+        fprintf(file, "            }\n");
+        fprintf(file, "        } else if (ch == '\"') {\n");
+        fprintf(file, "            scan.inString = true;\n");
+        fprintf(file, "        } else if (ch == '{' || ch == '[') {\n");
+        fprintf(file, "            ++scan.depth;\n");
+        fprintf(file, "        } else if ((ch == '}' || ch == ']') && --scan.depth == 0) {\n");
+        fprintf(file, "            int rc;\n");
+        fprintf(file, "            if (state.buffer.empty()) {\n");
+        fprintf(file, "                rc = %s_parser_impl_parse(state, chunk + begin, i + 1 - begin);\n", t);
+        fprintf(file, "            } else {\n");
+        fprintf(file, "                state.buffer.append(chunk, i + 1);\n");
+        fprintf(file, "                rc = %s_parser_impl_parse(state, state.buffer.data(), state.buffer.size());\n", t);
+        fprintf(file, "                state.buffer.clear();\n");
+        fprintf(file, "            }\n");
+        fprintf(file, "            if (rc != 0) {\n");
+        fprintf(file, "                state.errorOffset += scan.begin;\n");
+        fprintf(file, "                return 1;\n");
+        fprintf(file, "            }\n");
+        fprintf(file, "            state.callback(*state.req);\n");
+        fprintf(file, "            state.req->Clear();\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    if (scan.depth != 0) { // keep the start of the pending object for the next chunk\n");
+        fprintf(file, "        const size_t from = state.buffer.empty() ? begin : 0;\n");
+        fprintf(file, "        state.buffer.append(chunk + from, chunkLen - from);\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    scan.offset += chunkLen;\n");
+        fprintf(file, "    return 0;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "%sstd::string %s_parser_impl_format_error(const %s_parser_state_s &state) {\n", linkage, t, t);
+        fprintf(file, "    return std::string(\"parse error: \") + (state.error ? state.error : \"unknown error\") +\n");
+        fprintf(file, "           \" at offset \" + std::to_string(state.errorOffset) + \"\\n\";\n");
+        fprintf(file, "}\n\n");
+    }
+
+    void printApiImpl(FILE *file, const char *t, const char *c) {
+        fprintf(file, "%svoid %s_parser_impl_easy(%s &msg, const char *buf, size_t bufLen) {\n", linkage, t, c);
+        fprintf(file, "    %s_parser_state_s state(msg);\n", t);
+        fprintf(file, "    state.config.checkInitialized = true;\n");
+        fprintf(file, "    state.config.stream = false;\n");
+        fprintf(file, "\n");
+        fprintf(file, "    if (%s_parser_impl_parse(state, buf, bufLen) != 0) {\n", t);
+        fprintf(file, "        throw std::runtime_error(%s_parser_impl_format_error(state));\n", t);
+        fprintf(file, "    }\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "int %s_parser_try_easy(%s &msg, const char *buf, size_t bufLen, %s_parser_error_s *error) {\n", t, c, t);
+        fprintf(file, "    %s_parser_state_s state(msg);\n", t);
+        fprintf(file, "    state.config.checkInitialized = true;\n");
+        fprintf(file, "    state.config.stream = false;\n");
+        fprintf(file, "    const int rc = %s_parser_impl_parse(state, buf, bufLen);\n", t);
+        fprintf(file, "    if (rc != 0 && error) {\n");
+        fprintf(file, "        *error = {state.errorCode, state.errorOffset, state.errorState};\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    return rc;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "%s %s_parser_easy(const std::string &json) {\n", c, t);
+        fprintf(file, "    return %s_parser_easy(json.c_str(), json.size());\n", t);
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "%s %s_parser_easy(const char *buf, size_t bufLen) {\n", c, t);
+        fprintf(file, "    %s msg;\n", c);
+        fprintf(file, "    %s_parser_impl_easy(msg, buf, bufLen);\n", t);
+        fprintf(file, "    return msg;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "%s *%s_parser_easy_arena(::google::protobuf::Arena *arena, const std::string &json) {\n", c, t);
+        fprintf(file, "    return %s_parser_easy_arena(arena, json.c_str(), json.size());\n", t);
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "%s *%s_parser_easy_arena(::google::protobuf::Arena *arena, const char *buf, size_t bufLen) {\n", c, t);
+        fprintf(file, "    %s *msg = ::google::protobuf::Arena::CreateMessage<%s>(arena);\n", c, c);
+        fprintf(file, "    %s_parser_impl_easy(*msg, buf, bufLen);\n", t);
+        fprintf(file, "    return msg;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "%s_parser_state_t %s_parser_init(%s &msg) {\n", t, t, c);
+        fprintf(file, "    %s_parser_state_t state = new %s_parser_state_s(msg);\n", t, t);
+        fprintf(file, "    state->config.checkInitialized = true;\n");
+        fprintf(file, "    state->config.stream = false;\n");
+        fprintf(file, "    return state;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "%s_parser_state_t %s_parser_init(%s &msg, const %s_parser_config &config) {\n", t, t, c, t);
+        fprintf(file, "    %s_parser_state_t state = new %s_parser_state_s(msg);\n", t, t);
+        fprintf(file, "    static_cast<%s_parser_config &>(state->config) = config;\n", t);
+        fprintf(file, "    return state;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "%s_parser_state_t %s_stream_init(%s &msg, %s_stream_callback callback) {\n", t, t, c, t);
+        fprintf(file, "    %s_parser_state_t state = new %s_parser_state_s(msg);\n", t, t);
+        fprintf(file, "    state->config.checkInitialized = true;\n");
+        fprintf(file, "    state->config.stream = true;\n");
+        fprintf(file, "    state->callback = std::move(callback);\n");
+        fprintf(file, "    return state;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "void %s_parser_free(%s_parser_state_t state) {\n", t, t);
+        fprintf(file, "    assert(state);\n");
+        fprintf(file, "    delete state;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "int %s_parser_on_chunk(%s_parser_state_t state, char *chunk, size_t chunkLen) {\n", t, t);
+        fprintf(file, "    assert(state);\n");
+        fprintf(file, "    if (state->config.stream) {\n");
+        fprintf(file, "        return %s_parser_impl_stream(*state, chunk, chunkLen);\n", t);
+        fprintf(file, "    }\n");
+        fprintf(file, "    state->buffer.append(chunk, chunkLen);\n");
+        fprintf(file, "    return 0;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "int %s_parser_complete(%s_parser_state_t state) {\n", t, t);
+        fprintf(file, "    assert(state);\n");
+        fprintf(file, "    if (state->config.stream) {\n");
+        fprintf(file, "        if (!state->error && state->scan.depth != 0) {\n");
+        fprintf(file, "            state->error = \"premature EOF\";\n");
+        fprintf(file, "            state->errorOffset = state->scan.offset;\n");
+        fprintf(file, "            state->errorCode = %s_parser_error_syntax;\n", t);
+        fprintf(file, "        }\n");
+        fprintf(file, "        return state->error != nullptr;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    return %s_parser_impl_parse(*state, state->buffer.data(), state->buffer.size());\n", t);
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "int %s_parser_reset(%s_parser_state_t state) {\n", t, t);
+        fprintf(file, "    assert(state);\n");
+        fprintf(file, "    if (state) {\n");
+        fprintf(file, "        state->reset();\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    return 0;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "int %s_parser_rebind(%s_parser_state_t state, %s &msg) {\n", t, t, c);
+        fprintf(file, "    assert(state);\n");
+        fprintf(file, "    state->req = &msg;\n");
+        fprintf(file, "    state->buffer.clear();\n");
+        fprintf(file, "    state->scan = %s_parser_scan_s();\n", t);
+        fprintf(file, "    state->error = nullptr;\n");
+        fprintf(file, "    state->errorOffset = 0;\n");
+        fprintf(file, "    state->errorCode = %s_parser_error_none;\n", t);
+        fprintf(file, "    state->errorState = 0;\n");
+        fprintf(file, "    return 0;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "char *%s_parser_get_error(%s_parser_state_t state) {\n", t, t);
+        fprintf(file, "    return %s_parser_get_error(state, 0, 0, 0);\n", t);
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "char *%s_parser_get_error(%s_parser_state_t state, int verbose, const char *chunk,\n", t, t);
+        fprintf(file, "                                  size_t chunkLen) {\n");
+        fprintf(file, "    assert(state);\n");
+        fprintf(file, "    const auto err = %s_parser_impl_format_error(*state);\n", t);
+        fprintf(file, "    return strdup(err.c_str());\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "void %s_parser_free_error(%s_parser_state_t state, char *err) {\n", t, t);
+        fprintf(file, "    free(err);\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "%s_parser_error_s %s_parser_last_error(%s_parser_state_t state) {\n", t, t, t);
+        fprintf(file, "    assert(state);\n");
+        fprintf(file, "    return {state->errorCode, state->errorOffset, state->errorState};\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        printErrorStringImpl(file, t);
+    }
+};
+
+} // namespace protog
@@ -0,0 +1,175 @@
+#pragma once
+
+#include "fused_writer.h"
+#include "parser.h"
+
+namespace protog {
+
+// Generates the fused parser as a single header with a protog::parse<Msg> specialization. All of it is inline, so the
+// compiler sees the whole parser at the call site and can inline it into the caller's loop, without the heap allocated
+// state behind the opaque handle of the parser api. The fused printers emit their functions with inline linkage here,
+// so every translation unit shares one definition. Such functions must not odr-use objects with internal linkage, which
+// is why tables and thread local state are function-local statics, constants which need no initialization at runtime.
+struct InlineWriter : public FusedWriter {
+    InlineWriter() {
+        profiled = false;
+        elementCallbacks = false;
+        linkage = "inline ";
+        inlineLinkage = "inline ";
+    }
+    virtual ~InlineWriter() {}
+
+    virtual void write(const Graph &graph, const char* proto_header) override {
+        auto name_lower = graph.root.desc->name();
+        std::transform(name_lower.begin(), name_lower.end(), name_lower.begin(), ::tolower);
+        const auto cpp_type = get_full_cpp_type_name(*graph.root.desc);
+        const auto inline_name = name_lower + "_inline";
+
+        const auto header_name = inline_name + ".pb.h";
+        FILE *header = openOutput();
+        printInlineHeader(header, graph, inline_name.c_str(), cpp_type.c_str(), proto_header);
+        closeOutput(header, header_name);
+    }
+
+    void printInlineHeader(FILE *file, const Graph &graph, const char *t, const char *c, const char* h) {
+        fprintf(file, "#pragma once\n\n");
+        fprintf(file, "#include <errno.h>\n");
+        fprintf(file, "#include <limits.h>\n");
+        fprintf(file, "#include <math.h>\n");
+        fprintf(file, "#include <stddef.h>\n");
+        fprintf(file, "#include <stdint.h>\n");
+        fprintf(file, "#include <stdlib.h>\n");
+        fprintf(file, "#include <stdio.h>\n");
+        fprintf(file, "#include <string.h>\n\n");
+        fprintf(file, "#if defined(__SSSE3__)\n");
+        fprintf(file, "#include <immintrin.h>\n");
+        fprintf(file, "#endif\n\n");
+        fprintf(file, "#include <string>\n\n");
+        fprintf(file, "#include \"%s\"\n\n", h);
+        printParseApi(file);
+        printNamespaceBegin(file, graph);
+        printHintsImpl(file, graph, t);
+        printLexer(file, t);
+        if (hasBytesFields(graph)) {
+            printBase64Impl(file, t);
+        }
+        printStateNames(file, graph, t);
+        printObjectParsers(file, graph, t);
+        printInlineParseImpl(file, t, c);
+
+        printNamespaceEnd(file, graph);
+        fprintf(file, "\n");
+        printSpecializations(file, graph, t, c);
+    }
+
+    // The templates shared by all generated headers, every message specializes them. Error codes are numbered like
+    // those of the parser api.
+    void printParseApi(FILE *file) {
+        fprintf(file, "#ifndef PROTOG_PARSE_API\n");
+        fprintf(file, "#define PROTOG_PARSE_API\n\n");
+        fprintf(file, "namespace protog {\n\n");
+        fprintf(file, "enum parse_error_code {\n");
+        fprintf(file, "    parse_error_none = 0,\n");
+        for (const auto &code : getErrorCodes()) {
+            fprintf(file, "    parse_error_%s, // %s\n", code.first, code.second);
+        }
+        fprintf(file, "};\n");
+        fprintf(file, "\n");
+        fprintf(file, "struct parse_error {\n");
+        fprintf(file, "    parse_error_code code;\n");
+        fprintf(file, "    size_t offset; // into the input\n");
+        fprintf(file, "    size_t state; // innermost object being parsed, see parse_state_name\n");
+        fprintf(file, "    const char *message;\n");
+        fprintf(file, "};\n");
+        fprintf(file, "\n");
+        fprintf(file, "struct parse_config {\n");
+        fprintf(file, "    bool validateUtf8 = true; // reject input which is not valid utf-8, checked a whole block at a time\n");
+        fprintf(file, "    bool allowComments = false; // accept // and /* */ comments wherever whitespace is allowed\n");
+        fprintf(file, "    bool allowTrailingGarbage = false; // ignore anything after the top-level object\n");
+        fprintf(file, "    bool checkInitialized = true; // fail when required fields are missing\n");
+        fprintf(file, "};\n");
+        fprintf(file, "\n");
+        fprintf(file, "// Parses json into msg and merges it like the *_parser_try_easy functions. Returns non-zero and fills in error\n");
+        fprintf(file, "// on failure. Only declared here, the generated *_inline.pb.h headers specialize it for their message.\n");
+        fprintf(file, "template <typename Msg>\n");
+        fprintf(file, "int parse(Msg &msg, const char *buf, size_t bufLen, parse_error *error = nullptr,\n");
+        fprintf(file, "          const parse_config &config = parse_config());\n");
+        fprintf(file, "\n");
+        fprintf(file, "// Path of a state reported in parse_error, nullptr for unknown states.\n");
+        fprintf(file, "template <typename Msg>\n");
+        fprintf(file, "const char *parse_state_name(size_t state);\n");
+        fprintf(file, "\n");
+        fprintf(file, "} // namespace protog\n\n");
+        fprintf(file, "#endif // PROTOG_PARSE_API\n\n");
+    }
+
+    void printStateNames(FILE *file, const Graph &graph, const char *t) {
+        std::vector<std::string> names(graph.stateCounter + 1);
+        for (const auto &node : graph.all_nodes) {
+            names[node->state] = node->full_name;
+        }
+        fprintf(file, "%sconst char *%s_parser_state_name(size_t state) {\n", inlineLinkage, t);
+        fprintf(file, "    static constexpr const char *names[%zu] = {\n", names.size());
+        for (const auto &name : names) {
+            fprintf(file, "        \"%s\",\n", name.c_str());
+        }
+        fprintf(file, "    };\n");
+        fprintf(file, "    return state < sizeof(names) / sizeof(names[0]) ? names[state] : nullptr;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+    }
+
+    void printInlineParseImpl(FILE *file, const char *t, const char *c) {
+        fprintf(file, "%sint %s_parser_parse(%s &msg, const char *buf, size_t bufLen, ::protog::parse_error *error,\n", linkage, t, c);
+        fprintf(file, "                           const ::protog::parse_config &config) {\n");
+        fprintf(file, "    %s_parser_lexer lex;\n", t);
+        fprintf(file, "    lex.begin = buf;\n");
+        fprintf(file, "    lex.p = buf;\n");
+        fprintf(file, "    lex.end = buf + bufLen;\n");
+        fprintf(file, "    lex.error = nullptr;\n");
+        fprintf(file, "    lex.code = 0;\n");
+        fprintf(file, "    lex.state = 0;\n");
+        fprintf(file, "    lex.checkInitialized = config.checkInitialized;\n");
+        fprintf(file, "    lex.allowComments = config.allowComments;\n");
+        fprintf(file, "    lex.done = false;\n");
+        fprintf(file, "    lex.depth = 0;\n");
+        fprintf(file, "    if ((!config.validateUtf8 || %s_parser_lex_check_utf8(lex)) && %s_parser_lex_expect(lex, '{') &&\n", t, t);
+        fprintf(file, "        %s_parser_parse_1(lex, &msg)) {\n", t);
+        fprintf(file, "        if (lex.done || config.allowTrailingGarbage) {\n");
+        fprintf(file, "            return 0;\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "        %s_parser_lex_skip_ws(lex);\n", t);
+        fprintf(file, "        if (lex.p == lex.end) {\n");
+        fprintf(file, "            return 0;\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "        %s_parser_lex_fail(lex, \"trailing garbage\");\n", t);
+        fprintf(file, "    }\n");
+        fprintf(file, "    if (error) {\n");
+        fprintf(file, "        error->code = static_cast<::protog::parse_error_code>(lex.code);\n");
+        fprintf(file, "        error->offset = lex.p - lex.begin;\n");
+        fprintf(file, "        error->state = lex.state;\n");
+        fprintf(file, "        error->message = lex.error;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    return 1;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+    }
+
+    void printSpecializations(FILE *file, const Graph &graph, const char *t, const char *c) {
+        const auto ns = "::" + replace_all(graph.fileDesc->package(), ".", "::") + (graph.fileDesc->package().empty() ? "" : "::");
+        fprintf(file, "namespace protog {\n\n");
+        fprintf(file, "template <>\n");
+        fprintf(file, "inline int parse<%s>(%s &msg, const char *buf, size_t bufLen, parse_error *error, const parse_config &config) {\n", c, c);
+        fprintf(file, "    return %s%s_parser_parse(msg, buf, bufLen, error, config);\n", ns.c_str(), t);
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "template <>\n");
+        fprintf(file, "inline const char *parse_state_name<%s>(size_t state) {\n", c);
+        fprintf(file, "    return %s%s_parser_state_name(state);\n", ns.c_str(), t);
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "} // namespace protog\n");
+    }
+};
+
+} // namespace protog
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace protog {
+
+// Saving of the generated files. A file is only rewritten when its content changed, so regenerating with the same
+// inputs keeps the timestamps and does not trigger recompiles of everything including it. The optional cache maps a
+// hash of all inputs to the files generated from them and skips parsing the proto file and generating on a hit.
+
+using Outputs = std::vector<std::pair<std::string, std::string>>;
+
+// 64 bit FNV-1a, chain calls by passing the previous result as hash
+inline uint64_t hashBytes(const std::string &data, uint64_t hash = 14695981039346656037ull) {
+    for (unsigned char ch : data) {
+        hash = (hash ^ ch) * 1099511628211ull;
+    }
+    return hash;
+}
+
+inline bool readFile(const std::string &path, std::string &content) {
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    content.clear();
+    char buf[1 << 16];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+        content.append(buf, n);
+    }
+    const bool ok = !ferror(file);
+    fclose(file);
+    return ok;
+}
+
+// writes to a temporary file renamed over path, so concurrent readers never see a partial file
+inline bool writeFile(const std::string &path, const std::string &content) {
+    const auto tmp = path + ".tmp" + std::to_string(getpid());
+    FILE *file = fopen(tmp.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    bool ok = fwrite(content.data(), 1, content.size(), file) == content.size();
+    ok = fclose(file) == 0 && ok;
+    ok = ok && rename(tmp.c_str(), path.c_str()) == 0;
+    if (!ok) {
+        remove(tmp.c_str());
+    }
+    return ok;
+}
+
+// returns 1 when the file was written, 0 when it already had this content and -1 on errors
+inline int writeIfChanged(const std::string &path, const std::string &content) {
+    std::string existing;
+    if (readFile(path, existing) && existing == content) {
+        return 0;
+    }
+    return writeFile(path, content) ? 1 : -1;
+}
+
+// A cache entry is a single file named by the hex input hash, holding every output as name, length and content on
+// consecutive lines. Entries are written atomically and never modified, parallel builds can share one directory.
+struct OutputCache {
+    std::string dir;
+
+    std::string entryPath(uint64_t key) const {
+        char name[17];
+        snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+        return dir + "/" + name;
+    }
+
+    bool load(uint64_t key, Outputs &outputs) const {
+        std::string entry;
+        if (!readFile(entryPath(key), entry)) {
+            return false;
+        }
+        Outputs loaded;
+        size_t pos = 0;
+        while (pos < entry.size()) {
+            const auto nameEnd = entry.find('\n', pos);
+            const auto lengthEnd = nameEnd == std::string::npos ? nameEnd : entry.find('\n', nameEnd + 1);
+            if (lengthEnd == std::string::npos) {
+                return false;
+            }
+            const auto length = strtoull(entry.c_str() + nameEnd + 1, nullptr, 10);
+            if (length > entry.size() - lengthEnd - 1) {
+                return false;
+            }
+            loaded.emplace_back(entry.substr(pos, nameEnd - pos), entry.substr(lengthEnd + 1, length));
+            pos = lengthEnd + 1 + length;
+        }
+        outputs = std::move(loaded);
+        return true;
+    }
+
+    bool store(uint64_t key, const Outputs &outputs) const {
+        if (mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST) {
+            return false;
+        }
+        std::string entry;
+        for (const auto &output : outputs) {
+            entry += output.first + "\n" + std::to_string(output.second.size()) + "\n" + output.second;
+        }
+        return writeFile(entryPath(key), entry);
+    }
+};
+
+} // namespace protog
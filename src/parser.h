@@ -6,6 +6,8 @@
 
 #include <algorithm>
 #include <functional>
+#include <map>
+#include <set>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -35,6 +37,7 @@ enum class NodeType : int {
     OUTSIDE_OBJECT = 5,
     INSIDE_OBJECT = 6,
     ARRAY = 7,
+    MAP = 8, // json object with arbitrary keys, its only child is the value node
 };
 
 static NodeType getNodeTypeForProtoType(FieldDescriptor::Type type) {
@@ -44,7 +47,7 @@ static NodeType getNodeTypeForProtoType(FieldDescriptor::Type type) {
         case FieldDescriptor::TYPE_INT32:
         case FieldDescriptor::TYPE_INT64:
         case FieldDescriptor::TYPE_UINT32:
-        case FieldDescriptor::TYPE_UINT64: // TODO: test for data loss!
+        case FieldDescriptor::TYPE_UINT64:
         case FieldDescriptor::TYPE_FIXED32:
         case FieldDescriptor::TYPE_FIXED64:
         case FieldDescriptor::TYPE_SFIXED32:
@@ -56,12 +59,12 @@ static NodeType getNodeTypeForProtoType(FieldDescriptor::Type type) {
         case FieldDescriptor::TYPE_DOUBLE:
             return NodeType::DOUBLE;
         case FieldDescriptor::TYPE_STRING:
+        case FieldDescriptor::TYPE_BYTES: // base64 encoded
             return NodeType::STRING;
         case FieldDescriptor::TYPE_MESSAGE:
             return NodeType::OUTSIDE_OBJECT;
         case FieldDescriptor::TYPE_ENUM:
             return NodeType::LONG;
-        case FieldDescriptor::TYPE_BYTES: // TODO
         default:
             throw std::runtime_error("Unsupported protobuf type " + std::to_string(static_cast<int>(type)));
     }
@@ -96,7 +99,7 @@ static std::vector<std::string> split(const std::string& str, const char delim,
 struct Node {
     // structure
     Node *parent;
-    std::vector<Node*> children;
+    std::vector<Node*> children; // children with a different parent are shared object nodes, see Graph::shareTypes
 
     // node info
     NodeType type;
@@ -109,7 +112,9 @@ struct Node {
 
     ~Node() {
         for(auto& child : children) {
-            delete child;
+            if (child->parent == this) {
+                delete child;
+            }
         }
     }
 };
@@ -131,6 +136,23 @@ struct Graph {
     std::vector<Node *> object_nodes;
     std::vector<Node *> key_nodes;
     std::vector<Node *> array_nodes;
+    std::vector<Node *> map_nodes;
+
+    // dotted field paths to keep, like "imp.banner.w". Selecting a message keeps all of its fields, an empty mask
+    // keeps everything.
+    std::vector<std::string> fieldMask;
+
+    // dotted path of a repeated message field, like "records", whose elements are handed to a callback as soon as
+    // they are complete instead of being kept in the message. elementNode is its array node.
+    std::string elementPath;
+    const Node *elementNode = nullptr;
+
+    // Expand every message type only once. Further fields of that type link to the first object node of the type
+    // instead of owning a copy of its subtree, so parsers need a runtime stack of return locations. This is required
+    // for self-referencing messages, which set recursive.
+    bool shareTypes = false;
+    bool recursive = false;
+    std::map<const Descriptor *, Node *> typeNodes;
 
     Graph(const std::string &fname, const std::string &msgName) : fname(fname), msgName(msgName) {
         root.state = ++stateCounter;
@@ -182,13 +204,57 @@ struct Graph {
         root.desc = &desc;
         root.field = nullptr;
         addNodeToTypeLists(root);
+        if (shareTypes) {
+            if (!fieldMask.empty()) {
+                throw std::runtime_error("A field mask can not be combined with shared message types");
+            }
+            typeNodes[&desc] = &root;
+        }
+        if (shareTypes && !elementPath.empty()) {
+            throw std::runtime_error("An element path can not be combined with shared message types");
+        }
+
+        std::set<std::string> paths;
+        parseMessageDescRec(desc, root, "", paths);
+        for (const auto &selected : fieldMask) {
+            if (!paths.count(selected)) {
+                throw std::runtime_error("Unable to find field " + selected + " of the field mask in " + msgName);
+            }
+        }
+        if (!elementPath.empty()) {
+            for (const Node *node : array_nodes) {
+                if (node->full_name == "." + elementPath && node->field->type() == FieldDescriptor::TYPE_MESSAGE) {
+                    elementNode = node;
+                }
+            }
+            if (!elementNode) {
+                throw std::runtime_error("Unable to find repeated message field " + elementPath + " outside of arrays in " + msgName);
+            }
+        }
+    }
 
-        parseMessageDescRec(desc, root);
+    bool isSelected(const std::string &path) const {
+        if (fieldMask.empty()) {
+            return true;
+        }
+        for (const auto &selected : fieldMask) {
+            // the field itself, a field below a selected message or a message on the way to a selected field
+            if (selected == path || path.compare(0, selected.size() + 1, selected + ".") == 0 ||
+                selected.compare(0, path.size() + 1, path + ".") == 0) {
+                return true;
+            }
+        }
+        return false;
     }
 
-    void parseMessageDescRec(const Descriptor &desc, Node &node) {
+    void parseMessageDescRec(const Descriptor &desc, Node &node, const std::string &prefix, std::set<std::string> &paths) {
         for (int f = 0; f < desc.field_count(); ++f) {
             const FieldDescriptor &fieldDesc = *desc.field(f);
+            const auto path = prefix + fieldDesc.name();
+            if (!isSelected(path)) {
+                continue;
+            }
+            paths.insert(path);
             const auto type = getNodeTypeForProtoType(fieldDesc.type());
             const auto isRepeated = fieldDesc.is_repeated();
 
@@ -198,13 +264,23 @@ struct Graph {
             child.field = &fieldDesc;
             child.desc = &desc;
 
-            if (!isRepeated) {
+            if (fieldDesc.is_map()) {
+                const FieldDescriptor &keyDesc = *fieldDesc.message_type()->map_key();
+                const FieldDescriptor &valueDesc = *fieldDesc.message_type()->map_value();
+                const auto valueType = getNodeTypeForProtoType(valueDesc.type());
+                child.type = NodeType::MAP;
+                child.type_name = "{" + getTypeNameForFieldDesc(keyDesc) + ":" + getTypeNameForFieldDesc(valueDesc) + "}";
+                addNodeToTypeLists(child);
+                Node& valueChild = injectMapValueNode(desc, valueDesc, valueType, child);
+                if (valueType == NodeType::OUTSIDE_OBJECT) {
+                    parseObjectNode(desc, valueDesc, valueChild, path, paths);
+                }
+            } else if (!isRepeated) {
                 child.type = type;
                 child.type_name = getTypeNameForFieldDesc(fieldDesc);
                 addNodeToTypeLists(child);
                 if (type == NodeType::OUTSIDE_OBJECT) {
-                    Node& objChild = injectObjectNode(desc, fieldDesc, child);
-                    parseMessageDescRec(*fieldDesc.message_type(), objChild);
+                    parseObjectNode(desc, fieldDesc, child, path, paths);
                 }
             } else {
                 child.type = NodeType::ARRAY;
@@ -212,11 +288,35 @@ struct Graph {
                 addNodeToTypeLists(child);
                 Node& arrChild = injectArrayNode(desc, fieldDesc, type, child);
                 if (type == NodeType::OUTSIDE_OBJECT) {
-                    Node& objChild = injectObjectNode(desc, fieldDesc, arrChild);
-                    parseMessageDescRec(*fieldDesc.message_type(), objChild);
+                    parseObjectNode(desc, fieldDesc, arrChild, path, paths);
+                }
+            }
+        }
+    }
+
+    void parseObjectNode(const Descriptor &desc, const FieldDescriptor &fieldDesc, Node &keyNode,
+                         const std::string &path, std::set<std::string> &paths) {
+        const Descriptor *type = fieldDesc.message_type();
+        if (shareTypes) {
+            const auto it = typeNodes.find(type);
+            if (it != typeNodes.end()) {
+                keyNode.children.push_back(it->second);
+                for (const Node *n = &keyNode; n; n = n->parent) {
+                    recursive = recursive || n == it->second;
                 }
+                return;
+            }
+        }
+        for (const Node *n = &keyNode; !shareTypes && n; n = n->parent) {
+            if (n->type == NodeType::INSIDE_OBJECT && (n->parent ? n->field->message_type() : n->desc) == type) {
+                throw std::runtime_error("Message " + type->full_name() + " references itself, which requires shared message types");
             }
         }
+        Node& objChild = injectObjectNode(desc, fieldDesc, keyNode);
+        if (shareTypes) {
+            typeNodes[type] = &objChild;
+        }
+        parseMessageDescRec(*type, objChild, path + ".", paths);
     }
 
     Node& injectArrayNode(const Descriptor &desc, const FieldDescriptor& fieldDesc, NodeType type, Node& node) {
@@ -231,6 +331,20 @@ struct Graph {
         return arrChild;
     }
 
+    // The value node of a map keeps the name of the map field, but the field of the entry value. Values are inserted
+    // into the map of the message which holds the map field, which is desc.
+    Node& injectMapValueNode(const Descriptor &desc, const FieldDescriptor& valueDesc, NodeType type, Node& node) {
+        Node &valueChild = addChild(node);
+        valueChild.name = node.name;
+        valueChild.full_name = node.full_name + "{}";
+        valueChild.type = type;
+        valueChild.type_name = getTypeNameForFieldDesc(valueDesc);
+        valueChild.field = &valueDesc;
+        valueChild.desc = &desc;
+        addNodeToTypeLists(valueChild);
+        return valueChild;
+    }
+
     Node& injectObjectNode(const Descriptor &desc, const FieldDescriptor& fieldDesc, Node& keyNode) {
         Node &objNode = addChild(keyNode);
         objNode.name = keyNode.name;
@@ -246,7 +360,8 @@ struct Graph {
     void addNodeToTypeLists(Node &node) {
         assert(node.state);
         all_nodes.push_back(&node);
-        if (node.field && (node.field->is_optional() || node.field->is_repeated())) {
+        const bool mapValue = node.parent && node.parent->type == NodeType::MAP;
+        if (node.field && (node.field->is_optional() || node.field->is_repeated()) && !mapValue) {
             null_nodes.push_back(&node);
         }
         switch (node.type) {
@@ -260,7 +375,7 @@ struct Graph {
                 break;
             case NodeType::DOUBLE:
                 double_nodes.push_back(&node);
-                // TODO: hack to allow ints as doubles. shall we switch to number anyways?
+                // integers are valid doubles, both arrive through the number callback
                 long_nodes.push_back(&node);
                 break;
             case NodeType::STRING:
@@ -275,6 +390,9 @@ struct Graph {
             case NodeType::ARRAY:
                 array_nodes.push_back(&node);
                 break;
+            case NodeType::MAP:
+                map_nodes.push_back(&node);
+                break;
         }
     }
 
@@ -286,6 +404,21 @@ struct Graph {
         return child;
     }
 
+    // number of messages being filled at the same time on the deepest path, including the root message
+    int getMaxMessageDepth() const {
+        return getMaxMessageDepthRec(root);
+    }
+
+    int getMaxMessageDepthRec(const Node& node) const {
+        int depth = 0;
+        for (const auto &child : node.children) {
+            if (child->parent == &node) {
+                depth = std::max(depth, getMaxMessageDepthRec(*child));
+            }
+        }
+        return node.type == NodeType::INSIDE_OBJECT ? depth + 1 : depth;
+    }
+
     void printDebug(FILE* file) const {
         printDebugRec(file, root, 0);
     }
@@ -293,7 +426,9 @@ struct Graph {
     void printDebugRec(FILE* file, const Node& node, int depth) const {
         printf(">> %s (type=%s, type_id=%d, state=%d\n", node.full_name.c_str(), node.type_name.c_str(), node.type, node.state);
         for (const auto &child : node.children) {
-            printDebugRec(file, *child, depth + 1);
+            if (child->parent == &node) {
+                printDebugRec(file, *child, depth + 1);
+            }
         }
     }
 };
@@ -2,6 +2,7 @@
 #include <getopt.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <algorithm>
 #include <functional>
@@ -16,10 +17,20 @@
 #include <google/protobuf/io/zero_copy_stream.h>
 #include <google/protobuf/io/zero_copy_stream_impl.h>
 
+#include "fused_writer.h"
+#include "inline_writer.h"
+#include "output.h"
 #include "parser.h"
+#include "protog_version.h"
+#include "serializer_writer.h"
+#include "view_writer.h"
+#include "wire_writer.h"
 #include "yajl_writer.h"
 
 static const char* DEFAULT_OUTPUT_DIR = ".";
+static const char* DEFAULT_BACKEND = "yajl";
+// part of the cache key, a hash of the protog sources computed by the build so any change of the generated code changes it
+static const char* GENERATOR_VERSION = PROTOG_GENERATOR_VERSION;
 
 void print_help(FILE* f) {
     fprintf(f, "Usage: protog [OPTIONS]\n");
@@ -32,13 +43,46 @@ void print_help(FILE* f) {
     fprintf(f, "  -i PROTO_INCLUDE   Name of the header file generated by protoc.\n");
     fprintf(f, "  -o OUTPUT_DIR      Folder where generated source files should be placed\n");
     fprintf(f, "                     It defaults to \"%s\".\n", DEFAULT_OUTPUT_DIR);
+    fprintf(f, "  -b BACKEND         Parser backend to generate: \"yajl\" drives the state machine\n");
+    fprintf(f, "                     from libyajl callbacks, \"fused\" emits a standalone lexer\n");
+    fprintf(f, "                     fused with the state machine. It defaults to \"%s\".\n", DEFAULT_BACKEND);
+    fprintf(f, "  -j                 Dispatch the callbacks of the yajl backend through label tables\n");
+    fprintf(f, "                     (computed goto, GCC and Clang only) instead of switch statements.\n");
+    fprintf(f, "  -s                 Also generate a json serializer for the message.\n");
+    fprintf(f, "  -v                 Also generate a zero-copy view struct and its parser.\n");
+    fprintf(f, "  -w                 Also generate a transcoder from json to the protobuf wire format.\n");
+    fprintf(f, "  -H                 Also generate a header-only parser specializing protog::parse<Msg>.\n");
+    fprintf(f, "  -t                 Generate the states of every message type only once instead of\n");
+    fprintf(f, "                     once per path. Required for recursive messages.\n");
+    fprintf(f, "  -u                 Skip keys which are not part of the schema together with their\n");
+    fprintf(f, "                     values instead of failing.\n");
+    fprintf(f, "  -f FIELDS          Only parse the comma separated field paths, e.g. id,imp.banner.w.\n");
+    fprintf(f, "                     Everything else is skipped and parsing stops once all of them\n");
+    fprintf(f, "                     are read. Implies -u, can not be combined with -v.\n");
+    fprintf(f, "  -e PATH            Let the parser pass every element of the repeated message field\n");
+    fprintf(f, "                     PATH, e.g. records, to a callback once it is complete and drop it\n");
+    fprintf(f, "                     afterwards instead of keeping it in the message.\n");
+    fprintf(f, "  -c CACHE_DIR       Keep the generated files in CACHE_DIR keyed by a hash of the proto\n");
+    fprintf(f, "                     file, message and options and reuse them on later runs.\n");
+    fprintf(f, "Generated files are only rewritten when their content changes.\n");
     fprintf(f, "Example usage:\n");
     fprintf(f, "  protog -p openrtb.proto -m com.google.openrtb.BidRequest -i openrtb.pb.h\n");
 }
 
 int main(int argc, char **argv) {
     bool debug = false;
+    bool serializer = false;
+    bool view = false;
+    bool wire = false;
+    bool headerOnly = false;
+    bool shareTypes = false;
+    bool threaded = false;
+    bool skipUnknown = false;
+    const char* field_mask = nullptr;
+    const char* element_path = nullptr;
     const char* output_dir = DEFAULT_OUTPUT_DIR;
+    const char* backend = DEFAULT_BACKEND;
+    const char* cache_dir = nullptr;
     // TODO: derive proto header name from proto_file
     const char* proto_include = NULL;
     const char* proto_message = NULL;
@@ -46,7 +90,7 @@ int main(int argc, char **argv) {
 
     int c;
     opterr = 0;
-    while ((c = getopt(argc, argv, "hdo:i:m:p:")) != -1) {
+    while ((c = getopt(argc, argv, "hdjsvwHtuf:e:o:i:m:p:b:c:")) != -1) {
         switch (c) {
         case 'h':
             print_help(stdout);
@@ -54,6 +98,34 @@ int main(int argc, char **argv) {
         case 'd':
             debug = true;
             break;
+        case 'j':
+            threaded = true;
+            break;
+        case 's':
+            serializer = true;
+            break;
+        case 'v':
+            view = true;
+            break;
+        case 'w':
+            wire = true;
+            break;
+        case 'H':
+            headerOnly = true;
+            break;
+        case 't':
+            shareTypes = true;
+            break;
+        case 'u':
+            skipUnknown = true;
+            break;
+        case 'f':
+            field_mask = optarg;
+            skipUnknown = true;
+            break;
+        case 'e':
+            element_path = optarg;
+            break;
         case 'p':
             proto_file = optarg;
             break;
@@ -66,6 +138,12 @@ int main(int argc, char **argv) {
         case 'o':
             output_dir = optarg;
             break;
+        case 'b':
+            backend = optarg;
+            break;
+        case 'c':
+            cache_dir = optarg;
+            break;
         default:
             print_help(stderr);
             exit(EXIT_FAILURE);
@@ -78,14 +156,89 @@ int main(int argc, char **argv) {
         exit(EXIT_FAILURE);
     }
 
-    protog::Graph graph{proto_file, proto_message};
-    graph.parseMessageDesc();
-    if (debug) {
-        graph.printDebug(stdout);
+    if (view && field_mask) {
+        // views share one struct between all paths of a message type, while a mask selects fields per path
+        fprintf(stderr, "A field mask can not be combined with views.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    std::string proto_content;
+    if (!protog::readFile(proto_file, proto_content)) {
+        fprintf(stderr, "Unable to read proto file %s.\n", proto_file);
+        exit(EXIT_FAILURE);
+    }
+    std::string options = std::string(backend) + (threaded ? " -j" : "") + (serializer ? " -s" : "") +
+                          (view ? " -v" : "") + (wire ? " -w" : "") + (headerOnly ? " -H" : "") +
+                          (shareTypes ? " -t" : "") + (skipUnknown ? " -u" : "") +
+                          (field_mask ? std::string(" -f ") + field_mask : "") +
+                          (element_path ? std::string(" -e ") + element_path : "");
+    uint64_t key = protog::hashBytes(GENERATOR_VERSION);
+    for (const auto &input : {proto_content, std::string(proto_message), std::string(proto_include), options}) {
+        key = protog::hashBytes(input + '\0', key);
+    }
+
+    protog::OutputCache cache{cache_dir ? cache_dir : ""};
+    protog::Outputs outputs;
+    if (!cache_dir || debug || !cache.load(key, outputs)) {
+        std::vector<std::shared_ptr<protog::Writer>> writers;
+        if (strcmp(backend, "yajl") == 0) {
+            auto writer = std::make_shared<protog::YajlWriter>();
+            writer->threaded = threaded;
+            writers.push_back(writer);
+        } else if (strcmp(backend, "fused") == 0) {
+            writers.push_back(std::make_shared<protog::FusedWriter>());
+        } else {
+            fprintf(stderr, "Unknown backend %s.\n", backend);
+            print_help(stderr);
+            exit(EXIT_FAILURE);
+        }
+        if (serializer) {
+            writers.push_back(std::make_shared<protog::SerializerWriter>());
+        }
+        if (view) {
+            writers.push_back(std::make_shared<protog::ViewWriter>());
+        }
+        if (wire) {
+            writers.push_back(std::make_shared<protog::WireWriter>());
+        }
+        if (headerOnly) {
+            writers.push_back(std::make_shared<protog::InlineWriter>());
+        }
+
+        protog::Graph graph{proto_file, proto_message};
+        if (field_mask) {
+            graph.fieldMask = protog::split(field_mask, ',');
+        }
+        if (element_path) {
+            graph.elementPath = element_path;
+        }
+        graph.shareTypes = shareTypes;
+        graph.parseMessageDesc();
+        if (debug) {
+            graph.printDebug(stdout);
+        }
+
+        for (const auto& writer : writers) {
+            writer->skipUnknown = skipUnknown;
+            writer->write(graph, proto_include);
+            outputs.insert(outputs.end(), writer->outputs.begin(), writer->outputs.end());
+        }
+        if (cache_dir && !cache.store(key, outputs)) {
+            fprintf(stderr, "Unable to store generated files in cache %s.\n", cache_dir);
+        }
     }
 
-    auto writer = std::make_shared<protog::YajlWriter>();
-    writer->write(graph, proto_include);
+    for (const auto &output : outputs) {
+        const auto path = std::string(output_dir) + "/" + output.first;
+        const int written = protog::writeIfChanged(path, output.second);
+        if (written < 0) {
+            fprintf(stderr, "Unable to write %s.\n", path.c_str());
+            exit(EXIT_FAILURE);
+        }
+        if (debug) {
+            printf("%s %s\n", written ? "wrote" : "unchanged", path.c_str());
+        }
+    }
 
     return 0;
 }
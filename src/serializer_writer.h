@@ -0,0 +1,581 @@
+#pragma once
+
+#include "parser.h"
+#include "writer.h"
+
+namespace protog {
+
+// Generates the opposite direction of the parsers: a typed, reflection free protobuf to json serializer which
+// appends to a caller provided std::string. The output uses the same conventions the generated parsers accept, i.e.
+// proto field names as keys and enums as numbers, so both round-trip.
+struct SerializerWriter : public Writer {
+    virtual ~SerializerWriter() {}
+
+    virtual void write(const Graph &graph, const char* proto_header) override {
+        auto name_lower = graph.root.desc->name();
+        std::transform(name_lower.begin(), name_lower.end(), name_lower.begin(), ::tolower);
+        const auto cpp_type = get_full_cpp_type_name(*graph.root.desc);
+        const auto res_name_prefix = name_lower + "_serializer.pb";
+
+        const auto header_name = res_name_prefix + ".h";
+        FILE *header = openOutput();
+        printHeader(header, graph, name_lower.c_str(), cpp_type.c_str(), proto_header);
+        closeOutput(header, header_name);
+
+        const auto source_name = res_name_prefix + ".cc";
+        FILE *source = openOutput();
+        printSource(source, graph, name_lower.c_str(), cpp_type.c_str());
+        closeOutput(source, source_name);
+    }
+
+    void printHeader(FILE *file, const Graph &graph, const char *t, const char *c, const char* h) {
+        fprintf(file, "#pragma once\n\n");
+        fprintf(file, "#include <string>\n\n");
+        fprintf(file, "#include \"%s\"\n\n", h);
+        printNamespaceBegin(file, graph);
+        fprintf(file, "// Appends the json representation of msg to out. Reuse out to avoid reallocations.\n");
+        fprintf(file, "void %s_serialize(const %s &msg, std::string &out);\n", t, c);
+        fprintf(file, "std::string %s_serialize(const %s &msg);\n", t, c);
+        fprintf(file, "\n");
+        printNamespaceEnd(file, graph);
+    }
+
+    void printSource(FILE *file, const Graph &graph, const char *t, const char *c) {
+        printSourceIncludes(file, t);
+        printNamespaceBegin(file, graph);
+        fprintf(file, "namespace {\n\n");
+        printRuntime(file, t);
+        if (hasBytesFields(graph)) {
+            printBase64Encoder(file, t);
+        }
+        printObjectSerializers(file, graph, t);
+        fprintf(file, "} // anonymous namespace\n\n");
+        printApiImpl(file, t, c);
+        printNamespaceEnd(file, graph);
+    }
+
+    void printSourceIncludes(FILE *file, const char *t) {
+        fprintf(file, "#include \"%s_serializer.pb.h\"\n\n", t);
+        fprintf(file, "#include <stdint.h>\n");
+        fprintf(file, "#include <string.h>\n\n");
+        fprintf(file, "#include <cmath>\n");
+        fprintf(file, "#include <limits>\n");
+        fprintf(file, "#include <string>\n");
+        fprintf(file, "\n");
+    }
+
+    void printRuntime(FILE *file, const char *t) {
+        fprintf(file, "static const char %s_serializer_digits[] =\n", t);
+        fprintf(file, "    \"00010203040506070809101112131415161718192021222324252627282930313233343536373839\"\n");
+        fprintf(file, "    \"40414243444546474849505152535455565758596061626364656667686970717273747576777879\"\n");
+        fprintf(file, "    \"8081828384858687888990919293949596979899\";\n");
+        fprintf(file, "\n");
+        fprintf(file, "static void %s_serializer_write_uint64(std::string &out, unsigned long long v) {\n", t);
+        fprintf(file, "    char buf[20];\n");
+        fprintf(file, "    char *p = buf + sizeof(buf);\n");
+        fprintf(file, "    while (v >= 100) {\n");
+        fprintf(file, "        const unsigned i = static_cast<unsigned>(v %% 100) * 2;\n");
+        fprintf(file, "        v /= 100;\n");
+        fprintf(file, "        *--p = %s_serializer_digits[i + 1];\n", t);
+        fprintf(file, "        *--p = %s_serializer_digits[i];\n", t);
+        fprintf(file, "    }\n");
+        fprintf(file, "    if (v >= 10) {\n");
+        fprintf(file, "        const unsigned i = static_cast<unsigned>(v) * 2;\n");
+        fprintf(file, "        *--p = %s_serializer_digits[i + 1];\n", t);
+        fprintf(file, "        *--p = %s_serializer_digits[i];\n", t);
+        fprintf(file, "    } else {\n");
+        fprintf(file, "        *--p = static_cast<char>('0' + v);\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    out.append(p, buf + sizeof(buf) - p);\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "static void %s_serializer_write_int64(std::string &out, long long v) {\n", t);
+        fprintf(file, "    if (v < 0) {\n");
+        fprintf(file, "        out += '-';\n");
+        fprintf(file, "        %s_serializer_write_uint64(out, 0 - static_cast<unsigned long long>(v));\n", t);
+        fprintf(file, "    } else {\n");
+        fprintf(file, "        %s_serializer_write_uint64(out, static_cast<unsigned long long>(v));\n", t);
+        fprintf(file, "    }\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "static inline void %s_serializer_write_bool(std::string &out, bool v) {\n", t);
+        fprintf(file, "    if (v) {\n");
+        fprintf(file, "        out.append(\"true\", 4);\n");
+        fprintf(file, "    } else {\n");
+        fprintf(file, "        out.append(\"false\", 5);\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "static void %s_serializer_write_string(std::string &out, const std::string &v) {\n", t);
+        fprintf(file, "    static const char hex[] = \"0123456789abcdef\";\n");
+        fprintf(file, "    out += '\"';\n");
+        fprintf(file, "    const char *p = v.data();\n");
+        fprintf(file, "    const char *end = p + v.size();\n");
+        fprintf(file, "    const char *run = p;\n");
+        fprintf(file, "    for (; p != end; ++p) {\n");
+        fprintf(file, "        const unsigned char ch = static_cast<unsigned char>(*p);\n");
+        fprintf(file, "        if (ch >= 0x20 && ch != '\"' && ch != '\\\\') {\n");
+        fprintf(file, "            continue;\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "        out.append(run, p - run);\n");
+        fprintf(file, "        run = p + 1;\n");
+        fprintf(file, "        switch (ch) {\n");
+        fprintf(file, "            case '\"': out.append(\"\\\\\\\"\", 2); break;\n");
+        fprintf(file, "            case '\\\\': out.append(\"\\\\\\\\\", 2); break;\n");
+        fprintf(file, "            case '\\b': out.append(\"\\\\b\", 2); break;\n");
+        fprintf(file, "            case '\\f': out.append(\"\\\\f\", 2); break;\n");
+        fprintf(file, "            case '\\n': out.append(\"\\\\n\", 2); break;\n");
+        fprintf(file, "            case '\\r': out.append(\"\\\\r\", 2); break;\n");
+        fprintf(file, "            case '\\t': out.append(\"\\\\t\", 2); break;\n");
+        fprintf(file, "            default: {\n");
+        fprintf(file, "                const char esc[6] = {'\\\\', 'u', '0', '0', hex[ch >> 4], hex[ch & 0xF]};\n");
+        fprintf(file, "                out.append(esc, 6);\n");
+        fprintf(file, "            }\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    out.append(run, p - run);\n");
+        fprintf(file, "    out += '\"';\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "// shortest round-trip formatting of floating point numbers with Grisu2, see\n");
+        fprintf(file, "// Loitsch, \"Printing Floating-Point Numbers Quickly and Accurately with Integers\"\n");
+        fprintf(file, "struct %s_serializer_diyfp {\n", t);
+        fprintf(file, "    uint64_t f;\n");
+        fprintf(file, "    int e;\n");
+        fprintf(file, "};\n");
+        fprintf(file, "\n");
+        fprintf(file, "static inline %s_serializer_diyfp %s_serializer_diyfp_sub(%s_serializer_diyfp x, %s_serializer_diyfp y) {\n", t, t, t, t);
+        fprintf(file, "    return {x.f - y.f, x.e};\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "static %s_serializer_diyfp %s_serializer_diyfp_mul(%s_serializer_diyfp x, %s_serializer_diyfp y) {\n", t, t, t, t);
+        fprintf(file, "    const uint64_t u_lo = x.f & 0xFFFFFFFFu;\n");
+        fprintf(file, "    const uint64_t u_hi = x.f >> 32u;\n");
+        fprintf(file, "    const uint64_t v_lo = y.f & 0xFFFFFFFFu;\n");
+        fprintf(file, "    const uint64_t v_hi = y.f >> 32u;\n");
+        fprintf(file, "    const uint64_t p0 = u_lo * v_lo;\n");
+        fprintf(file, "    const uint64_t p1 = u_lo * v_hi;\n");
+        fprintf(file, "    const uint64_t p2 = u_hi * v_lo;\n");
+        fprintf(file, "    const uint64_t p3 = u_hi * v_hi;\n");
+        fprintf(file, "    uint64_t q = (p0 >> 32u) + (p1 & 0xFFFFFFFFu) + (p2 & 0xFFFFFFFFu);\n");
+        fprintf(file, "    q += uint64_t{1} << 31u; // round\n");
+        fprintf(file, "    return {p3 + (p1 >> 32u) + (p2 >> 32u) + (q >> 32u), x.e + y.e + 64};\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "static %s_serializer_diyfp %s_serializer_diyfp_normalize(%s_serializer_diyfp x) {\n", t, t, t);
+        fprintf(file, "    while ((x.f >> 63u) == 0) {\n");
+        fprintf(file, "        x.f <<= 1u;\n");
+        fprintf(file, "        x.e--;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    return x;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "template <typename FloatType, typename BitsType>\n");
+        fprintf(file, "static void %s_serializer_boundaries(FloatType value, %s_serializer_diyfp &w, %s_serializer_diyfp &minus,\n", t, t, t);
+        fprintf(file, "                                    %s_serializer_diyfp &plus) {\n", t);
+        fprintf(file, "    const int precision = std::numeric_limits<FloatType>::digits; // including the hidden bit\n");
+        fprintf(file, "    const int bias = std::numeric_limits<FloatType>::max_exponent - 1 + (precision - 1);\n");
+        fprintf(file, "    const uint64_t hiddenBit = uint64_t{1} << (precision - 1);\n");
+        fprintf(file, "    BitsType bits;\n");
+        fprintf(file, "    memcpy(&bits, &value, sizeof(bits));\n");
+        fprintf(file, "    const uint64_t E = bits >> (precision - 1);\n");
+        fprintf(file, "    const uint64_t F = bits & (hiddenBit - 1);\n");
+        fprintf(file, "    const %s_serializer_diyfp v = E == 0 ? %s_serializer_diyfp{F, 1 - bias}\n", t, t);
+        fprintf(file, "                                        : %s_serializer_diyfp{F + hiddenBit, static_cast<int>(E) - bias};\n", t);
+        fprintf(file, "    const bool lowerBoundaryIsCloser = F == 0 && E > 1;\n");
+        fprintf(file, "    plus = %s_serializer_diyfp_normalize({2 * v.f + 1, v.e - 1});\n", t);
+        fprintf(file, "    minus = lowerBoundaryIsCloser ? %s_serializer_diyfp{4 * v.f - 1, v.e - 2} : %s_serializer_diyfp{2 * v.f - 1, v.e - 1};\n", t, t);
+        fprintf(file, "    minus = {minus.f << (minus.e - plus.e), plus.e};\n");
+        fprintf(file, "    w = %s_serializer_diyfp_normalize(v);\n", t);
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "struct %s_serializer_cached_power {\n", t);
+        fprintf(file, "    uint64_t f;\n");
+        fprintf(file, "    int e;\n");
+        fprintf(file, "    int k;\n");
+        fprintf(file, "};\n");
+        fprintf(file, "\n");
+        fprintf(file, "static %s_serializer_cached_power %s_serializer_get_cached_power(int e) {\n", t, t);
+        fprintf(file, "    // normalized powers of ten 10^k for k = -300, -292, ..., 324\n");
+        fprintf(file, "    static const %s_serializer_cached_power powers[] = {\n", t);
+        fprintf(file, "        { 0xAB70FE17C79AC6CAULL, -1060, -300 },\n");
+        fprintf(file, "        { 0xFF77B1FCBEBCDC4FULL, -1034, -292 },\n");
+        fprintf(file, "        { 0xBE5691EF416BD60CULL, -1007, -284 },\n");
+        fprintf(file, "        { 0x8DD01FAD907FFC3CULL, -980, -276 },\n");
+        fprintf(file, "        { 0xD3515C2831559A83ULL, -954, -268 },\n");
+        fprintf(file, "        { 0x9D71AC8FADA6C9B5ULL, -927, -260 },\n");
+        fprintf(file, "        { 0xEA9C227723EE8BCBULL, -901, -252 },\n");
+        fprintf(file, "        { 0xAECC49914078536DULL, -874, -244 },\n");
+        fprintf(file, "        { 0x823C12795DB6CE57ULL, -847, -236 },\n");
+        fprintf(file, "        { 0xC21094364DFB5637ULL, -821, -228 },\n");
+        fprintf(file, "        { 0x9096EA6F3848984FULL, -794, -220 },\n");
+        fprintf(file, "        { 0xD77485CB25823AC7ULL, -768, -212 },\n");
+        fprintf(file, "        { 0xA086CFCD97BF97F4ULL, -741, -204 },\n");
+        fprintf(file, "        { 0xEF340A98172AACE5ULL, -715, -196 },\n");
+        fprintf(file, "        { 0xB23867FB2A35B28EULL, -688, -188 },\n");
+        fprintf(file, "        { 0x84C8D4DFD2C63F3BULL, -661, -180 },\n");
+        fprintf(file, "        { 0xC5DD44271AD3CDBAULL, -635, -172 },\n");
+        fprintf(file, "        { 0x936B9FCEBB25C996ULL, -608, -164 },\n");
+        fprintf(file, "        { 0xDBAC6C247D62A584ULL, -582, -156 },\n");
+        fprintf(file, "        { 0xA3AB66580D5FDAF6ULL, -555, -148 },\n");
+        fprintf(file, "        { 0xF3E2F893DEC3F126ULL, -529, -140 },\n");
+        fprintf(file, "        { 0xB5B5ADA8AAFF80B8ULL, -502, -132 },\n");
+        fprintf(file, "        { 0x87625F056C7C4A8BULL, -475, -124 },\n");
+        fprintf(file, "        { 0xC9BCFF6034C13053ULL, -449, -116 },\n");
+        fprintf(file, "        { 0x964E858C91BA2655ULL, -422, -108 },\n");
+        fprintf(file, "        { 0xDFF9772470297EBDULL, -396, -100 },\n");
+        fprintf(file, "        { 0xA6DFBD9FB8E5B88FULL, -369, -92 },\n");
+        fprintf(file, "        { 0xF8A95FCF88747D94ULL, -343, -84 },\n");
+        fprintf(file, "        { 0xB94470938FA89BCFULL, -316, -76 },\n");
+        fprintf(file, "        { 0x8A08F0F8BF0F156BULL, -289, -68 },\n");
+        fprintf(file, "        { 0xCDB02555653131B6ULL, -263, -60 },\n");
+        fprintf(file, "        { 0x993FE2C6D07B7FACULL, -236, -52 },\n");
+        fprintf(file, "        { 0xE45C10C42A2B3B06ULL, -210, -44 },\n");
+        fprintf(file, "        { 0xAA242499697392D3ULL, -183, -36 },\n");
+        fprintf(file, "        { 0xFD87B5F28300CA0EULL, -157, -28 },\n");
+        fprintf(file, "        { 0xBCE5086492111AEBULL, -130, -20 },\n");
+        fprintf(file, "        { 0x8CBCCC096F5088CCULL, -103, -12 },\n");
+        fprintf(file, "        { 0xD1B71758E219652CULL, -77, -4 },\n");
+        fprintf(file, "        { 0x9C40000000000000ULL, -50, 4 },\n");
+        fprintf(file, "        { 0xE8D4A51000000000ULL, -24, 12 },\n");
+        fprintf(file, "        { 0xAD78EBC5AC620000ULL, 3, 20 },\n");
+        fprintf(file, "        { 0x813F3978F8940984ULL, 30, 28 },\n");
+        fprintf(file, "        { 0xC097CE7BC90715B3ULL, 56, 36 },\n");
+        fprintf(file, "        { 0x8F7E32CE7BEA5C70ULL, 83, 44 },\n");
+        fprintf(file, "        { 0xD5D238A4ABE98068ULL, 109, 52 },\n");
+        fprintf(file, "        { 0x9F4F2726179A2245ULL, 136, 60 },\n");
+        fprintf(file, "        { 0xED63A231D4C4FB27ULL, 162, 68 },\n");
+        fprintf(file, "        { 0xB0DE65388CC8ADA8ULL, 189, 76 },\n");
+        fprintf(file, "        { 0x83C7088E1AAB65DBULL, 216, 84 },\n");
+        fprintf(file, "        { 0xC45D1DF942711D9AULL, 242, 92 },\n");
+        fprintf(file, "        { 0x924D692CA61BE758ULL, 269, 100 },\n");
+        fprintf(file, "        { 0xDA01EE641A708DEAULL, 295, 108 },\n");
+        fprintf(file, "        { 0xA26DA3999AEF774AULL, 322, 116 },\n");
+        fprintf(file, "        { 0xF209787BB47D6B85ULL, 348, 124 },\n");
+        fprintf(file, "        { 0xB454E4A179DD1877ULL, 375, 132 },\n");
+        fprintf(file, "        { 0x865B86925B9BC5C2ULL, 402, 140 },\n");
+        fprintf(file, "        { 0xC83553C5C8965D3DULL, 428, 148 },\n");
+        fprintf(file, "        { 0x952AB45CFA97A0B3ULL, 455, 156 },\n");
+        fprintf(file, "        { 0xDE469FBD99A05FE3ULL, 481, 164 },\n");
+        fprintf(file, "        { 0xA59BC234DB398C25ULL, 508, 172 },\n");
+        fprintf(file, "        { 0xF6C69A72A3989F5CULL, 534, 180 },\n");
+        fprintf(file, "        { 0xB7DCBF5354E9BECEULL, 561, 188 },\n");
+        fprintf(file, "        { 0x88FCF317F22241E2ULL, 588, 196 },\n");
+        fprintf(file, "        { 0xCC20CE9BD35C78A5ULL, 614, 204 },\n");
+        fprintf(file, "        { 0x98165AF37B2153DFULL, 641, 212 },\n");
+        fprintf(file, "        { 0xE2A0B5DC971F303AULL, 667, 220 },\n");
+        fprintf(file, "        { 0xA8D9D1535CE3B396ULL, 694, 228 },\n");
+        fprintf(file, "        { 0xFB9B7CD9A4A7443CULL, 720, 236 },\n");
+        fprintf(file, "        { 0xBB764C4CA7A44410ULL, 747, 244 },\n");
+        fprintf(file, "        { 0x8BAB8EEFB6409C1AULL, 774, 252 },\n");
+        fprintf(file, "        { 0xD01FEF10A657842CULL, 800, 260 },\n");
+        fprintf(file, "        { 0x9B10A4E5E9913129ULL, 827, 268 },\n");
+        fprintf(file, "        { 0xE7109BFBA19C0C9DULL, 853, 276 },\n");
+        fprintf(file, "        { 0xAC2820D9623BF429ULL, 880, 284 },\n");
+        fprintf(file, "        { 0x80444B5E7AA7CF85ULL, 907, 292 },\n");
+        fprintf(file, "        { 0xBF21E44003ACDD2DULL, 933, 300 },\n");
+        fprintf(file, "        { 0x8E679C2F5E44FF8FULL, 960, 308 },\n");
+        fprintf(file, "        { 0xD433179D9C8CB841ULL, 986, 316 },\n");
+        fprintf(file, "        { 0x9E19DB92B4E31BA9ULL, 1013, 324 },\n");
+        fprintf(file, "    };\n");
+        fprintf(file, "    const int f = -60 - e - 1;\n");
+        fprintf(file, "    const int k = (f * 78913) / (1 << 18) + (f > 0);\n");
+        fprintf(file, "    return powers[(300 + k + 7) / 8];\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "static void %s_serializer_grisu2_round(char *buf, int len, uint64_t dist, uint64_t delta, uint64_t rest, uint64_t tenK) {\n", t);
+        fprintf(file, "    while (rest < dist && delta - rest >= tenK && (rest + tenK < dist || dist - rest > rest + tenK - dist)) {\n");
+        fprintf(file, "        buf[len - 1]--;\n");
+        fprintf(file, "        rest += tenK;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "static void %s_serializer_grisu2(char *buf, int &len, int &decimalExponent, %s_serializer_diyfp v,\n", t, t);
+        fprintf(file, "                                %s_serializer_diyfp minus, %s_serializer_diyfp plus) {\n", t, t);
+        fprintf(file, "    const %s_serializer_cached_power cached = %s_serializer_get_cached_power(plus.e);\n", t, t);
+        fprintf(file, "    const %s_serializer_diyfp c = {cached.f, cached.e};\n", t);
+        fprintf(file, "    const %s_serializer_diyfp w = %s_serializer_diyfp_mul(v, c);\n", t, t);
+        fprintf(file, "    const %s_serializer_diyfp wMinus = %s_serializer_diyfp_mul(minus, c);\n", t, t);
+        fprintf(file, "    const %s_serializer_diyfp wPlus = %s_serializer_diyfp_mul(plus, c);\n", t, t);
+        fprintf(file, "    const %s_serializer_diyfp M_minus = {wMinus.f + 1, wMinus.e};\n", t);
+        fprintf(file, "    const %s_serializer_diyfp M_plus = {wPlus.f - 1, wPlus.e};\n", t);
+        fprintf(file, "    decimalExponent = -cached.k;\n");
+        fprintf(file, "\n");
+        fprintf(file, "    uint64_t delta = %s_serializer_diyfp_sub(M_plus, M_minus).f;\n", t);
+        fprintf(file, "    uint64_t dist = %s_serializer_diyfp_sub(M_plus, w).f;\n", t);
+        fprintf(file, "    const %s_serializer_diyfp one = {uint64_t{1} << -M_plus.e, M_plus.e};\n", t);
+        fprintf(file, "    uint32_t p1 = static_cast<uint32_t>(M_plus.f >> -one.e);\n");
+        fprintf(file, "    uint64_t p2 = M_plus.f & (one.f - 1);\n");
+        fprintf(file, "\n");
+        fprintf(file, "    uint32_t pow10 = 1;\n");
+        fprintf(file, "    int n = 1;\n");
+        fprintf(file, "    while (n < 10 && p1 / pow10 >= 10) {\n");
+        fprintf(file, "        pow10 *= 10;\n");
+        fprintf(file, "        ++n;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    while (n > 0) {\n");
+        fprintf(file, "        buf[len++] = static_cast<char>('0' + p1 / pow10);\n");
+        fprintf(file, "        p1 %%= pow10;\n");
+        fprintf(file, "        n--;\n");
+        fprintf(file, "        const uint64_t rest = (static_cast<uint64_t>(p1) << -one.e) + p2;\n");
+        fprintf(file, "        if (rest <= delta) {\n");
+        fprintf(file, "            decimalExponent += n;\n");
+        fprintf(file, "            %s_serializer_grisu2_round(buf, len, dist, delta, rest, static_cast<uint64_t>(pow10) << -one.e);\n", t);
+        fprintf(file, "            return;\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "        pow10 /= 10;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    int m = 0;\n");
+        fprintf(file, "    for (;;) {\n");
+        fprintf(file, "        p2 *= 10;\n");
+        fprintf(file, "        buf[len++] = static_cast<char>('0' + (p2 >> -one.e));\n");
+        fprintf(file, "        p2 &= one.f - 1;\n");
+        fprintf(file, "        m++;\n");
+        fprintf(file, "        delta *= 10;\n");
+        fprintf(file, "        dist *= 10;\n");
+        fprintf(file, "        if (p2 <= delta) {\n");
+        fprintf(file, "            break;\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    decimalExponent -= m;\n");
+        fprintf(file, "    %s_serializer_grisu2_round(buf, len, dist, delta, p2, one.f);\n", t);
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "template <typename FloatType, typename BitsType>\n");
+        fprintf(file, "static void %s_serializer_write_float(std::string &out, FloatType value) {\n", t);
+        fprintf(file, "    if (!std::isfinite(value)) {\n");
+        fprintf(file, "        out.append(\"null\", 4); // not representable in json\n");
+        fprintf(file, "        return;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    if (value == 0) {\n");
+        fprintf(file, "        if (std::signbit(value)) {\n");
+        fprintf(file, "            out.append(\"-0.0\", 4); // -0 would be read back as integer\n");
+        fprintf(file, "        } else {\n");
+        fprintf(file, "            out += '0';\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "        return;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    if (value < 0) {\n");
+        fprintf(file, "        out += '-';\n");
+        fprintf(file, "        value = -value;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    char buf[32];\n");
+        fprintf(file, "    int len = 0;\n");
+        fprintf(file, "    int decimalExponent = 0;\n");
+        fprintf(file, "    %s_serializer_diyfp w, minus, plus;\n", t);
+        fprintf(file, "    %s_serializer_boundaries<FloatType, BitsType>(value, w, minus, plus);\n", t);
+        fprintf(file, "    %s_serializer_grisu2(buf, len, decimalExponent, w, minus, plus);\n", t);
+        fprintf(file, "\n");
+        fprintf(file, "    // value = buf[0, len) * 10^decimalExponent, print it without exponent where reasonably short\n");
+        fprintf(file, "    const int k = len;\n");
+        fprintf(file, "    const int n = len + decimalExponent;\n");
+        fprintf(file, "    if (k <= n && n <= 15) { // digits[000]\n");
+        fprintf(file, "        memset(buf + k, '0', n - k);\n");
+        fprintf(file, "        out.append(buf, n);\n");
+        fprintf(file, "    } else if (0 < n && n <= 15) { // dig.its\n");
+        fprintf(file, "        memmove(buf + n + 1, buf + n, k - n);\n");
+        fprintf(file, "        buf[n] = '.';\n");
+        fprintf(file, "        out.append(buf, k + 1);\n");
+        fprintf(file, "    } else if (-4 < n && n <= 0) { // 0.[000]digits\n");
+        fprintf(file, "        memmove(buf + 2 - n, buf, k);\n");
+        fprintf(file, "        buf[0] = '0';\n");
+        fprintf(file, "        buf[1] = '.';\n");
+        fprintf(file, "        memset(buf + 2, '0', -n);\n");
+        fprintf(file, "        out.append(buf, 2 - n + k);\n");
+        fprintf(file, "    } else { // d.igitsE-123\n");
+        fprintf(file, "        if (k == 1) {\n");
+        fprintf(file, "            out += buf[0];\n");
+        fprintf(file, "        } else {\n");
+        fprintf(file, "            out += buf[0];\n");
+        fprintf(file, "            out += '.';\n");
+        fprintf(file, "            out.append(buf + 1, k - 1);\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "        out += 'e';\n");
+        fprintf(file, "        %s_serializer_write_int64(out, n - 1);\n", t);
+        fprintf(file, "    }\n");
+        fprintf(file, "}\n");
+
+        fprintf(file, "\n");
+    }
+
+    // bytes fields are written as padded standard base64, which the generated parsers accept
+    void printBase64Encoder(FILE *file, const char *t) {
+        fprintf(file, "static void %s_serializer_write_bytes(std::string &out, const std::string &v) {\n", t);
+        fprintf(file, "    static const char alphabet[] = \"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/\";\n");
+        fprintf(file, "    const unsigned char *p = reinterpret_cast<const unsigned char *>(v.data());\n");
+        fprintf(file, "    const size_t n = v.size();\n");
+        fprintf(file, "    const size_t start = out.size();\n");
+        fprintf(file, "    out.resize(start + 2 + (n + 2) / 3 * 4);\n");
+        fprintf(file, "    char *o = &out[start];\n");
+        fprintf(file, "    *o++ = '\"';\n");
+        fprintf(file, "    size_t i = 0;\n");
+        fprintf(file, "    for (; i + 3 <= n; i += 3) {\n");
+        fprintf(file, "        const uint32_t w = static_cast<uint32_t>(p[i]) << 16 | static_cast<uint32_t>(p[i + 1]) << 8 | p[i + 2];\n");
+        fprintf(file, "        *o++ = alphabet[w >> 18];\n");
+        fprintf(file, "        *o++ = alphabet[(w >> 12) & 0x3F];\n");
+        fprintf(file, "        *o++ = alphabet[(w >> 6) & 0x3F];\n");
+        fprintf(file, "        *o++ = alphabet[w & 0x3F];\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    if (i < n) {\n");
+        fprintf(file, "        const uint32_t w = static_cast<uint32_t>(p[i]) << 16 | (i + 1 < n ? static_cast<uint32_t>(p[i + 1]) << 8 : 0);\n");
+        fprintf(file, "        *o++ = alphabet[w >> 18];\n");
+        fprintf(file, "        *o++ = alphabet[(w >> 12) & 0x3F];\n");
+        fprintf(file, "        *o++ = i + 1 < n ? alphabet[(w >> 6) & 0x3F] : '=';\n");
+        fprintf(file, "        *o++ = '=';\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    *o = '\"';\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+    }
+
+    void printObjectSerializers(FILE *file, const Graph &graph, const char *t) {
+        if (graph.shareTypes) { // shared object nodes may be called from anywhere, including themselves
+            for (const auto &node : graph.object_nodes) {
+                fprintf(file, "static void %s_serialize_%d(const %s &msg, std::string &out);\n", t, node->state,
+                        get_full_cpp_type_name(*getMessageDesc(*node)).c_str());
+            }
+            fprintf(file, "\n");
+        }
+        // object nodes are listed parents first, so walk them backwards to define callees before their callers
+        for (auto it = graph.object_nodes.rbegin(); it != graph.object_nodes.rend(); ++it) {
+            printObjectSerializer(file, **it, t);
+        }
+    }
+
+    void printObjectSerializer(FILE *file, const Node &node, const char *t) {
+        const auto cpp_type = get_full_cpp_type_name(*getMessageDesc(node));
+        fprintf(file, "// map %s\n", node.full_name.c_str());
+        fprintf(file, "static void %s_serialize_%d(const %s &msg, std::string &out) {\n", t, node.state, cpp_type.c_str());
+        if (node.children.empty()) {
+            fprintf(file, "    out.append(\"{}\", 2);\n");
+            fprintf(file, "}\n\n");
+            return;
+        }
+        fprintf(file, "    char sep = '{';\n");
+        for (const auto &child : node.children) {
+            const auto &field = *child->field;
+            const char *name = child->name.c_str();
+            if (field.is_repeated()) {
+                fprintf(file, "    if (msg.%s_size() > 0) { // key %s\n", name, child->full_name.c_str());
+            } else if (field.has_presence()) {
+                fprintf(file, "    if (msg.has_%s()) { // key %s\n", name, child->full_name.c_str());
+            } else if (child->type == NodeType::STRING) {
+                fprintf(file, "    if (!msg.%s().empty()) { // key %s\n", name, child->full_name.c_str());
+            } else {
+                fprintf(file, "    if (msg.%s() != 0) { // key %s\n", name, child->full_name.c_str());
+            }
+            fprintf(file, "        out += sep;\n");
+            fprintf(file, "        sep = ',';\n");
+            fprintf(file, "        out.append(\"\\\"%s\\\":\", %zu);\n", name, child->name.size() + 3);
+            if (child->type == NodeType::MAP) {
+                assert(child->children.size() == 1);
+                fprintf(file, "        char entrySep = '{';\n");
+                fprintf(file, "        for (const auto &entry : msg.%s()) {\n", name);
+                fprintf(file, "            out += entrySep;\n");
+                fprintf(file, "            entrySep = ',';\n");
+                printEntryKey(file, getMapKey(*child), t, "entry.first", "            ");
+                fprintf(file, "            out += ':';\n");
+                printValue(file, *child->children[0], t, "entry.second", "            ");
+                fprintf(file, "        }\n");
+                fprintf(file, "        out += '}';\n");
+            } else if (field.is_repeated()) {
+                assert(child->children.size() == 1);
+                fprintf(file, "        out += '[';\n");
+                fprintf(file, "        for (int i = 0; i < msg.%s_size(); ++i) {\n", name);
+                fprintf(file, "            if (i > 0) {\n");
+                fprintf(file, "                out += ',';\n");
+                fprintf(file, "            }\n");
+                printValue(file, *child->children[0], t, "msg." + child->name + "(i)", "            ");
+                fprintf(file, "        }\n");
+                fprintf(file, "        out += ']';\n");
+            } else {
+                printValue(file, *child, t, "msg." + child->name + "()", "        ");
+            }
+            fprintf(file, "    }\n");
+        }
+        fprintf(file, "    if (sep == '{') {\n");
+        fprintf(file, "        out += '{';\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    out += '}';\n");
+        fprintf(file, "}\n\n");
+    }
+
+    // json keys are strings, so integer and boolean keys are quoted
+    void printEntryKey(FILE *file, const FieldDescriptor &key, const char *t, const char *v, const std::string &indent) {
+        const char *i = indent.c_str();
+        switch (key.cpp_type()) {
+            case FieldDescriptor::CPPTYPE_STRING:
+                fprintf(file, "%s%s_serializer_write_string(out, %s);\n", i, t, v);
+                return;
+            case FieldDescriptor::CPPTYPE_BOOL:
+                fprintf(file, "%sout.append(%s ? \"\\\"true\\\"\" : \"\\\"false\\\"\");\n", i, v);
+                return;
+            case FieldDescriptor::CPPTYPE_UINT32:
+            case FieldDescriptor::CPPTYPE_UINT64:
+                fprintf(file, "%sout += '\"';\n", i);
+                fprintf(file, "%s%s_serializer_write_uint64(out, %s);\n", i, t, v);
+                break;
+            default:
+                fprintf(file, "%sout += '\"';\n", i);
+                fprintf(file, "%s%s_serializer_write_int64(out, %s);\n", i, t, v);
+                break;
+        }
+        fprintf(file, "%sout += '\"';\n", i);
+    }
+
+    void printValue(FILE *file, const Node &node, const char *t, const std::string &v, const std::string &indent) {
+        const char *i = indent.c_str();
+        switch (node.type) {
+            case NodeType::BOOL:
+                fprintf(file, "%s%s_serializer_write_bool(out, %s);\n", i, t, v.c_str());
+                break;
+            case NodeType::LONG:
+                switch (node.field->cpp_type()) {
+                    case FieldDescriptor::CPPTYPE_UINT32:
+                    case FieldDescriptor::CPPTYPE_UINT64:
+                        fprintf(file, "%s%s_serializer_write_uint64(out, %s);\n", i, t, v.c_str());
+                        break;
+                    case FieldDescriptor::CPPTYPE_ENUM:
+                        fprintf(file, "%s%s_serializer_write_int64(out, static_cast<int>(%s));\n", i, t, v.c_str());
+                        break;
+                    default:
+                        fprintf(file, "%s%s_serializer_write_int64(out, %s);\n", i, t, v.c_str());
+                }
+                break;
+            case NodeType::DOUBLE:
+                if (node.field->type() == FieldDescriptor::TYPE_FLOAT) {
+                    fprintf(file, "%s%s_serializer_write_float<float, uint32_t>(out, %s);\n", i, t, v.c_str());
+                } else {
+                    fprintf(file, "%s%s_serializer_write_float<double, uint64_t>(out, %s);\n", i, t, v.c_str());
+                }
+                break;
+            case NodeType::STRING:
+                if (node.field->type() == FieldDescriptor::TYPE_BYTES) {
+                    fprintf(file, "%s%s_serializer_write_bytes(out, %s);\n", i, t, v.c_str());
+                    break;
+                }
+                fprintf(file, "%s%s_serializer_write_string(out, %s);\n", i, t, v.c_str());
+                break;
+            case NodeType::OUTSIDE_OBJECT:
+                assert(node.children.size() == 1);
+                fprintf(file, "%s%s_serialize_%d(%s, out);\n", i, t, node.children[0]->state, v.c_str());
+                break;
+            default:
+                throw std::runtime_error("Unexpected node type for " + node.full_name);
+        }
+    }
+
+    void printApiImpl(FILE *file, const char *t, const char *c) {
+        fprintf(file, "void %s_serialize(const %s &msg, std::string &out) {\n", t, c);
+        fprintf(file, "    %s_serialize_%d(msg, out);\n", t, 1);
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "std::string %s_serialize(const %s &msg) {\n", t, c);
+        fprintf(file, "    std::string out;\n");
+        fprintf(file, "    %s_serialize_%d(msg, out);\n", t, 1);
+        fprintf(file, "    return out;\n");
+        fprintf(file, "}\n\n");
+    }
+};
+
+} // namespace protog
@@ -0,0 +1,501 @@
+#pragma once
+
+#include <set>
+
+#include "fused_writer.h"
+#include "parser.h"
+
+namespace protog {
+
+// Generates a plain struct per message type together with a fused lexer parser filling it. Strings are not copied
+// but point into the parsed buffer, unless they contained escape sequences. Repeated fields keep their first elements
+// inline and singular fields have presence bits. Converting a view into the protobuf message is a separate call, so
+// consumers which only look at a few fields do not pay for building the whole message.
+struct ViewWriter : public FusedWriter {
+    virtual ~ViewWriter() {}
+
+    virtual void write(const Graph &graph, const char* proto_header) override {
+        if (graph.recursive) {
+            throw std::runtime_error("Views can not hold recursive messages");
+        }
+        auto name_lower = graph.root.desc->name();
+        std::transform(name_lower.begin(), name_lower.end(), name_lower.begin(), ::tolower);
+        const auto cpp_type = get_full_cpp_type_name(*graph.root.desc);
+        const auto view_name = name_lower + "_view";
+        const auto res_name_prefix = view_name + ".pb";
+
+        const auto header_name = res_name_prefix + ".h";
+        FILE *header = openOutput();
+        printViewHeader(header, graph, view_name.c_str(), cpp_type.c_str(), proto_header);
+        closeOutput(header, header_name);
+
+        const auto source_name = res_name_prefix + ".cc";
+        FILE *source = openOutput();
+        printViewSource(source, graph, view_name.c_str(), cpp_type.c_str());
+        closeOutput(source, source_name);
+    }
+
+    void printViewHeader(FILE *file, const Graph &graph, const char *t, const char *c, const char* h) {
+        fprintf(file, "#pragma once\n\n");
+        fprintf(file, "#include <stddef.h>\n");
+        fprintf(file, "#include <stdint.h>\n");
+        fprintf(file, "#include <string.h>\n\n");
+        fprintf(file, "#include <deque>\n");
+        fprintf(file, "#include <string>\n");
+        fprintf(file, "#include <vector>\n\n");
+        fprintf(file, "#include \"%s\"\n\n", h);
+        printNamespaceBegin(file, graph);
+        printViewTypes(file, t);
+        for (const auto &node : getMessageNodes(graph)) {
+            printViewStruct(file, graph, *node, t);
+        }
+        fprintf(file, "// Parses json into view, which is reset first. Strings without escape sequences point into buf, so buf has\n");
+        fprintf(file, "// to outlive the view. Returns 0 on success.\n");
+        fprintf(file, "int %s_parse(%s &view, const char *buf, size_t bufLen, std::string *error = nullptr);\n", t, t);
+        fprintf(file, "void %s_to_message(const %s &view, %s &msg);\n", t, t, c);
+        fprintf(file, "\n");
+        printNamespaceEnd(file, graph);
+    }
+
+    void printViewTypes(FILE *file, const char *t) {
+        fprintf(file, "// Points into the parsed buffer, or into the view's own storage for strings which contained escape sequences.\n");
+        fprintf(file, "struct %s_string {\n", t);
+        fprintf(file, "    const char *data = nullptr;\n");
+        fprintf(file, "    size_t size = 0;\n");
+        fprintf(file, "\n");
+        fprintf(file, "    std::string str() const { return std::string(data, size); }\n");
+        fprintf(file, "    bool operator==(const std::string &other) const { return other.size() == size && memcmp(other.data(), data, size) == 0; }\n");
+        fprintf(file, "};\n");
+        fprintf(file, "\n");
+        fprintf(file, "// Keeps the first N elements inline and moves to the heap once there are more.\n");
+        fprintf(file, "template <typename T, size_t N>\n");
+        fprintf(file, "class %s_vector {\n", t);
+        fprintf(file, "public:\n");
+        fprintf(file, "    size_t size() const { return size_; }\n");
+        fprintf(file, "    bool empty() const { return size_ == 0; }\n");
+        fprintf(file, "    const T &operator[](size_t i) const { return data()[i]; }\n");
+        fprintf(file, "    const T *begin() const { return data(); }\n");
+        fprintf(file, "    const T *end() const { return data() + size_; }\n");
+        fprintf(file, "\n");
+        fprintf(file, "    T &add() {\n");
+        fprintf(file, "        if (size_ < N) {\n");
+        fprintf(file, "            inline_[size_] = T();\n");
+        fprintf(file, "            return inline_[size_++];\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "        if (size_ == N) {\n");
+        fprintf(file, "            heap_.reserve(N * 2);\n");
+        fprintf(file, "            for (size_t i = 0; i < N; ++i) {\n");
+        fprintf(file, "                heap_.push_back(std::move(inline_[i]));\n");
+        fprintf(file, "            }\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "        heap_.emplace_back();\n");
+        fprintf(file, "        ++size_;\n");
+        fprintf(file, "        return heap_.back();\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "\n");
+        fprintf(file, "    void clear() {\n");
+        fprintf(file, "        size_ = 0;\n");
+        fprintf(file, "        heap_.clear();\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "\n");
+        fprintf(file, "private:\n");
+        fprintf(file, "    const T *data() const { return size_ > N ? heap_.data() : inline_; }\n");
+        fprintf(file, "\n");
+        fprintf(file, "    T inline_[N];\n");
+        fprintf(file, "    std::vector<T> heap_;\n");
+        fprintf(file, "    size_t size_ = 0;\n");
+        fprintf(file, "};\n");
+        fprintf(file, "\n");
+        fprintf(file, "// Map fields keep their entries in json order, a key which appears twice is only resolved on conversion.\n");
+        fprintf(file, "template <typename K, typename V>\n");
+        fprintf(file, "struct %s_entry {\n", t);
+        fprintf(file, "    K key{};\n");
+        fprintf(file, "    V value{};\n");
+        fprintf(file, "};\n");
+
+        fprintf(file, "\n");
+    }
+
+    void printViewStruct(FILE *file, const Graph &graph, const Node &node, const char *t) {
+        const auto name = getViewName(graph, *getMessageDesc(node), t);
+        fprintf(file, "struct %s {\n", name.c_str());
+        int bits = 0;
+        for (const auto &child : node.children) {
+            const auto type = getViewFieldType(graph, *child, t);
+            fprintf(file, "    %s %s{};\n", type.c_str(), child->name.c_str());
+            if (!child->field->is_repeated()) {
+                ++bits;
+            }
+        }
+        if (!node.parent) {
+            fprintf(file, "    std::deque<std::string> storage_; // strings which contained escape sequences and decoded bytes\n");
+        }
+        if (bits > 0) {
+            fprintf(file, "    uint32_t has_bits_[%d] = {};\n", (bits + 31) / 32);
+            fprintf(file, "\n");
+            int bit = 0;
+            for (const auto &child : node.children) {
+                if (child->field->is_repeated()) {
+                    continue;
+                }
+                const char *n = child->name.c_str();
+                fprintf(file, "    bool has_%s() const { return (has_bits_[%d] & %uu) != 0; }\n", n, bit / 32, 1u << (bit % 32));
+                fprintf(file, "    void set_has_%s() { has_bits_[%d] |= %uu; }\n", n, bit / 32, 1u << (bit % 32));
+                fprintf(file, "    void clear_has_%s() { has_bits_[%d] &= ~%uu; }\n", n, bit / 32, 1u << (bit % 32));
+                ++bit;
+            }
+        }
+        fprintf(file, "};\n\n");
+    }
+
+    void printViewSource(FILE *file, const Graph &graph, const char *t, const char *c) {
+        fprintf(file, "#include \"%s.pb.h\"\n\n", t);
+        fprintf(file, "#include <errno.h>\n");
+        fprintf(file, "#include <limits.h>\n");
+        fprintf(file, "#include <math.h>\n");
+        fprintf(file, "#include <stdlib.h>\n");
+        fprintf(file, "#include <stdio.h>\n");
+        fprintf(file, "#include <string.h>\n\n");
+        fprintf(file, "#if defined(__SSSE3__)\n");
+        fprintf(file, "#include <immintrin.h>\n");
+        fprintf(file, "#endif\n\n");
+        fprintf(file, "#include <string>\n");
+        fprintf(file, "\n");
+        printNamespaceBegin(file, graph);
+        fprintf(file, "namespace {\n\n");
+        printLexer(file, t);
+        if (hasBytesFields(graph)) {
+            printBase64Impl(file, t);
+        }
+        fprintf(file, "static inline %s_string %s_capture(%s_parser_lexer &lex, std::deque<std::string> &storage,\n", t, t, t);
+        fprintf(file, "                                   const char *v, size_t vLen) {\n");
+        fprintf(file, "    if (v == lex.scratch.data()) { // decoded escape sequences are only kept until the next string\n");
+        fprintf(file, "        storage.emplace_back(v, vLen);\n");
+        fprintf(file, "        v = storage.back().data();\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    %s_string s;\n", t);
+        fprintf(file, "    s.data = v;\n");
+        fprintf(file, "    s.size = vLen;\n");
+        fprintf(file, "    return s;\n");
+        fprintf(file, "}\n\n");
+        const auto nodes = getMessageNodes(graph);
+        for (const auto &node : nodes) {
+            printViewParser(file, graph, *node, t);
+        }
+        for (const auto &node : nodes) {
+            printViewConverter(file, graph, *node, t);
+        }
+        fprintf(file, "} // anonymous namespace\n\n");
+        printViewApiImpl(file, graph, t, c);
+        printNamespaceEnd(file, graph);
+    }
+
+    void printViewParser(FILE *file, const Graph &graph, const Node &node, const char *t) {
+        const auto name = getViewName(graph, *getMessageDesc(node), t);
+        fprintf(file, "// map %s\n", node.full_name.c_str());
+        fprintf(file, "static bool %s_read(%s_parser_lexer &lex, std::deque<std::string> &storage, %s *view) {\n",
+                name.c_str(), t, name.c_str());
+        fprintf(file, "    if (%s_parser_lex_peek(lex, '}')) {\n", t);
+        fprintf(file, "        ++lex.p;\n");
+        fprintf(file, "        return true;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    bool more = true;\n");
+        fprintf(file, "    while (more) {\n");
+        fprintf(file, "        const char *key;\n");
+        fprintf(file, "        size_t keyLen;\n");
+        fprintf(file, "        if (!%s_parser_lex_string(lex, key, keyLen, true) || !%s_parser_lex_expect(lex, ':')) {\n", t, t);
+        fprintf(file, "            return false;\n");
+        fprintf(file, "        }\n");
+        printKeySwitch(file, node.children, "key", "keyLen", "        ", [&](const Node& child, const std::string& indent) {
+            printViewField(file, graph, child, t, indent);
+            fprintf(file, "%sgoto next;\n", indent.c_str());
+        });
+        if (skipUnknown) {
+            fprintf(file, "        if (!%s_parser_lex_skip(lex)) {\n", t);
+            fprintf(file, "            return false;\n");
+            fprintf(file, "        }\n");
+        } else {
+            fprintf(file, "        return %s_parser_lex_fail(lex, \"invalid key for %s\");\n", t, node.full_name.c_str());
+        }
+        if (!node.children.empty()) {
+            fprintf(file, "    next:\n");
+        }
+        fprintf(file, "        if (!%s_parser_lex_end_of_value(lex, more, '}')) {\n", t);
+        fprintf(file, "            return false;\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    return true;\n");
+        fprintf(file, "}\n\n");
+    }
+
+    void printViewField(FILE *file, const Graph &graph, const Node &node, const char *t, const std::string &indent) {
+        const bool nullable = std::find(graph.null_nodes.begin(), graph.null_nodes.end(), &node) != graph.null_nodes.end();
+        const char *n = node.name.c_str();
+        const bool repeated = node.field->is_repeated();
+        auto inner = indent;
+        if (nullable) {
+            fprintf(file, "%sif (%s_parser_lex_peek(lex, 'n')) {\n", indent.c_str(), t);
+            fprintf(file, "%s    if (!%s_parser_lex_null(lex)) {\n", indent.c_str(), t);
+            fprintf(file, "%s        return false;\n", indent.c_str());
+            fprintf(file, "%s    }\n", indent.c_str());
+            if (repeated) {
+                fprintf(file, "%s    view->%s.clear();\n", indent.c_str(), n);
+            } else {
+                fprintf(file, "%s    view->%s = {};\n", indent.c_str(), n);
+                fprintf(file, "%s    view->clear_has_%s();\n", indent.c_str(), n);
+            }
+            fprintf(file, "%s} else {\n", indent.c_str());
+            inner += "    ";
+        }
+        const char *i = inner.c_str();
+        if (node.type == NodeType::ARRAY) {
+            assert(node.children.size() == 1);
+            fprintf(file, "%sif (!%s_parser_lex_expect(lex, '[')) {\n", i, t);
+            fprintf(file, "%s    return false;\n", i);
+            fprintf(file, "%s}\n", i);
+            fprintf(file, "%sif (%s_parser_lex_peek(lex, ']')) {\n", i, t);
+            fprintf(file, "%s    ++lex.p;\n", i);
+            fprintf(file, "%s} else {\n", i);
+            fprintf(file, "%s    bool more = true;\n", i);
+            fprintf(file, "%s    while (more) {\n", i);
+            printViewValue(file, graph, *node.children[0], t, "view->" + node.name + ".add()", inner + "        ");
+            fprintf(file, "%s        if (!%s_parser_lex_end_of_value(lex, more, ']')) {\n", i, t);
+            fprintf(file, "%s            return false;\n", i);
+            fprintf(file, "%s        }\n", i);
+            fprintf(file, "%s    }\n", i);
+            fprintf(file, "%s}\n", i);
+        } else if (node.type == NodeType::MAP) {
+            assert(node.children.size() == 1);
+            const auto &key = getMapKey(node);
+            fprintf(file, "%sif (!%s_parser_lex_expect(lex, '{')) {\n", i, t);
+            fprintf(file, "%s    return false;\n", i);
+            fprintf(file, "%s}\n", i);
+            fprintf(file, "%sif (%s_parser_lex_peek(lex, '}')) {\n", i, t);
+            fprintf(file, "%s    ++lex.p;\n", i);
+            fprintf(file, "%s} else {\n", i);
+            fprintf(file, "%s    bool more = true;\n", i);
+            fprintf(file, "%s    while (more) {\n", i);
+            fprintf(file, "%s        const char *key;\n", i);
+            fprintf(file, "%s        size_t keyLen;\n", i);
+            fprintf(file, "%s        if (!%s_parser_lex_string(lex, key, keyLen, true) || !%s_parser_lex_expect(lex, ':')) {\n", i, t, t);
+            fprintf(file, "%s            return false;\n", i);
+            fprintf(file, "%s        }\n", i);
+            fprintf(file, "%s        auto &entry = view->%s.add();\n", i, n);
+            if (key.cpp_type() == FieldDescriptor::CPPTYPE_STRING) {
+                fprintf(file, "%s        entry.key = %s_capture(lex, storage, key, keyLen);\n", i, t);
+            } else {
+                printMapKey(file, key, t, "key", "keyLen", "entry.key", inner + "        ", [&](const std::string &indent) {
+                    fprintf(file, "%sreturn %s_parser_lex_fail(lex, \"invalid map key\", %s_parser_lex_key);\n", indent.c_str(), t, t);
+                });
+            }
+            printViewValue(file, graph, *node.children[0], t, "entry.value", inner + "        ");
+            fprintf(file, "%s        if (!%s_parser_lex_end_of_value(lex, more, '}')) {\n", i, t);
+            fprintf(file, "%s            return false;\n", i);
+            fprintf(file, "%s        }\n", i);
+            fprintf(file, "%s    }\n", i);
+            fprintf(file, "%s}\n", i);
+        } else {
+            printViewValue(file, graph, node, t, "view->" + node.name, inner);
+            fprintf(file, "%sview->set_has_%s();\n", i, n);
+        }
+        if (nullable) {
+            fprintf(file, "%s}\n", indent.c_str());
+        }
+    }
+
+    void printViewValue(FILE *file, const Graph &graph, const Node &node, const char *t, const std::string &target,
+                        const std::string &indent) {
+        const char *i = indent.c_str();
+        const auto type = getViewScalarType(graph, *node.field, t);
+        switch (node.type) {
+            case NodeType::BOOL:
+                fprintf(file, "%sbool v;\n", i);
+                fprintf(file, "%sif (!%s_parser_lex_boolean(lex, v)) {\n", i, t);
+                fprintf(file, "%s    return false;\n", i);
+                fprintf(file, "%s}\n", i);
+                fprintf(file, "%s%s = v;\n", i, target.c_str());
+                break;
+            case NodeType::LONG:
+                fprintf(file, "%s%s_t v;\n", i, getNumberKind(*node.field));
+                fprintf(file, "%sif (!%s_parser_lex_%s(lex, v)) {\n", i, t, getNumberKind(*node.field));
+                fprintf(file, "%s    return false;\n", i);
+                fprintf(file, "%s}\n", i);
+                fprintf(file, "%s%s = static_cast<%s>(v);\n", i, target.c_str(), type.c_str());
+                break;
+            case NodeType::DOUBLE:
+                fprintf(file, "%sdouble v;\n", i);
+                fprintf(file, "%sif (!%s_parser_lex_double(lex, v)) {\n", i, t);
+                fprintf(file, "%s    return false;\n", i);
+                fprintf(file, "%s}\n", i);
+                fprintf(file, "%s%s = static_cast<%s>(v);\n", i, target.c_str(), type.c_str());
+                break;
+            case NodeType::STRING:
+                fprintf(file, "%sconst char *v;\n", i);
+                fprintf(file, "%ssize_t vLen;\n", i);
+                fprintf(file, "%sif (!%s_parser_lex_string(lex, v, vLen)) {\n", i, t);
+                fprintf(file, "%s    return false;\n", i);
+                fprintf(file, "%s}\n", i);
+                if (node.field->type() == FieldDescriptor::TYPE_BYTES) {
+                    fprintf(file, "%sstorage.emplace_back();\n", i);
+                    fprintf(file, "%sif (!%s_parser_base64_decode(v, vLen, storage.back())) {\n", i, t);
+                    fprintf(file, "%s    return %s_parser_lex_fail(lex, \"invalid base64 string\", %s_parser_lex_base64);\n", i, t, t);
+                    fprintf(file, "%s}\n", i);
+                    fprintf(file, "%s%s = %s_capture(lex, storage, storage.back().data(), storage.back().size());\n", i,
+                            target.c_str(), t);
+                } else {
+                    fprintf(file, "%s%s = %s_capture(lex, storage, v, vLen);\n", i, target.c_str(), t);
+                }
+                break;
+            case NodeType::OUTSIDE_OBJECT:
+                fprintf(file, "%sif (!%s_parser_lex_expect(lex, '{') ||\n", i, t);
+                fprintf(file, "%s    !%s_read(lex, storage, &(%s))) {\n", i,
+                        getViewName(graph, *node.field->message_type(), t).c_str(), target.c_str());
+                fprintf(file, "%s    return false;\n", i);
+                fprintf(file, "%s}\n", i);
+                break;
+            default:
+                throw std::runtime_error("Unexpected node type for " + node.full_name);
+        }
+    }
+
+    void printViewConverter(FILE *file, const Graph &graph, const Node &node, const char *t) {
+        const auto &desc = *getMessageDesc(node);
+        const auto name = getViewName(graph, desc, t);
+        fprintf(file, "static void %s_convert(const %s &view, %s &msg) {\n", name.c_str(), name.c_str(),
+                get_full_cpp_type_name(desc).c_str());
+        for (const auto &child : node.children) {
+            const char *n = child->name.c_str();
+            const bool isMessage = child->field->type() == FieldDescriptor::TYPE_MESSAGE;
+            const bool isString = child->field->cpp_type() == FieldDescriptor::CPPTYPE_STRING;
+            if (child->type == NodeType::MAP) {
+                const auto &value = *child->children[0]->field;
+                const bool isStringKey = getMapKey(*child).cpp_type() == FieldDescriptor::CPPTYPE_STRING;
+                fprintf(file, "    for (const auto &entry : view.%s) {\n", n);
+                fprintf(file, "        auto &v = (*msg.mutable_%s())[%s];\n", n, isStringKey ? "entry.key.str()" : "entry.key");
+                if (value.type() == FieldDescriptor::TYPE_MESSAGE) {
+                    const auto sub = getViewName(graph, *value.message_type(), t);
+                    fprintf(file, "        %s_convert(entry.value, v);\n", sub.c_str());
+                } else if (value.cpp_type() == FieldDescriptor::CPPTYPE_STRING) {
+                    fprintf(file, "        v.assign(entry.value.data, entry.value.size);\n");
+                } else {
+                    fprintf(file, "        v = entry.value;\n");
+                }
+                fprintf(file, "    }\n");
+            } else if (child->field->is_repeated()) {
+                fprintf(file, "    if (!view.%s.empty()) {\n", n);
+                fprintf(file, "        msg.mutable_%s()->Reserve(msg.%s_size() + static_cast<int>(view.%s.size()));\n", n, n, n);
+                fprintf(file, "        for (const auto &v : view.%s) {\n", n);
+                if (isMessage) {
+                    const auto sub = getViewName(graph, *child->field->message_type(), t);
+                    fprintf(file, "            %s_convert(v, *msg.add_%s());\n", sub.c_str(), n);
+                } else if (isString) {
+                    fprintf(file, "            msg.add_%s()->assign(v.data, v.size);\n", n);
+                } else {
+                    fprintf(file, "            msg.add_%s(v);\n", n);
+                }
+                fprintf(file, "        }\n");
+                fprintf(file, "    }\n");
+            } else {
+                fprintf(file, "    if (view.has_%s()) {\n", n);
+                if (isMessage) {
+                    const auto sub = getViewName(graph, *child->field->message_type(), t);
+                    fprintf(file, "        %s_convert(view.%s, *msg.mutable_%s());\n", sub.c_str(), n, n);
+                } else if (isString) {
+                    fprintf(file, "        msg.mutable_%s()->assign(view.%s.data, view.%s.size);\n", n, n, n);
+                } else {
+                    fprintf(file, "        msg.set_%s(view.%s);\n", n, n);
+                }
+                fprintf(file, "    }\n");
+            }
+        }
+        fprintf(file, "}\n\n");
+    }
+
+    void printViewApiImpl(FILE *file, const Graph &graph, const char *t, const char *c) {
+        fprintf(file, "int %s_parse(%s &view, const char *buf, size_t bufLen, std::string *error) {\n", t, t);
+        fprintf(file, "    view = %s();\n", t);
+        fprintf(file, "    %s_parser_lexer lex;\n", t);
+        fprintf(file, "    lex.begin = buf;\n");
+        fprintf(file, "    lex.p = buf;\n");
+        fprintf(file, "    lex.end = buf + bufLen;\n");
+        fprintf(file, "    lex.error = nullptr;\n");
+        fprintf(file, "    lex.code = 0;\n");
+        fprintf(file, "    lex.state = 0;\n");
+        fprintf(file, "    lex.checkInitialized = false;\n");
+        fprintf(file, "    lex.allowComments = false;\n");
+        fprintf(file, "    lex.done = false;\n");
+        fprintf(file, "    lex.depth = 0;\n");
+        fprintf(file, "    if (%s_parser_lex_check_utf8(lex) && %s_parser_lex_expect(lex, '{') && %s_read(lex, view.storage_, &view)) {\n", t, t, t);
+        fprintf(file, "        %s_parser_lex_skip_ws(lex);\n", t);
+        fprintf(file, "        if (lex.p == lex.end) {\n");
+        fprintf(file, "            return 0;\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "        %s_parser_lex_fail(lex, \"trailing garbage\");\n", t);
+        fprintf(file, "    }\n");
+        fprintf(file, "    if (error) {\n");
+        fprintf(file, "        *error = std::string(\"parse error: \") + lex.error + \" at offset \" + std::to_string(lex.p - lex.begin);\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    return 1;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "void %s_to_message(const %s &view, %s &msg) {\n", t, t, c);
+        fprintf(file, "    %s_convert(view, msg);\n", t);
+        fprintf(file, "}\n\n");
+    }
+
+    // one object node per message type, callees before their callers
+    static std::vector<const Node*> getMessageNodes(const Graph &graph) {
+        std::vector<const Node*> nodes;
+        std::set<const Descriptor*> seen;
+        for (auto it = graph.object_nodes.rbegin(); it != graph.object_nodes.rend(); ++it) {
+            if (seen.insert(getMessageDesc(**it)).second) {
+                nodes.push_back(*it);
+            }
+        }
+        return nodes;
+    }
+
+    static std::string getViewName(const Graph &graph, const Descriptor &desc, const char *t) {
+        if (&desc == graph.root.desc) {
+            return t;
+        }
+        auto name = desc.full_name();
+        const auto &package = graph.fileDesc->package();
+        if (!package.empty()) {
+            name = name.substr(package.size() + 1);
+        }
+        return std::string(t) + "_" + replace_all(name, ".", "_");
+    }
+
+    static std::string getViewScalarType(const Graph &graph, const FieldDescriptor &field, const char *t) {
+        switch (field.cpp_type()) {
+            case FieldDescriptor::CPPTYPE_BOOL: return "bool";
+            case FieldDescriptor::CPPTYPE_INT32: return "int32_t";
+            case FieldDescriptor::CPPTYPE_INT64: return "int64_t";
+            case FieldDescriptor::CPPTYPE_UINT32: return "uint32_t";
+            case FieldDescriptor::CPPTYPE_UINT64: return "uint64_t";
+            case FieldDescriptor::CPPTYPE_FLOAT: return "float";
+            case FieldDescriptor::CPPTYPE_DOUBLE: return "double";
+            case FieldDescriptor::CPPTYPE_ENUM: return get_full_cpp_type_name(*field.enum_type());
+            case FieldDescriptor::CPPTYPE_STRING: return std::string(t) + "_string";
+            case FieldDescriptor::CPPTYPE_MESSAGE: return getViewName(graph, *field.message_type(), t);
+        }
+        throw std::runtime_error("Unsupported field type for " + field.full_name());
+    }
+
+    static std::string getViewFieldType(const Graph &graph, const Node &node, const char *t) {
+        if (node.type == NodeType::MAP) {
+            const auto key = getViewScalarType(graph, getMapKey(node), t);
+            const auto value = getViewScalarType(graph, *node.children[0]->field, t);
+            return std::string(t) + "_vector<" + t + "_entry<" + key + ", " + value + ">, 4>";
+        }
+        const auto type = getViewScalarType(graph, *node.field, t);
+        if (!node.field->is_repeated()) {
+            return type;
+        }
+        const bool isMessage = node.field->type() == FieldDescriptor::TYPE_MESSAGE;
+        return std::string(t) + "_vector<" + type + ", " + (isMessage ? "2" : "4") + ">";
+    }
+};
+
+} // namespace protog
@@ -0,0 +1,451 @@
+#pragma once
+
+#include "fused_writer.h"
+#include "parser.h"
+
+namespace protog {
+
+// Generates a transcoder which writes the protobuf wire format straight from the fused lexer, for consumers which
+// would otherwise parse into a message only to serialize it again. Tags are precomputed, scalars are encoded as they
+// are read and nested messages reserve a single length byte which is back-filled once the message is complete. No
+// message objects are involved, the only allocations are the growth of the output buffer.
+struct WireWriter : public FusedWriter {
+    virtual ~WireWriter() {}
+
+    virtual void write(const Graph &graph, const char* proto_header) override {
+        auto name_lower = graph.root.desc->name();
+        std::transform(name_lower.begin(), name_lower.end(), name_lower.begin(), ::tolower);
+        const auto wire_name = name_lower + "_wire";
+        const auto res_name_prefix = wire_name + ".pb";
+
+        const auto header_name = res_name_prefix + ".h";
+        FILE *header = openOutput();
+        printWireHeader(header, graph, wire_name.c_str(), graph.root.desc->full_name().c_str());
+        closeOutput(header, header_name);
+
+        const auto source_name = res_name_prefix + ".cc";
+        FILE *source = openOutput();
+        printWireSource(source, graph, wire_name.c_str());
+        closeOutput(source, source_name);
+    }
+
+    void printWireHeader(FILE *file, const Graph &graph, const char *t, const char *name) {
+        fprintf(file, "#pragma once\n\n");
+        fprintf(file, "#include <stddef.h>\n\n");
+        fprintf(file, "#include <string>\n\n");
+        printNamespaceBegin(file, graph);
+        fprintf(file, "// Appends the protobuf wire format of the %s in json to out. Fields are written in input order and\n", name);
+        fprintf(file, "// null values are left out, required fields are not checked. Reuse out to avoid reallocations. Returns 0\n");
+        fprintf(file, "// on success, on failure out is truncated to its previous size.\n");
+        fprintf(file, "int %s_transcode(const char *buf, size_t bufLen, std::string &out, std::string *error = nullptr);\n", t);
+        fprintf(file, "\n");
+        printNamespaceEnd(file, graph);
+    }
+
+    void printWireSource(FILE *file, const Graph &graph, const char *t) {
+        fprintf(file, "#include \"%s.pb.h\"\n\n", t);
+        fprintf(file, "#include <errno.h>\n");
+        fprintf(file, "#include <limits.h>\n");
+        fprintf(file, "#include <math.h>\n");
+        fprintf(file, "#include <stdint.h>\n");
+        fprintf(file, "#include <stdlib.h>\n");
+        fprintf(file, "#include <stdio.h>\n");
+        fprintf(file, "#include <string.h>\n\n");
+        fprintf(file, "#if defined(__SSSE3__)\n");
+        fprintf(file, "#include <immintrin.h>\n");
+        fprintf(file, "#endif\n\n");
+        fprintf(file, "#include <string>\n");
+        fprintf(file, "\n");
+        printNamespaceBegin(file, graph);
+        fprintf(file, "namespace {\n\n");
+        printLexer(file, t);
+        if (hasBytesFields(graph)) {
+            printBase64Impl(file, t);
+        }
+        printWireRuntime(file, t);
+        if (graph.shareTypes) {
+            for (const auto &node : graph.object_nodes) {
+                fprintf(file, "static bool %s_read_%d(%s_parser_lexer &lex, std::string &out);\n", t, node->state, t);
+            }
+            fprintf(file, "\n");
+        }
+        for (auto it = graph.object_nodes.rbegin(); it != graph.object_nodes.rend(); ++it) {
+            printWireReader(file, graph, **it, t);
+        }
+        fprintf(file, "} // anonymous namespace\n\n");
+        printWireApiImpl(file, t);
+        printNamespaceEnd(file, graph);
+    }
+
+    void printWireRuntime(FILE *file, const char *t) {
+        fprintf(file, "static inline void %s_put_varint(std::string &out, uint64_t v) {\n", t);
+        fprintf(file, "    char tmp[10];\n");
+        fprintf(file, "    size_t n = 0;\n");
+        fprintf(file, "    while (v >= 0x80) {\n");
+        fprintf(file, "        tmp[n++] = static_cast<char>(v | 0x80);\n");
+        fprintf(file, "        v >>= 7;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    tmp[n++] = static_cast<char>(v);\n");
+        fprintf(file, "    out.append(tmp, n);\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "static inline void %s_put_fixed32(std::string &out, uint32_t v) {\n", t);
+        fprintf(file, "    char tmp[4];\n");
+        fprintf(file, "    for (size_t i = 0; i < sizeof(tmp); ++i) {\n");
+        fprintf(file, "        tmp[i] = static_cast<char>(v >> (8 * i));\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    out.append(tmp, sizeof(tmp));\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "static inline void %s_put_fixed64(std::string &out, uint64_t v) {\n", t);
+        fprintf(file, "    char tmp[8];\n");
+        fprintf(file, "    for (size_t i = 0; i < sizeof(tmp); ++i) {\n");
+        fprintf(file, "        tmp[i] = static_cast<char>(v >> (8 * i));\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    out.append(tmp, sizeof(tmp));\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "static inline void %s_put_float(std::string &out, float v) {\n", t);
+        fprintf(file, "    uint32_t bits;\n");
+        fprintf(file, "    memcpy(&bits, &v, sizeof(bits));\n");
+        fprintf(file, "    %s_put_fixed32(out, bits);\n", t);
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "static inline void %s_put_double(std::string &out, double v) {\n", t);
+        fprintf(file, "    uint64_t bits;\n");
+        fprintf(file, "    memcpy(&bits, &v, sizeof(bits));\n");
+        fprintf(file, "    %s_put_fixed64(out, bits);\n", t);
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "// Reserves one byte for the length of the payload which follows and returns where the payload starts.\n");
+        fprintf(file, "static inline size_t %s_begin(std::string &out) {\n", t);
+        fprintf(file, "    out.push_back('\\0');\n");
+        fprintf(file, "    return out.size();\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "// Back-fills the length reserved by begin. Payloads of 128 bytes and more are shifted to make room for the\n");
+        fprintf(file, "// longer varint, which is rare enough to be cheaper than reserving the maximum up front.\n");
+        fprintf(file, "static inline void %s_end(std::string &out, size_t start) {\n", t);
+        fprintf(file, "    uint64_t len = out.size() - start;\n");
+        fprintf(file, "    if (len < 0x80) {\n");
+        fprintf(file, "        out[start - 1] = static_cast<char>(len);\n");
+        fprintf(file, "        return;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    char tmp[10];\n");
+        fprintf(file, "    size_t n = 0;\n");
+        fprintf(file, "    while (len >= 0x80) {\n");
+        fprintf(file, "        tmp[n++] = static_cast<char>(len | 0x80);\n");
+        fprintf(file, "        len >>= 7;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    tmp[n++] = static_cast<char>(len);\n");
+        fprintf(file, "    out.insert(start, n - 1, '\\0');\n");
+        fprintf(file, "    memcpy(&out[start - 1], tmp, n);\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+    }
+
+    void printWireReader(FILE *file, const Graph &graph, const Node &node, const char *t) {
+        fprintf(file, "// map %s\n", node.full_name.c_str());
+        fprintf(file, "static bool %s_read_%d(%s_parser_lexer &lex, std::string &out) {\n", t, node.state, t);
+        if (graph.recursive) {
+            printDepthCheck(file, t);
+        }
+        fprintf(file, "    if (%s_parser_lex_peek(lex, '}')) {\n", t);
+        fprintf(file, "        ++lex.p;\n");
+        if (graph.recursive) {
+            fprintf(file, "        --lex.depth;\n");
+        }
+        fprintf(file, "        return true;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    bool more = true;\n");
+        fprintf(file, "    while (more) {\n");
+        fprintf(file, "        const char *key;\n");
+        fprintf(file, "        size_t keyLen;\n");
+        fprintf(file, "        if (!%s_parser_lex_string(lex, key, keyLen, true) || !%s_parser_lex_expect(lex, ':')) {\n", t, t);
+        fprintf(file, "            return false;\n");
+        fprintf(file, "        }\n");
+        printKeySwitch(file, node.children, "key", "keyLen", "        ", [&](const Node& child, const std::string& indent) {
+            printWireField(file, graph, child, t, indent);
+            fprintf(file, "%sgoto next;\n", indent.c_str());
+        });
+        if (skipUnknown) {
+            fprintf(file, "        if (!%s_parser_lex_skip(lex)) {\n", t);
+            fprintf(file, "            return false;\n");
+            fprintf(file, "        }\n");
+        } else {
+            fprintf(file, "        return %s_parser_lex_fail(lex, \"invalid key for %s\");\n", t, node.full_name.c_str());
+        }
+        if (!node.children.empty()) {
+            fprintf(file, "    next:\n");
+        }
+        fprintf(file, "        if (!%s_parser_lex_end_of_value(lex, more, '}')) {\n", t);
+        fprintf(file, "            return false;\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "    }\n");
+        if (graph.recursive) {
+            fprintf(file, "    --lex.depth;\n");
+        }
+        fprintf(file, "    return true;\n");
+        fprintf(file, "}\n\n");
+    }
+
+    void printWireField(FILE *file, const Graph &graph, const Node &node, const char *t, const std::string &indent) {
+        const bool nullable = std::find(graph.null_nodes.begin(), graph.null_nodes.end(), &node) != graph.null_nodes.end();
+        auto inner = indent;
+        if (nullable) {
+            fprintf(file, "%sif (%s_parser_lex_peek(lex, 'n')) {\n", indent.c_str(), t);
+            fprintf(file, "%s    if (!%s_parser_lex_null(lex)) {\n", indent.c_str(), t);
+            fprintf(file, "%s        return false;\n", indent.c_str());
+            fprintf(file, "%s    }\n", indent.c_str());
+            fprintf(file, "%s} else {\n", indent.c_str());
+            inner += "    ";
+        }
+        const char *i = inner.c_str();
+        if (node.type == NodeType::ARRAY) {
+            assert(node.children.size() == 1);
+            const bool packed = node.field->is_packed();
+            fprintf(file, "%sif (!%s_parser_lex_expect(lex, '[')) {\n", i, t);
+            fprintf(file, "%s    return false;\n", i);
+            fprintf(file, "%s}\n", i);
+            fprintf(file, "%sif (%s_parser_lex_peek(lex, ']')) {\n", i, t);
+            fprintf(file, "%s    ++lex.p;\n", i);
+            fprintf(file, "%s} else {\n", i);
+            if (packed) {
+                printTag(file, *node.field, WIRETYPE_LENGTH_DELIMITED, inner + "    ");
+                fprintf(file, "%s    const size_t start = %s_begin(out);\n", i, t);
+            }
+            fprintf(file, "%s    bool more = true;\n", i);
+            fprintf(file, "%s    while (more) {\n", i);
+            if (!packed) {
+                printTag(file, *node.field, getWireType(*node.field), inner + "        ");
+            }
+            printWireValue(file, *node.children[0], t, inner + "        ");
+            fprintf(file, "%s        if (!%s_parser_lex_end_of_value(lex, more, ']')) {\n", i, t);
+            fprintf(file, "%s            return false;\n", i);
+            fprintf(file, "%s        }\n", i);
+            fprintf(file, "%s    }\n", i);
+            if (packed) {
+                fprintf(file, "%s    %s_end(out, start);\n", i, t);
+            }
+            fprintf(file, "%s}\n", i);
+        } else if (node.type == NodeType::MAP) {
+            assert(node.children.size() == 1);
+            fprintf(file, "%sif (!%s_parser_lex_expect(lex, '{')) {\n", i, t);
+            fprintf(file, "%s    return false;\n", i);
+            fprintf(file, "%s}\n", i);
+            fprintf(file, "%sif (%s_parser_lex_peek(lex, '}')) {\n", i, t);
+            fprintf(file, "%s    ++lex.p;\n", i);
+            fprintf(file, "%s} else {\n", i);
+            fprintf(file, "%s    bool more = true;\n", i);
+            fprintf(file, "%s    while (more) {\n", i);
+            fprintf(file, "%s        const char *key;\n", i);
+            fprintf(file, "%s        size_t keyLen;\n", i);
+            fprintf(file, "%s        if (!%s_parser_lex_string(lex, key, keyLen, true) || !%s_parser_lex_expect(lex, ':')) {\n", i, t, t);
+            fprintf(file, "%s            return false;\n", i);
+            fprintf(file, "%s        }\n", i);
+            printTag(file, *node.field, WIRETYPE_LENGTH_DELIMITED, inner + "        ");
+            fprintf(file, "%s        const size_t entry = %s_begin(out);\n", i, t);
+            printWireMapKey(file, getMapKey(node), t, inner + "        ");
+            const auto &value = *node.children[0];
+            printTag(file, *value.field, getWireType(*value.field), inner + "        ");
+            printWireValue(file, value, t, inner + "        ");
+            fprintf(file, "%s        %s_end(out, entry);\n", i, t);
+            fprintf(file, "%s        if (!%s_parser_lex_end_of_value(lex, more, '}')) {\n", i, t);
+            fprintf(file, "%s            return false;\n", i);
+            fprintf(file, "%s        }\n", i);
+            fprintf(file, "%s    }\n", i);
+            fprintf(file, "%s}\n", i);
+        } else {
+            printTag(file, *node.field, getWireType(*node.field), inner);
+            printWireValue(file, node, t, inner);
+        }
+        if (nullable) {
+            fprintf(file, "%s}\n", indent.c_str());
+        }
+    }
+
+    void printWireValue(FILE *file, const Node &node, const char *t, const std::string &indent) {
+        const char *i = indent.c_str();
+        switch (node.type) {
+            case NodeType::BOOL:
+                fprintf(file, "%sbool v;\n", i);
+                fprintf(file, "%sif (!%s_parser_lex_boolean(lex, v)) {\n", i, t);
+                fprintf(file, "%s    return false;\n", i);
+                fprintf(file, "%s}\n", i);
+                fprintf(file, "%sout.push_back(v ? '\\1' : '\\0');\n", i);
+                break;
+            case NodeType::LONG:
+                fprintf(file, "%s%s_t v;\n", i, getNumberKind(*node.field));
+                fprintf(file, "%sif (!%s_parser_lex_%s(lex, v)) {\n", i, t, getNumberKind(*node.field));
+                fprintf(file, "%s    return false;\n", i);
+                fprintf(file, "%s}\n", i);
+                printWireInteger(file, *node.field, t, i);
+                break;
+            case NodeType::DOUBLE:
+                fprintf(file, "%sdouble v;\n", i);
+                fprintf(file, "%sif (!%s_parser_lex_double(lex, v)) {\n", i, t);
+                fprintf(file, "%s    return false;\n", i);
+                fprintf(file, "%s}\n", i);
+                if (node.field->type() == FieldDescriptor::TYPE_FLOAT) {
+                    fprintf(file, "%s%s_put_float(out, static_cast<float>(v));\n", i, t);
+                } else {
+                    fprintf(file, "%s%s_put_double(out, v);\n", i, t);
+                }
+                break;
+            case NodeType::STRING:
+                fprintf(file, "%sconst char *v;\n", i);
+                fprintf(file, "%ssize_t vLen;\n", i);
+                fprintf(file, "%sif (!%s_parser_lex_string(lex, v, vLen)) {\n", i, t);
+                fprintf(file, "%s    return false;\n", i);
+                fprintf(file, "%s}\n", i);
+                if (node.field->type() == FieldDescriptor::TYPE_BYTES) {
+                    fprintf(file, "%s%s_put_varint(out, %s_parser_base64_size(v, vLen));\n", i, t, t);
+                    fprintf(file, "%sif (!%s_parser_base64_decode(v, vLen, out)) {\n", i, t);
+                    fprintf(file, "%s    return %s_parser_lex_fail(lex, \"invalid base64 string\", %s_parser_lex_base64);\n", i, t, t);
+                    fprintf(file, "%s}\n", i);
+                } else {
+                    fprintf(file, "%s%s_put_varint(out, vLen);\n", i, t);
+                    fprintf(file, "%sout.append(v, vLen);\n", i);
+                }
+                break;
+            case NodeType::OUTSIDE_OBJECT:
+                assert(node.children.size() == 1);
+                fprintf(file, "%sconst size_t start = %s_begin(out);\n", i, t);
+                fprintf(file, "%sif (!%s_parser_lex_expect(lex, '{') || !%s_read_%d(lex, out)) {\n", i, t, t,
+                        node.children[0]->state);
+                fprintf(file, "%s    return false;\n", i);
+                fprintf(file, "%s}\n", i);
+                fprintf(file, "%s%s_end(out, start);\n", i, t);
+                break;
+            default:
+                throw std::runtime_error("Unexpected node type for " + node.full_name);
+        }
+    }
+
+    // the key of a map entry is field 1 of the entry message, in its own block as values use the same names
+    void printWireMapKey(FILE *file, const FieldDescriptor &key, const char *t, const std::string &indent) {
+        const char *i = indent.c_str();
+        printTag(file, key, getWireType(key), indent);
+        if (key.cpp_type() == FieldDescriptor::CPPTYPE_STRING) {
+            fprintf(file, "%s%s_put_varint(out, keyLen);\n", i, t);
+            fprintf(file, "%sout.append(key, keyLen);\n", i);
+            return;
+        }
+        fprintf(file, "%s{\n", i);
+        fprintf(file, "%s    %s v;\n", i, getMapKeyType(key).c_str());
+        printMapKey(file, key, t, "key", "keyLen", "v", indent + "    ", [&](const std::string &indent) {
+            fprintf(file, "%sreturn %s_parser_lex_fail(lex, \"invalid map key\", %s_parser_lex_key);\n", indent.c_str(), t, t);
+        });
+        if (key.cpp_type() == FieldDescriptor::CPPTYPE_BOOL) {
+            fprintf(file, "%s    out.push_back(v ? '\\1' : '\\0');\n", i);
+        } else {
+            printWireInteger(file, key, t, (indent + "    ").c_str());
+        }
+        fprintf(file, "%s}\n", i);
+    }
+
+    // integers are truncated to the field type first, just like the setters of the message parsers do
+    void printWireInteger(FILE *file, const FieldDescriptor &field, const char *t, const char *i) {
+        switch (field.type()) {
+            case FieldDescriptor::TYPE_INT32:
+            case FieldDescriptor::TYPE_ENUM:
+                fprintf(file, "%s%s_put_varint(out, static_cast<uint64_t>(static_cast<int64_t>(static_cast<int32_t>(v))));\n", i, t);
+                break;
+            case FieldDescriptor::TYPE_UINT32:
+                fprintf(file, "%s%s_put_varint(out, static_cast<uint32_t>(v));\n", i, t);
+                break;
+            case FieldDescriptor::TYPE_INT64:
+            case FieldDescriptor::TYPE_UINT64:
+                fprintf(file, "%s%s_put_varint(out, static_cast<uint64_t>(v));\n", i, t);
+                break;
+            case FieldDescriptor::TYPE_SINT32:
+                fprintf(file, "%sconst int32_t s = static_cast<int32_t>(v);\n", i);
+                fprintf(file, "%s%s_put_varint(out, (static_cast<uint32_t>(s) << 1) ^ static_cast<uint32_t>(s >> 31));\n", i, t);
+                break;
+            case FieldDescriptor::TYPE_SINT64:
+                fprintf(file, "%sconst int64_t s = static_cast<int64_t>(v);\n", i);
+                fprintf(file, "%s%s_put_varint(out, (static_cast<uint64_t>(s) << 1) ^ static_cast<uint64_t>(s >> 63));\n", i, t);
+                break;
+            case FieldDescriptor::TYPE_FIXED32:
+            case FieldDescriptor::TYPE_SFIXED32:
+                fprintf(file, "%s%s_put_fixed32(out, static_cast<uint32_t>(v));\n", i, t);
+                break;
+            case FieldDescriptor::TYPE_FIXED64:
+            case FieldDescriptor::TYPE_SFIXED64:
+                fprintf(file, "%s%s_put_fixed64(out, static_cast<uint64_t>(v));\n", i, t);
+                break;
+            default:
+                throw std::runtime_error("Unexpected integer type for " + field.full_name());
+        }
+    }
+
+    // the tag is known at generation time, so it is emitted as a string literal
+    void printTag(FILE *file, const FieldDescriptor &field, int type, const std::string &indent) {
+        uint64_t tag = (static_cast<uint64_t>(field.number()) << 3) | type;
+        std::string literal;
+        size_t n = 0;
+        do {
+            char byte[8];
+            snprintf(byte, sizeof(byte), "\\x%02x", static_cast<unsigned>((tag & 0x7f) | (tag >= 0x80 ? 0x80 : 0)));
+            literal += byte;
+            tag >>= 7;
+            ++n;
+        } while (tag != 0);
+        fprintf(file, "%sout.append(\"%s\", %zu); // tag %d\n", indent.c_str(), literal.c_str(), n, field.number());
+    }
+
+    static const int WIRETYPE_VARINT = 0;
+    static const int WIRETYPE_FIXED64 = 1;
+    static const int WIRETYPE_LENGTH_DELIMITED = 2;
+    static const int WIRETYPE_FIXED32 = 5;
+
+    static int getWireType(const FieldDescriptor &field) {
+        switch (field.type()) {
+            case FieldDescriptor::TYPE_FIXED64:
+            case FieldDescriptor::TYPE_SFIXED64:
+            case FieldDescriptor::TYPE_DOUBLE:
+                return WIRETYPE_FIXED64;
+            case FieldDescriptor::TYPE_FIXED32:
+            case FieldDescriptor::TYPE_SFIXED32:
+            case FieldDescriptor::TYPE_FLOAT:
+                return WIRETYPE_FIXED32;
+            case FieldDescriptor::TYPE_STRING:
+            case FieldDescriptor::TYPE_BYTES:
+            case FieldDescriptor::TYPE_MESSAGE:
+                return WIRETYPE_LENGTH_DELIMITED;
+            default:
+                return WIRETYPE_VARINT;
+        }
+    }
+
+    void printWireApiImpl(FILE *file, const char *t) {
+        fprintf(file, "int %s_transcode(const char *buf, size_t bufLen, std::string &out, std::string *error) {\n", t);
+        fprintf(file, "    const size_t size = out.size();\n");
+        fprintf(file, "    %s_parser_lexer lex;\n", t);
+        fprintf(file, "    lex.begin = buf;\n");
+        fprintf(file, "    lex.p = buf;\n");
+        fprintf(file, "    lex.end = buf + bufLen;\n");
+        fprintf(file, "    lex.error = nullptr;\n");
+        fprintf(file, "    lex.code = 0;\n");
+        fprintf(file, "    lex.state = 0;\n");
+        fprintf(file, "    lex.checkInitialized = false;\n");
+        fprintf(file, "    lex.allowComments = false;\n");
+        fprintf(file, "    lex.done = false;\n");
+        fprintf(file, "    lex.depth = 0;\n");
+        fprintf(file, "    if (%s_parser_lex_check_utf8(lex) && %s_parser_lex_expect(lex, '{') && %s_read_1(lex, out)) {\n", t, t, t);
+        fprintf(file, "        %s_parser_lex_skip_ws(lex);\n", t);
+        fprintf(file, "        if (lex.p == lex.end) {\n");
+        fprintf(file, "            return 0;\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "        %s_parser_lex_fail(lex, \"trailing garbage\");\n", t);
+        fprintf(file, "    }\n");
+        fprintf(file, "    out.resize(size);\n");
+        fprintf(file, "    if (error) {\n");
+        fprintf(file, "        *error = std::string(\"parse error: \") + lex.error + \" at offset \" + std::to_string(lex.p - lex.begin);\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    return 1;\n");
+        fprintf(file, "}\n\n");
+    }
+};
+
+} // namespace protog
@@ -1,12 +1,1290 @@
 #pragma once
 
-namespace protog {
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <functional>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "parser.h"
 
-struct Graph;
+namespace protog {
 
 struct Writer {
     virtual ~Writer() {}
+
+    // skip keys which are not part of the schema together with their values instead of failing
+    bool skipUnknown = false;
+    // Prefixes of the generated functions: static in generated sources, inline in generated headers where every
+    // translation unit has to share one definition. inlineLinkage is for the small functions worth inlining.
+    const char *linkage = "static ";
+    const char *inlineLinkage = "static inline ";
     virtual void write(const Graph &graph, const char* proto_header) = 0;
+
+    // files generated by write as (name, content), saved by the caller only where they changed, see output.h
+    std::vector<std::pair<std::string, std::string>> outputs;
+
+    FILE *openOutput() {
+        return open_memstream(&outputBuffer, &outputLength);
+    }
+
+    void closeOutput(FILE *file, const std::string &name) {
+        fclose(file);
+        outputs.emplace_back(name, std::string(outputBuffer, outputLength));
+        free(outputBuffer);
+        outputBuffer = nullptr;
+    }
+
+    char *outputBuffer = nullptr;
+    size_t outputLength = 0;
+
+    // classes of parse errors, numbered from 1 in this order by every backend
+    static const std::vector<std::pair<const char *, const char *>> &getErrorCodes() {
+        static const std::vector<std::pair<const char *, const char *>> codes = {
+                {"syntax", "malformed json"},
+                {"type", "value of the wrong type"},
+                {"key", "key which is not part of the schema"},
+                {"range", "number out of range for its field"},
+                {"base64", "invalid base64 in a bytes field"},
+                {"required", "required field missing"},
+                {"depth", "maximum nesting depth exceeded"},
+                {"utf8", "invalid utf-8 in the input"},
+        };
+        return codes;
+    }
+
+    void printHeader(FILE *file, const Graph &graph, const char *t, const char *c, const char* h) {
+        fprintf(file, "#pragma once\n\n");
+        fprintf(file, "#include <stdint.h>\n\n");
+        fprintf(file, "#include <functional>\n");
+        fprintf(file, "#include <vector>\n\n");
+        fprintf(file, "#include \"%s\"\n\n", h);
+        printNamespaceBegin(file, graph);
+        fprintf(file, "typedef struct %s_parser_state_s *%s_parser_state_t;\n", t, t);
+        fprintf(file, "typedef std::function<void(%s &msg)> %s_stream_callback;\n", c, t);
+        fprintf(file, "\n");
+        fprintf(file, "%s %s_parser_easy(const std::string &json);\n", c, t);
+        fprintf(file, "%s %s_parser_easy(const char *buf, size_t bufLen);\n", c, t);
+        fprintf(file, "\n");
+        fprintf(file, "// Same as %s_parser_easy, but the message and all of its sub-messages and strings are allocated on the\n", t);
+        fprintf(file, "// given arena, so a whole request is released at once when the arena is reset.\n");
+        fprintf(file, "%s *%s_parser_easy_arena(::google::protobuf::Arena *arena, const std::string &json);\n", c, t);
+        fprintf(file, "%s *%s_parser_easy_arena(::google::protobuf::Arena *arena, const char *buf, size_t bufLen);\n", c, t);
+        fprintf(file, "\n");
+        fprintf(file, "%s_parser_state_t %s_parser_init(%s &msg);\n", t, t, c);
+        fprintf(file, "// Same as %s_parser_init, but with explicit options. Without utf-8 validation strings are taken as they are,\n", t);
+        fprintf(file, "// which only suits trusted input. The defaults are those of the overload above.\n");
+        fprintf(file, "struct %s_parser_config {\n", t);
+        fprintf(file, "    bool validateUtf8 = true; // reject input which is not valid utf-8, checked a whole block at a time\n");
+        fprintf(file, "    bool allowComments = false; // accept // and /* */ comments wherever whitespace is allowed\n");
+        fprintf(file, "    bool allowTrailingGarbage = false; // ignore anything after the top-level object\n");
+        fprintf(file, "    bool checkInitialized = true; // fail when required fields are missing\n");
+        fprintf(file, "};\n");
+        fprintf(file, "%s_parser_state_t %s_parser_init(%s &msg, const %s_parser_config &config);\n", t, t, c, t);
+        fprintf(file, "void %s_parser_free(%s_parser_state_t state);\n", t, t);
+        fprintf(file, "int %s_parser_on_chunk(%s_parser_state_t state, char *chunk, size_t chunkLen);\n", t, t);
+        fprintf(file, "int %s_parser_complete(%s_parser_state_t state);\n", t, t);
+        fprintf(file, "int %s_parser_reset(%s_parser_state_t state);\n", t, t);
+        fprintf(file, "int %s_parser_rebind(%s_parser_state_t state, %s &msg);\n", t, t, c);
+        fprintf(file, "char *%s_parser_get_error(%s_parser_state_t state);\n", t, t);
+        fprintf(file,
+                "char *%s_parser_get_error(%s_parser_state_t state, int verbose, const char *chunk, size_t chunkLen);\n",
+                t, t);
+        fprintf(file, "void %s_parser_free_error(%s_parser_state_t state, char *err);\n", t, t);
+        fprintf(file, "\n");
+        fprintf(file, "// Errors never abort the process. A failing on_chunk or complete returns non-zero and records the class of the\n");
+        fprintf(file, "// error, the byte offset into the input counted over all chunks and the parser state it occurred in. Messages\n");
+        fprintf(file, "// are only put together by get_error.\n");
+        fprintf(file, "enum %s_parser_error_code {\n", t);
+        fprintf(file, "    %s_parser_error_none = 0,\n", t);
+        for (const auto &code : getErrorCodes()) {
+            fprintf(file, "    %s_parser_error_%s, // %s\n", t, code.first, code.second);
+        }
+        fprintf(file, "};\n");
+        fprintf(file, "\n");
+        fprintf(file, "struct %s_parser_error_s {\n", t);
+        fprintf(file, "    %s_parser_error_code code;\n", t);
+        fprintf(file, "    size_t offset;\n");
+        fprintf(file, "    size_t state;\n");
+        fprintf(file, "};\n");
+        fprintf(file, "\n");
+        fprintf(file, "%s_parser_error_s %s_parser_last_error(%s_parser_state_t state);\n", t, t, t);
+        fprintf(file, "const char *%s_parser_error_string(%s_parser_error_code code);\n", t, t);
+        fprintf(file, "\n");
+        fprintf(file, "// Same as %s_parser_easy, but returns non-zero and fills in error instead of throwing.\n", t);
+        fprintf(file, "int %s_parser_try_easy(%s &msg, const char *buf, size_t bufLen, %s_parser_error_s *error = nullptr);\n", t, c, t);
+        fprintf(file, "\n");
+        fprintf(file, "// A state can be reused after complete or error: reset clears the message and starts over, rebind starts\n");
+        fprintf(file, "// over with another message. acquire and release work like init and free, but keep released states in a\n");
+        fprintf(file, "// thread local pool, so steady parsing does not allocate parser bookkeeping. Whatever state was released,\n");
+        fprintf(file, "// acquire returns it with the defaults of %s_parser_init(msg): no stream callback and the default config.\n", t);
+        fprintf(file, "%s_parser_state_t %s_parser_acquire(%s &msg);\n", t, t, c);
+        fprintf(file, "void %s_parser_release(%s_parser_state_t state);\n", t, t);
+        fprintf(file, "\n");
+        fprintf(file, "// Streaming mode for newline delimited json or any other sequence of top-level objects. Chunks are fed with\n");
+        fprintf(file, "// %s_parser_on_chunk, callback is invoked with msg for every completed object and msg is cleared afterwards,\n", t);
+        fprintf(file, "// so all records share one message. %s_parser_complete fails if the input ends inside an object.\n", t);
+        fprintf(file, "%s_parser_state_t %s_stream_init(%s &msg, %s_stream_callback callback);\n", t, t, c, t);
+        fprintf(file, "\n");
+        if (graph.elementNode) {
+            const auto element = get_full_cpp_type_name(*graph.elementNode->field->message_type());
+            fprintf(file, "// Generated with -e %s: callback is invoked with every element of %s as soon as it is complete,\n",
+                    graph.elementPath.c_str(), graph.elementPath.c_str());
+            fprintf(file, "// and the element is removed from the message afterwards. Its memory is reused for the next element, so a\n");
+            fprintf(file, "// document wrapping a huge array parses in constant memory. Kept across reset and rebind, released states\n");
+            fprintf(file, "// drop it. Without a callback the elements are kept as usual.\n");
+            fprintf(file, "typedef std::function<void(%s &element)> %s_element_callback;\n", element.c_str(), t);
+            fprintf(file, "void %s_parser_set_element_callback(%s_parser_state_t state, %s_element_callback callback);\n", t, t, t);
+            fprintf(file, "\n");
+        }
+        fprintf(file, "// Parses a buffer with many messages on several threads, 0 starts one per core. buf holds either newline\n");
+        fprintf(file, "// delimited json with one object per line or a top-level json array of objects. The messages are appended\n");
+        fprintf(file, "// to out, or passed to callback on the calling thread once all of them are parsed, in input order.\n");
+        fprintf(file, "int %s_parser_parallel(const char *buf, size_t bufLen, ::google::protobuf::RepeatedPtrField<%s> &out,\n", t, c);
+        fprintf(file, "                      unsigned threads = 0, std::string *error = nullptr);\n");
+        fprintf(file, "int %s_parser_parallel(const char *buf, size_t bufLen, const %s_stream_callback &callback,\n", t, t);
+        fprintf(file, "                      unsigned threads = 0, std::string *error = nullptr);\n");
+        fprintf(file, "\n");
+        fprintf(file, "// Profiling counters, which only exist when the parser source is compiled with PROTOG_PROFILE defined. Otherwise\n");
+        fprintf(file, "// the dump is empty and parsing does not pay for them. States are named by their path, like in the comments of\n");
+        fprintf(file, "// the generated source, and count the callbacks or fields they handled and the cycles spent there. The yajl\n");
+        fprintf(file, "// backend adds an entry per callback. Counters survive reset and rebind, profile_reset clears them.\n");
+        fprintf(file, "struct %s_parser_profile_entry {\n", t);
+        fprintf(file, "    const char *name;\n");
+        fprintf(file, "    uint64_t hits;\n");
+        fprintf(file, "    uint64_t cycles;\n");
+        fprintf(file, "};\n");
+        fprintf(file, "std::vector<%s_parser_profile_entry> %s_parser_profile_dump(%s_parser_state_t state);\n", t, t, t);
+        fprintf(file, "void %s_parser_profile_reset(%s_parser_state_t state);\n", t, t);
+        fprintf(file, "\n");
+        fprintf(file, "// Parse files without reading them into memory first: they are mapped with sequential access hints.\n");
+        fprintf(file, "// %s_stream_file maps one window after the other, so memory usage stays flat for arbitrarily large files.\n", t);
+        fprintf(file, "// Both throw a std::runtime_error on failure.\n");
+        fprintf(file, "%s %s_parse_file(const char *path);\n", c, t);
+        fprintf(file, "void %s_stream_file(const char *path, %s_stream_callback callback);\n", t, t);
+        fprintf(file, "\n");
+        printNamespaceEnd(file, graph);
+    }
+
+    void printErrorStringImpl(FILE *file, const char *t) {
+        fprintf(file, "const char *%s_parser_error_string(%s_parser_error_code code) {\n", t, t);
+        fprintf(file, "    switch (code) {\n");
+        fprintf(file, "        case %s_parser_error_none:\n", t);
+        fprintf(file, "            return \"no error\";\n");
+        for (const auto &code : getErrorCodes()) {
+            fprintf(file, "        case %s_parser_error_%s:\n", t, code.first);
+            fprintf(file, "            return \"%s\";\n", code.second);
+        }
+        fprintf(file, "    }\n");
+        fprintf(file, "    return \"unknown error\";\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+    }
+
+    void printNamespaceBegin(FILE *file, const Graph &graph) {
+        const auto ns = split(graph.fileDesc->package(), '.');
+        for (auto it = ns.begin(); it != ns.end(); ++it) {
+            fprintf(file, "namespace %s {\n", it->c_str());
+        }
+        fprintf(file, "\n");
+    }
+
+    void printNamespaceEnd(FILE *file, const Graph &graph) {
+        const auto ns = split(graph.fileDesc->package(), '.');
+        for (auto it = ns.rbegin(); it != ns.rend(); ++it) {
+            fprintf(file, "} // namespace %s\n", it->c_str());
+        }
+    }
+
+    void printNumberImpl(FILE *file, const char *t) {
+        fprintf(file, "// Exact conversions of the raw text of a json number, as validated by the tokenizer, into the type of a field.\n");
+        fprintf(file, "// Integers are range checked for the field type. Doubles take Clinger's fast path whenever the decimal mantissa and\n");
+        fprintf(file, "// exponent are exactly representable and fall back to strtod otherwise, so both paths are correctly rounded.\n");
+        fprintf(file, "%sbool %s_parser_number_is_integer(const char *s, size_t len) {\n", inlineLinkage, t);
+        fprintf(file, "    return !memchr(s, '.', len) && !memchr(s, 'e', len) && !memchr(s, 'E', len);\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "// magnitude and sign of an integer, false for fractions, exponents and magnitudes beyond 64 bits\n");
+        fprintf(file, "%sbool %s_parser_number_magnitude(const char *s, size_t len, bool &negative, uint64_t &v) {\n", inlineLinkage, t);
+        fprintf(file, "    negative = len > 0 && *s == '-';\n");
+        fprintf(file, "    size_t i = negative ? 1 : 0;\n");
+        fprintf(file, "    if (i == len) {\n");
+        fprintf(file, "        return false;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    v = 0;\n");
+        fprintf(file, "    for (; i < len; ++i) {\n");
+        fprintf(file, "        const unsigned digit = static_cast<unsigned>(static_cast<unsigned char>(s[i]) - '0');\n");
+        fprintf(file, "        if (digit > 9 || v > (UINT64_MAX - digit) / 10) {\n");
+        fprintf(file, "            return false;\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "        v = v * 10 + digit;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    return true;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "%sbool %s_parser_number_int64(const char *s, size_t len, int64_t &v) {\n", inlineLinkage, t);
+        fprintf(file, "    bool negative;\n");
+        fprintf(file, "    uint64_t m;\n");
+        fprintf(file, "    if (!%s_parser_number_magnitude(s, len, negative, m) || m > static_cast<uint64_t>(INT64_MAX) + negative) {\n", t);
+        fprintf(file, "        return false;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    v = negative ? static_cast<int64_t>(0 - m) : static_cast<int64_t>(m);\n");
+        fprintf(file, "    return true;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "%sbool %s_parser_number_int32(const char *s, size_t len, int32_t &v) {\n", inlineLinkage, t);
+        fprintf(file, "    int64_t w;\n");
+        fprintf(file, "    if (!%s_parser_number_int64(s, len, w) || w < INT32_MIN || w > INT32_MAX) {\n", t);
+        fprintf(file, "        return false;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    v = static_cast<int32_t>(w);\n");
+        fprintf(file, "    return true;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "%sbool %s_parser_number_uint64(const char *s, size_t len, uint64_t &v) {\n", inlineLinkage, t);
+        fprintf(file, "    bool negative;\n");
+        fprintf(file, "    return %s_parser_number_magnitude(s, len, negative, v) && (!negative || v == 0);\n", t);
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "%sbool %s_parser_number_uint32(const char *s, size_t len, uint32_t &v) {\n", inlineLinkage, t);
+        fprintf(file, "    uint64_t w;\n");
+        fprintf(file, "    if (!%s_parser_number_uint64(s, len, w) || w > UINT32_MAX) {\n", t);
+        fprintf(file, "        return false;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    v = static_cast<uint32_t>(w);\n");
+        fprintf(file, "    return true;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "// false if the magnitude is too large for a double\n");
+        fprintf(file, "%sbool %s_parser_number_double(const char *s, size_t len, double &v) {\n", inlineLinkage, t);
+        fprintf(file, "    const char *p = s;\n");
+        fprintf(file, "    const char *end = s + len;\n");
+        fprintf(file, "    const bool negative = p != end && *p == '-';\n");
+        fprintf(file, "    p += negative ? 1 : 0;\n");
+        fprintf(file, "    uint64_t mantissa = 0;\n");
+        fprintf(file, "    int digits = 0; // significant digits in mantissa, at most 19 fit\n");
+        fprintf(file, "    int exp10 = 0;\n");
+        fprintf(file, "    bool truncated = false;\n");
+        fprintf(file, "    for (; p != end && *p >= '0' && *p <= '9'; ++p) {\n");
+        fprintf(file, "        if (digits < 19) {\n");
+        fprintf(file, "            mantissa = mantissa * 10 + static_cast<unsigned>(*p - '0');\n");
+        fprintf(file, "            digits += mantissa != 0 ? 1 : 0;\n");
+        fprintf(file, "        } else {\n");
+        fprintf(file, "            ++exp10;\n");
+        fprintf(file, "            truncated = truncated || *p != '0';\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    if (p != end && *p == '.') {\n");
+        fprintf(file, "        for (++p; p != end && *p >= '0' && *p <= '9'; ++p) {\n");
+        fprintf(file, "            if (digits < 19) {\n");
+        fprintf(file, "                mantissa = mantissa * 10 + static_cast<unsigned>(*p - '0');\n");
+        fprintf(file, "                digits += mantissa != 0 ? 1 : 0;\n");
+        fprintf(file, "                --exp10;\n");
+        fprintf(file, "            } else {\n");
+        fprintf(file, "                truncated = truncated || *p != '0';\n");
+        fprintf(file, "            }\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    if (p != end && (*p == 'e' || *p == 'E')) {\n");
+        fprintf(file, "        ++p;\n");
+        fprintf(file, "        const bool negativeExp = p != end && *p == '-';\n");
+        fprintf(file, "        p += p != end && (*p == '-' || *p == '+') ? 1 : 0;\n");
+        fprintf(file, "        int e = 0;\n");
+        fprintf(file, "        for (; p != end && *p >= '0' && *p <= '9'; ++p) {\n");
+        fprintf(file, "            e = e < 100000 ? e * 10 + (*p - '0') : e;\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "        exp10 += negativeExp ? -e : e;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    if (!truncated && mantissa <= (UINT64_C(1) << 53) && exp10 >= -22 && exp10 <= 22) {\n");
+        fprintf(file, "        static const double pow10[] = {\n");
+        fprintf(file, "            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,\n");
+        fprintf(file, "            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,\n");
+        fprintf(file, "        };\n");
+        fprintf(file, "        const double d = static_cast<double>(mantissa);\n");
+        fprintf(file, "        v = exp10 < 0 ? d / pow10[-exp10] : d * pow10[exp10];\n");
+        fprintf(file, "        v = negative ? -v : v;\n");
+        fprintf(file, "        return true;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    char tmp[64];\n");
+        fprintf(file, "    std::string big;\n");
+        fprintf(file, "    char *z = tmp;\n");
+        fprintf(file, "    if (len >= sizeof(tmp)) {\n");
+        fprintf(file, "        big.assign(s, len);\n");
+        fprintf(file, "        z = &big[0];\n");
+        fprintf(file, "    } else {\n");
+        fprintf(file, "        memcpy(tmp, s, len);\n");
+        fprintf(file, "        tmp[len] = '\\0';\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    errno = 0;\n");
+        fprintf(file, "    v = strtod(z, nullptr);\n");
+        fprintf(file, "    return !(errno == ERANGE && (v == HUGE_VAL || v == -HUGE_VAL));\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+    }
+
+    static bool hasBytesFields(const Graph &graph) {
+        for (const auto &node : graph.string_nodes) {
+            if (node->field->type() == FieldDescriptor::TYPE_BYTES) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // the yajl callbacks in the order of their profiling counters
+    static const std::vector<const char *> &getProfileCallbacks() {
+        static const std::vector<const char *> callbacks = {
+                "null", "boolean", "number", "string", "start_map", "map_key", "end_map", "start_array", "end_array",
+        };
+        return callbacks;
+    }
+
+    static size_t getProfileCallback(const char *name) {
+        const auto &callbacks = getProfileCallbacks();
+        for (size_t i = 0; i < callbacks.size(); ++i) {
+            if (strcmp(callbacks[i], name) == 0) {
+                return i;
+            }
+        }
+        throw std::runtime_error(std::string("unknown callback ") + name);
+    }
+
+    // Counters of PROTOG_PROFILE builds live in the parser state. They are indexed by parser state, with one more slot
+    // for the values of unknown keys.
+    void printProfileDefinition(FILE *file, const Graph &graph, const char *t) {
+        fprintf(file, "#if defined(PROTOG_PROFILE)\n");
+        fprintf(file, "static const size_t %s_parser_profile_states = %d;\n", t, graph.stateCounter + 2);
+        fprintf(file, "static const size_t %s_parser_profile_callbacks = %d;\n", t, static_cast<int>(getProfileCallbacks().size()));
+        fprintf(file, "\n");
+        fprintf(file, "struct %s_parser_profile_s {\n", t);
+        fprintf(file, "    uint64_t hits[%s_parser_profile_states] = {};\n", t);
+        fprintf(file, "    uint64_t cycles[%s_parser_profile_states] = {};\n", t);
+        fprintf(file, "    uint64_t calls[%s_parser_profile_callbacks] = {};\n", t);
+        fprintf(file, "    uint64_t callbackCycles[%s_parser_profile_callbacks] = {};\n", t);
+        fprintf(file, "};\n");
+        fprintf(file, "#endif\n");
+        fprintf(file, "\n");
+    }
+
+    void printProfileImpl(FILE *file, const Graph &graph, const char *t) {
+        std::vector<std::string> names(graph.stateCounter + 2);
+        names.back() = "<skipped>";
+        for (const auto &node : graph.all_nodes) {
+            names[node->state] = node->full_name;
+        }
+        fprintf(file, "#if defined(PROTOG_PROFILE)\n");
+        fprintf(file, "static const char *const %s_parser_profile_names[%s_parser_profile_states] = {\n", t, t);
+        for (const auto &name : names) {
+            fprintf(file, "    \"%s\",\n", name.c_str());
+        }
+        fprintf(file, "};\n");
+        fprintf(file, "\n");
+        fprintf(file, "static const char *const %s_parser_profile_callback_names[%s_parser_profile_callbacks] = {\n", t, t);
+        for (const auto &callback : getProfileCallbacks()) {
+            fprintf(file, "    \"yajl_%s\",\n", callback);
+        }
+        fprintf(file, "};\n");
+        fprintf(file, "#endif\n");
+        fprintf(file, "\n");
+        fprintf(file, "#if defined(PROTOG_PROFILE)\n");
+        fprintf(file, "%suint64_t %s_parser_profile_clock() {\n", inlineLinkage, t);
+        fprintf(file, "#if defined(__x86_64__) || defined(__i386__)\n");
+        fprintf(file, "    return __rdtsc();\n");
+        fprintf(file, "#else\n");
+        fprintf(file, "    return std::chrono::steady_clock::now().time_since_epoch().count();\n");
+        fprintf(file, "#endif\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "// counts a hit of location and books the cycles until the end of the scope on it, and on callback unless that is -1\n");
+        fprintf(file, "struct %s_parser_profile_scope {\n", t);
+        fprintf(file, "    %s_parser_profile_s &profile;\n", t);
+        fprintf(file, "    const size_t location;\n");
+        fprintf(file, "    const size_t callback;\n");
+        fprintf(file, "    const uint64_t start;\n");
+        fprintf(file, "\n");
+        fprintf(file, "    %s_parser_profile_scope(%s_parser_profile_s &profile, size_t location, size_t callback = static_cast<size_t>(-1))\n", t, t);
+        fprintf(file, "        : profile(profile), location(std::min(location, %s_parser_profile_states - 1)), callback(callback),\n", t);
+        fprintf(file, "          start(%s_parser_profile_clock()) {\n", t);
+        fprintf(file, "        ++profile.hits[this->location];\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "\n");
+        fprintf(file, "    ~%s_parser_profile_scope() {\n", t);
+        fprintf(file, "        const uint64_t cycles = %s_parser_profile_clock() - start;\n", t);
+        fprintf(file, "        profile.cycles[location] += cycles;\n");
+        fprintf(file, "        if (callback != static_cast<size_t>(-1)) {\n");
+        fprintf(file, "            ++profile.calls[callback];\n");
+        fprintf(file, "            profile.callbackCycles[callback] += cycles;\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "};\n");
+        fprintf(file, "\n");
+        fprintf(file, "#define PROTOG_PROFILE_HIT(profile, location) ++(profile).hits[location]\n");
+        fprintf(file, "#else\n");
+        fprintf(file, "#define PROTOG_PROFILE_HIT(profile, location)\n");
+        fprintf(file, "#endif\n");
+        fprintf(file, "\n");
+    }
+
+    // Repeated fields reserve the element count their array had in earlier parses, instead of growing one add at a
+    // time. The counts are kept per array state and thread, like the state pool, so the easy functions learn them too.
+    // A larger count is taken at once, a smaller one only decays the hint by a quarter of the difference.
+    void printHintsImpl(FILE *file, const Graph &graph, const char *t) {
+        if (graph.array_nodes.empty()) {
+            return;
+        }
+        fprintf(file, "static const uint32_t %s_parser_hint_max = 4096; // elements, bounds what a single outlier reserves\n", t);
+        fprintf(file, "\n");
+        fprintf(file, "struct %s_parser_hints_s {\n", t);
+        fprintf(file, "    uint32_t counts[%zu] = {};\n", graph.array_nodes.size());
+        fprintf(file, "};\n");
+        fprintf(file, "\n");
+        fprintf(file, "%s%s_parser_hints_s &%s_parser_hints() {\n", inlineLinkage, t, t);
+        fprintf(file, "    static thread_local %s_parser_hints_s hints;\n", t);
+        fprintf(file, "    return hints;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "%suint32_t %s_parser_hint(uint32_t hint, int count) {\n", inlineLinkage, t);
+        fprintf(file, "    uint32_t n = static_cast<uint32_t>(count);\n");
+        fprintf(file, "    if (n > %s_parser_hint_max) {\n", t);
+        fprintf(file, "        n = %s_parser_hint_max;\n", t);
+        fprintf(file, "    }\n");
+        fprintf(file, "    return n >= hint ? n : hint - (hint - n + 3) / 4;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+    }
+
+    // msg is the message holding the repeated field of the array node
+    void printReserveHint(FILE *file, const Graph &graph, const Node &node, const char *t, const std::string &msg,
+                          const std::string &indent) {
+        const char *i = indent.c_str();
+        fprintf(file, "%sif (const uint32_t hint = %s) {\n", i, getArrayHint(graph, node, t).c_str());
+        fprintf(file, "%s    auto *field = %s->mutable_%s();\n", i, msg.c_str(), node.name.c_str());
+        fprintf(file, "%s    field->Reserve(field->size() + static_cast<int>(hint));\n", i);
+        fprintf(file, "%s}\n", i);
+    }
+
+    void printUpdateHint(FILE *file, const Graph &graph, const Node &node, const char *t, const std::string &msg,
+                         const std::string &indent) {
+        const auto hint = getArrayHint(graph, node, t);
+        fprintf(file, "%s%s = %s_parser_hint(%s, %s->%s_size());\n", indent.c_str(), hint.c_str(), t, hint.c_str(),
+                msg.c_str(), node.name.c_str());
+    }
+
+    static std::string getArrayHint(const Graph &graph, const Node &node, const char *t) {
+        const auto it = std::find(graph.array_nodes.begin(), graph.array_nodes.end(), &node);
+        assert(it != graph.array_nodes.end());
+        return std::string(t) + "_parser_hints().counts[" + std::to_string(it - graph.array_nodes.begin()) + "]";
+    }
+
+    void printProfileApiImpl(FILE *file, const char *t) {
+        fprintf(file, "std::vector<%s_parser_profile_entry> %s_parser_profile_dump(%s_parser_state_t state) {\n", t, t, t);
+        fprintf(file, "    assert(state);\n");
+        fprintf(file, "    std::vector<%s_parser_profile_entry> entries;\n", t);
+        fprintf(file, "#if defined(PROTOG_PROFILE)\n");
+        fprintf(file, "    const %s_parser_profile_s &profile = state->profile;\n", t);
+        fprintf(file, "    for (size_t i = 0; i < %s_parser_profile_states; ++i) {\n", t);
+        fprintf(file, "        if (profile.hits[i] != 0) {\n");
+        fprintf(file, "            entries.push_back({%s_parser_profile_names[i], profile.hits[i], profile.cycles[i]});\n", t);
+        fprintf(file, "        }\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    for (size_t i = 0; i < %s_parser_profile_callbacks; ++i) {\n", t);
+        fprintf(file, "        if (profile.calls[i] != 0) {\n");
+        fprintf(file, "            entries.push_back({%s_parser_profile_callback_names[i], profile.calls[i], profile.callbackCycles[i]});\n", t);
+        fprintf(file, "        }\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "#endif\n");
+        fprintf(file, "    return entries;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "void %s_parser_profile_reset(%s_parser_state_t state) {\n", t, t);
+        fprintf(file, "    assert(state);\n");
+        fprintf(file, "#if defined(PROTOG_PROFILE)\n");
+        fprintf(file, "    state->profile = %s_parser_profile_s();\n", t);
+        fprintf(file, "#endif\n");
+        fprintf(file, "}\n");
+    }
+
+    void printUtf8Impl(FILE *file, const char *t) {
+        fprintf(file, "// Returns the length of the longest valid utf-8 prefix of s, which is len when all of s is valid. Overlong\n");
+        fprintf(file, "// encodings, surrogates and code points above U+10FFFF are rejected.\n");
+        fprintf(file, "%ssize_t %s_parser_utf8_scalar(const unsigned char *s, size_t len) {\n", linkage, t);
+        fprintf(file, "    size_t i = 0;\n");
+        fprintf(file, "    while (i < len) {\n");
+        fprintf(file, "        const unsigned char c = s[i];\n");
+        fprintf(file, "        if (c < 0x80) {\n");
+        fprintf(file, "            ++i;\n");
+        fprintf(file, "            continue;\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "        size_t n;\n");
+        fprintf(file, "        unsigned char lo = 0x80, hi = 0xBF; // range of the second byte\n");
+        fprintf(file, "        if (c >= 0xC2 && c <= 0xDF) {\n");
+        fprintf(file, "            n = 2;\n");
+        fprintf(file, "        } else if (c >= 0xE0 && c <= 0xEF) {\n");
+        fprintf(file, "            n = 3;\n");
+        fprintf(file, "            lo = c == 0xE0 ? 0xA0 : 0x80;\n");
+        fprintf(file, "            hi = c == 0xED ? 0x9F : 0xBF;\n");
+        fprintf(file, "        } else if (c >= 0xF0 && c <= 0xF4) {\n");
+        fprintf(file, "            n = 4;\n");
+        fprintf(file, "            lo = c == 0xF0 ? 0x90 : 0x80;\n");
+        fprintf(file, "            hi = c == 0xF4 ? 0x8F : 0xBF;\n");
+        fprintf(file, "        } else {\n");
+        fprintf(file, "            return i;\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "        if (len - i < n || s[i + 1] < lo || s[i + 1] > hi) {\n");
+        fprintf(file, "            return i;\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "        for (size_t k = 2; k < n; ++k) {\n");
+        fprintf(file, "            if ((s[i + k] & 0xC0) != 0x80) {\n");
+        fprintf(file, "                return i;\n");
+        fprintf(file, "            }\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "        i += n;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    return len;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "#if defined(__SSSE3__)\n");
+        fprintf(file, "// Vectorized validation after Keiser and Lemire, \"Validating UTF-8 In Less Than One Instruction Per Byte\". Three\n");
+        fprintf(file, "// table lookups on the nibbles of every byte and of its predecessor flag the invalid two byte windows, the bytes which\n");
+        fprintf(file, "// must continue a three or four byte sequence are checked separately. Error bits only accumulate, they are tested\n");
+        fprintf(file, "// once at the end.\n");
+        fprintf(file, "%s__m128i %s_parser_utf8_block(__m128i input, __m128i previous) {\n", inlineLinkage, t);
+        fprintf(file, "    const __m128i nibble = _mm_set1_epi8(0x0F);\n");
+        fprintf(file, "    const __m128i prev1 = _mm_alignr_epi8(input, previous, 15);\n");
+        fprintf(file, "    const __m128i prev2 = _mm_alignr_epi8(input, previous, 14);\n");
+        fprintf(file, "    const __m128i prev3 = _mm_alignr_epi8(input, previous, 13);\n");
+        fprintf(file, "    const __m128i byte1High = _mm_shuffle_epi8(_mm_setr_epi8(2, 2, 2, 2, 2, 2, 2, 2, -128, -128, -128, -128, 33, 1, 21, 73),\n");
+        fprintf(file, "                                               _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble));\n");
+        fprintf(file, "    const __m128i byte1Low = _mm_shuffle_epi8(_mm_setr_epi8(-25, -93, -125, -125, -117, -53, -53, -53, -53, -53, -53, -53, -53, -37, -53, -53),\n");
+        fprintf(file, "                                              _mm_and_si128(prev1, nibble));\n");
+        fprintf(file, "    const __m128i byte2High = _mm_shuffle_epi8(_mm_setr_epi8(1, 1, 1, 1, 1, 1, 1, 1, -26, -82, -70, -70, 1, 1, 1, 1),\n");
+        fprintf(file, "                                               _mm_and_si128(_mm_srli_epi16(input, 4), nibble));\n");
+        fprintf(file, "    const __m128i special = _mm_and_si128(_mm_and_si128(byte1High, byte1Low), byte2High);\n");
+        fprintf(file, "    const __m128i third = _mm_subs_epu8(prev2, _mm_set1_epi8(0xE0 - 0x80));\n");
+        fprintf(file, "    const __m128i fourth = _mm_subs_epu8(prev3, _mm_set1_epi8(0xF0 - 0x80));\n");
+        fprintf(file, "    const __m128i must23 = _mm_and_si128(_mm_or_si128(third, fourth), _mm_set1_epi8(-128));\n");
+        fprintf(file, "    return _mm_xor_si128(must23, special);\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "// lead bytes in the last three positions whose sequence continues in the next block\n");
+        fprintf(file, "%s__m128i %s_parser_utf8_incomplete(__m128i input) {\n", inlineLinkage, t);
+        fprintf(file, "    return _mm_subs_epu8(input, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1));\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "%svoid %s_parser_utf8_load(const unsigned char *p, __m128i &v) {\n", inlineLinkage, t);
+        fprintf(file, "    v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "%sbool %s_parser_utf8_is_ascii(__m128i v) {\n", inlineLinkage, t);
+        fprintf(file, "    return _mm_movemask_epi8(v) == 0;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "%s__m128i %s_parser_utf8_or(__m128i a, __m128i b) {\n", inlineLinkage, t);
+        fprintf(file, "    return _mm_or_si128(a, b);\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "%sbool %s_parser_utf8_is_zero(__m128i v) {\n", inlineLinkage, t);
+        fprintf(file, "    return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) == 0xFFFF;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "#endif\n");
+        fprintf(file, "\n");
+        fprintf(file, "#if defined(__AVX2__)\n");
+        fprintf(file, "%s__m256i %s_parser_utf8_block(__m256i input, __m256i previous) {\n", inlineLinkage, t);
+        fprintf(file, "    const __m256i nibble = _mm256_set1_epi8(0x0F);\n");
+        fprintf(file, "    const __m256i shifted = _mm256_permute2x128_si256(previous, input, 0x21);\n");
+        fprintf(file, "    const __m256i prev1 = _mm256_alignr_epi8(input, shifted, 15);\n");
+        fprintf(file, "    const __m256i prev2 = _mm256_alignr_epi8(input, shifted, 14);\n");
+        fprintf(file, "    const __m256i prev3 = _mm256_alignr_epi8(input, shifted, 13);\n");
+        fprintf(file, "    const __m256i byte1High = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_setr_epi8(2, 2, 2, 2, 2, 2, 2, 2, -128, -128, -128, -128, 33, 1, 21, 73)),\n");
+        fprintf(file, "                                                  _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble));\n");
+        fprintf(file, "    const __m256i byte1Low = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_setr_epi8(-25, -93, -125, -125, -117, -53, -53, -53, -53, -53, -53, -53, -53, -37, -53, -53)),\n");
+        fprintf(file, "                                                 _mm256_and_si256(prev1, nibble));\n");
+        fprintf(file, "    const __m256i byte2High = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_setr_epi8(1, 1, 1, 1, 1, 1, 1, 1, -26, -82, -70, -70, 1, 1, 1, 1)),\n");
+        fprintf(file, "                                                  _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble));\n");
+        fprintf(file, "    const __m256i special = _mm256_and_si256(_mm256_and_si256(byte1High, byte1Low), byte2High);\n");
+        fprintf(file, "    const __m256i third = _mm256_subs_epu8(prev2, _mm256_set1_epi8(0xE0 - 0x80));\n");
+        fprintf(file, "    const __m256i fourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8(0xF0 - 0x80));\n");
+        fprintf(file, "    const __m256i must23 = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8(-128));\n");
+        fprintf(file, "    return _mm256_xor_si256(must23, special);\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "%s__m256i %s_parser_utf8_incomplete(__m256i input) {\n", inlineLinkage, t);
+        fprintf(file, "    return _mm256_subs_epu8(input, _mm256_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1));\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "%svoid %s_parser_utf8_load(const unsigned char *p, __m256i &v) {\n", inlineLinkage, t);
+        fprintf(file, "    v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "%sbool %s_parser_utf8_is_ascii(__m256i v) {\n", inlineLinkage, t);
+        fprintf(file, "    return _mm256_movemask_epi8(v) == 0;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "%s__m256i %s_parser_utf8_or(__m256i a, __m256i b) {\n", inlineLinkage, t);
+        fprintf(file, "    return _mm256_or_si256(a, b);\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "%sbool %s_parser_utf8_is_zero(__m256i v) {\n", inlineLinkage, t);
+        fprintf(file, "    return _mm256_testz_si256(v, v) != 0;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "#endif\n");
+        fprintf(file, "\n");
+        fprintf(file, "// Returns the offset of the first invalid utf-8 sequence in buf, or len when all of it is valid. Blocks of 32 or 16\n");
+        fprintf(file, "// bytes are validated at once with AVX2 or SSSE3 when the compiler targets them, and blocks of plain ascii only cost\n");
+        fprintf(file, "// a movemask. Invalid input is looked at again byte by byte to find the offset.\n");
+        fprintf(file, "%ssize_t %s_parser_utf8_check(const char *buf, size_t len) {\n", linkage, t);
+        fprintf(file, "    const unsigned char *s = reinterpret_cast<const unsigned char *>(buf);\n");
+        fprintf(file, "#if defined(__SSSE3__)\n");
+        fprintf(file, "#if defined(__AVX2__)\n");
+        fprintf(file, "    typedef __m256i block_t;\n");
+        fprintf(file, "#else\n");
+        fprintf(file, "    typedef __m128i block_t;\n");
+        fprintf(file, "#endif\n");
+        fprintf(file, "    const size_t width = sizeof(block_t);\n");
+        fprintf(file, "    const block_t zero = block_t();\n");
+        fprintf(file, "    block_t error = zero;\n");
+        fprintf(file, "    block_t previous = zero;\n");
+        fprintf(file, "    block_t incomplete = zero;\n");
+        fprintf(file, "    block_t input;\n");
+        fprintf(file, "    size_t i = 0;\n");
+        fprintf(file, "    for (; i + width <= len; i += width) {\n");
+        fprintf(file, "        %s_parser_utf8_load(s + i, input);\n", t);
+        fprintf(file, "        if (%s_parser_utf8_is_ascii(input)) {\n", t);
+        fprintf(file, "            error = %s_parser_utf8_or(error, incomplete);\n", t);
+        fprintf(file, "            incomplete = zero;\n");
+        fprintf(file, "        } else {\n");
+        fprintf(file, "            error = %s_parser_utf8_or(error, %s_parser_utf8_block(input, previous));\n", t, t);
+        fprintf(file, "            incomplete = %s_parser_utf8_incomplete(input);\n", t);
+        fprintf(file, "        }\n");
+        fprintf(file, "        previous = input;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    if (i < len) { // zero padding is ascii, so a sequence which is cut off by the end of the input is an error\n");
+        fprintf(file, "        unsigned char tail[width] = {};\n");
+        fprintf(file, "        memcpy(tail, s + i, len - i);\n");
+        fprintf(file, "        %s_parser_utf8_load(tail, input);\n", t);
+        fprintf(file, "        error = %s_parser_utf8_or(error, %s_parser_utf8_block(input, previous));\n", t, t);
+        fprintf(file, "    } else {\n");
+        fprintf(file, "        error = %s_parser_utf8_or(error, incomplete);\n", t);
+        fprintf(file, "    }\n");
+        fprintf(file, "    if (%s_parser_utf8_is_zero(error)) {\n", t);
+        fprintf(file, "        return len;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "#endif\n");
+        fprintf(file, "    return %s_parser_utf8_scalar(s, len);\n", t);
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+    }
+
+    // Emits the base64 decoder of bytes fields. The generated sources include immintrin.h when SSSE3 is enabled.
+    void printBase64Impl(FILE *file, const char *t) {
+        static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        int table[256];
+        std::fill(table, table + 256, -1);
+        for (int i = 0; i < 64; ++i) {
+            table[static_cast<unsigned char>(alphabet[i])] = i;
+        }
+        table['-'] = 62;
+        table['_'] = 63;
+        fprintf(file, "#if defined(__SSSE3__)\n");
+        fprintf(file, "// maps 16 base64 characters of either alphabet to their 6 bit values, fails on any other byte including padding\n");
+        fprintf(file, "%sbool %s_parser_base64_sextets(__m128i &v) {\n", inlineLinkage, t);
+        fprintf(file, "    const __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));\n");
+        fprintf(file, "    const __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('z' + 1)));\n");
+        fprintf(file, "    const __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));\n");
+        fprintf(file, "    const __m128i plus = _mm_cmpeq_epi8(v, _mm_set1_epi8('+'));\n");
+        fprintf(file, "    const __m128i minus = _mm_cmpeq_epi8(v, _mm_set1_epi8('-'));\n");
+        fprintf(file, "    const __m128i slash = _mm_cmpeq_epi8(v, _mm_set1_epi8('/'));\n");
+        fprintf(file, "    const __m128i underscore = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));\n");
+        fprintf(file, "    const __m128i valid = _mm_or_si128(_mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(digit, plus)),\n");
+        fprintf(file, "                                       _mm_or_si128(_mm_or_si128(minus, slash), underscore));\n");
+        fprintf(file, "    if (_mm_movemask_epi8(valid) != 0xFFFF) {\n");
+        fprintf(file, "        return false;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    __m128i shift = _mm_and_si128(upper, _mm_set1_epi8(-'A'));\n");
+        fprintf(file, "    shift = _mm_or_si128(shift, _mm_and_si128(lower, _mm_set1_epi8(26 - 'a')));\n");
+        fprintf(file, "    shift = _mm_or_si128(shift, _mm_and_si128(digit, _mm_set1_epi8(52 - '0')));\n");
+        fprintf(file, "    shift = _mm_or_si128(shift, _mm_and_si128(plus, _mm_set1_epi8(62 - '+')));\n");
+        fprintf(file, "    shift = _mm_or_si128(shift, _mm_and_si128(minus, _mm_set1_epi8(62 - '-')));\n");
+        fprintf(file, "    shift = _mm_or_si128(shift, _mm_and_si128(slash, _mm_set1_epi8(63 - '/')));\n");
+        fprintf(file, "    shift = _mm_or_si128(shift, _mm_and_si128(underscore, _mm_set1_epi8(63 - '_')));\n");
+        fprintf(file, "    v = _mm_add_epi8(v, shift);\n");
+        fprintf(file, "    return true;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "#endif\n");
+        fprintf(file, "\n");
+        fprintf(file, "#if defined(__AVX2__)\n");
+        fprintf(file, "%sbool %s_parser_base64_sextets(__m256i &v) {\n", inlineLinkage, t);
+        fprintf(file, "    const __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), v));\n");
+        fprintf(file, "    const __m256i lower = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('a' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), v));\n");
+        fprintf(file, "    const __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));\n");
+        fprintf(file, "    const __m256i plus = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('+'));\n");
+        fprintf(file, "    const __m256i minus = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('-'));\n");
+        fprintf(file, "    const __m256i slash = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('/'));\n");
+        fprintf(file, "    const __m256i underscore = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));\n");
+        fprintf(file, "    const __m256i valid = _mm256_or_si256(_mm256_or_si256(_mm256_or_si256(upper, lower), _mm256_or_si256(digit, plus)),\n");
+        fprintf(file, "                                          _mm256_or_si256(_mm256_or_si256(minus, slash), underscore));\n");
+        fprintf(file, "    if (_mm256_movemask_epi8(valid) != -1) {\n");
+        fprintf(file, "        return false;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    __m256i shift = _mm256_and_si256(upper, _mm256_set1_epi8(-'A'));\n");
+        fprintf(file, "    shift = _mm256_or_si256(shift, _mm256_and_si256(lower, _mm256_set1_epi8(26 - 'a')));\n");
+        fprintf(file, "    shift = _mm256_or_si256(shift, _mm256_and_si256(digit, _mm256_set1_epi8(52 - '0')));\n");
+        fprintf(file, "    shift = _mm256_or_si256(shift, _mm256_and_si256(plus, _mm256_set1_epi8(62 - '+')));\n");
+        fprintf(file, "    shift = _mm256_or_si256(shift, _mm256_and_si256(minus, _mm256_set1_epi8(62 - '-')));\n");
+        fprintf(file, "    shift = _mm256_or_si256(shift, _mm256_and_si256(slash, _mm256_set1_epi8(63 - '/')));\n");
+        fprintf(file, "    shift = _mm256_or_si256(shift, _mm256_and_si256(underscore, _mm256_set1_epi8(63 - '_')));\n");
+        fprintf(file, "    v = _mm256_add_epi8(v, shift);\n");
+        fprintf(file, "    return true;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "#endif\n");
+        fprintf(file, "\n");
+        fprintf(file, "// number of bytes encoded by base64 text, with or without padding\n");
+        fprintf(file, "%ssize_t %s_parser_base64_size(const char *s, size_t len) {\n", inlineLinkage, t);
+        fprintf(file, "    while (len > 0 && s[len - 1] == '=') {\n");
+        fprintf(file, "        --len;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    return len / 4 * 3 + (len %% 4 < 2 ? 0 : len %% 4 - 1);\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "// Appends the bytes of standard or url safe base64 text, with or without padding. Blocks of 32 or 16 characters are\n");
+        fprintf(file, "// translated and packed with AVX2 or SSSE3 when the compiler targets them. The remainder, and any block holding a\n");
+        fprintf(file, "// character the vector path rejects, goes through the table.\n");
+        fprintf(file, "%sbool %s_parser_base64_decode(const char *s, size_t len, std::string &out) {\n", linkage, t);
+        fprintf(file, "    size_t padding = 0;\n");
+        fprintf(file, "    while (len > 0 && s[len - 1] == '=' && padding < 2) {\n");
+        fprintf(file, "        --len;\n");
+        fprintf(file, "        ++padding;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    if (len %% 4 == 1 || (padding > 0 && (len + padding) %% 4 != 0)) {\n");
+        fprintf(file, "        return false;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    const size_t start = out.size();\n");
+        fprintf(file, "    const size_t size = %s_parser_base64_size(s, len);\n", t);
+        fprintf(file, "    out.resize(start + size + 4); // vector stores write up to 4 bytes past the last group\n");
+        fprintf(file, "    const unsigned char *p = reinterpret_cast<const unsigned char *>(s);\n");
+        fprintf(file, "    const unsigned char *end = p + len;\n");
+        fprintf(file, "    unsigned char *o = reinterpret_cast<unsigned char *>(&out[start]);\n");
+        fprintf(file, "#if defined(__AVX2__)\n");
+        fprintf(file, "    while (end - p >= 32) {\n");
+        fprintf(file, "        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));\n");
+        fprintf(file, "        if (!%s_parser_base64_sextets(v)) {\n", t);
+        fprintf(file, "            break;\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "        v = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));\n");
+        fprintf(file, "        v = _mm256_madd_epi16(v, _mm256_set1_epi32(0x00011000));\n");
+        fprintf(file, "        v = _mm256_shuffle_epi8(v, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,\n");
+        fprintf(file, "                                                    2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));\n");
+        fprintf(file, "        _mm_storeu_si128(reinterpret_cast<__m128i *>(o), _mm256_castsi256_si128(v));\n");
+        fprintf(file, "        _mm_storeu_si128(reinterpret_cast<__m128i *>(o + 12), _mm256_extracti128_si256(v, 1));\n");
+        fprintf(file, "        p += 32;\n");
+        fprintf(file, "        o += 24;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "#endif\n");
+        fprintf(file, "#if defined(__SSSE3__)\n");
+        fprintf(file, "    while (end - p >= 16) {\n");
+        fprintf(file, "        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));\n");
+        fprintf(file, "        if (!%s_parser_base64_sextets(v)) {\n", t);
+        fprintf(file, "            break;\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "        v = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));\n");
+        fprintf(file, "        v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));\n");
+        fprintf(file, "        v = _mm_shuffle_epi8(v, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));\n");
+        fprintf(file, "        _mm_storeu_si128(reinterpret_cast<__m128i *>(o), v);\n");
+        fprintf(file, "        p += 16;\n");
+        fprintf(file, "        o += 12;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "#endif\n");
+        fprintf(file, "    static const int8_t table[256] = {");
+        for (int i = 0; i < 256; ++i) {
+            fprintf(file, i % 16 == 0 ? "\n        %d," : " %d,", table[i]);
+        }
+        fprintf(file, "\n    };\n");
+        fprintf(file, "    for (; end - p >= 4; p += 4, o += 3) {\n");
+        fprintf(file, "        const int32_t a = table[p[0]], b = table[p[1]], c = table[p[2]], d = table[p[3]];\n");
+        fprintf(file, "        if ((a | b | c | d) < 0) {\n");
+        fprintf(file, "            out.resize(start);\n");
+        fprintf(file, "            return false;\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "        const uint32_t w = static_cast<uint32_t>(a << 18 | b << 12 | c << 6 | d);\n");
+        fprintf(file, "        o[0] = static_cast<unsigned char>(w >> 16);\n");
+        fprintf(file, "        o[1] = static_cast<unsigned char>(w >> 8);\n");
+        fprintf(file, "        o[2] = static_cast<unsigned char>(w);\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    if (end - p >= 2) {\n");
+        fprintf(file, "        const int32_t a = table[p[0]], b = table[p[1]], c = end - p == 3 ? table[p[2]] : 0;\n");
+        fprintf(file, "        if ((a | b | c) < 0) {\n");
+        fprintf(file, "            out.resize(start);\n");
+        fprintf(file, "            return false;\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "        const uint32_t w = static_cast<uint32_t>(a << 18 | b << 12 | c << 6);\n");
+        fprintf(file, "        o[0] = static_cast<unsigned char>(w >> 16);\n");
+        fprintf(file, "        if (end - p == 3) {\n");
+        fprintf(file, "            o[1] = static_cast<unsigned char>(w >> 8);\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    out.resize(start + size);\n");
+        fprintf(file, "    return true;\n");
+        fprintf(file, "}\n");
+
+        fprintf(file, "\n");
+    }
+
+    void printElementCallbackImpl(FILE *file, const Graph &graph, const char *t) {
+        if (!graph.elementNode) {
+            return;
+        }
+        fprintf(file, "void %s_parser_set_element_callback(%s_parser_state_t state, %s_element_callback callback) {\n", t, t, t);
+        fprintf(file, "    assert(state);\n");
+        fprintf(file, "    state->elementCallback = std::move(callback);\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+    }
+
+    void printPoolImpl(FILE *file, const Graph &graph, const char *t, const char *c) {
+        fprintf(file, "namespace {\n\n");
+        fprintf(file, "static const size_t %s_parser_pool_capacity = 16;\n", t);
+        fprintf(file, "\n");
+        fprintf(file, "struct %s_parser_pool_s {\n", t);
+        fprintf(file, "    std::vector<%s_parser_state_t> states;\n", t);
+        fprintf(file, "\n");
+        fprintf(file, "    ~%s_parser_pool_s() {\n", t);
+        fprintf(file, "        for (auto state : states) {\n");
+        fprintf(file, "            %s_parser_free(state);\n", t);
+        fprintf(file, "        }\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "};\n");
+        fprintf(file, "\n");
+        fprintf(file, "static thread_local %s_parser_pool_s %s_parser_pool;\n", t, t);
+        fprintf(file, "\n");
+        fprintf(file, "} // anonymous namespace\n\n");
+        fprintf(file, "%s_parser_state_t %s_parser_acquire(%s &msg) {\n", t, t, c);
+        fprintf(file, "    auto &states = %s_parser_pool.states;\n", t);
+        fprintf(file, "    if (states.empty()) {\n");
+        fprintf(file, "        return %s_parser_init(msg);\n", t);
+        fprintf(file, "    }\n");
+        fprintf(file, "    %s_parser_state_t state = states.back();\n", t);
+        fprintf(file, "    states.pop_back();\n");
+        fprintf(file, "    %s_parser_rebind(state, msg);\n", t);
+        fprintf(file, "    return state;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "void %s_parser_release(%s_parser_state_t state) {\n", t, t);
+        fprintf(file, "    auto &states = %s_parser_pool.states;\n", t);
+        fprintf(file, "    if (states.size() >= %s_parser_pool_capacity) {\n", t);
+        fprintf(file, "        %s_parser_free(state);\n", t);
+        fprintf(file, "        return;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    // states from stream_init or init with a config go back as if they came from init(msg)\n");
+        fprintf(file, "    state->config = %s_parser_config_s();\n", t);
+        fprintf(file, "    state->config.checkInitialized = true;\n");
+        fprintf(file, "    state->callback = nullptr;\n");
+        if (graph.elementNode) {
+            fprintf(file, "    state->elementCallback = nullptr;\n");
+        }
+        fprintf(file, "    states.push_back(state);\n");
+        fprintf(file, "}\n\n");
+    }
+
+    // Memory mapped file entry points on top of the easy and streaming api of the backend.
+    void printFileImpl(FILE *file, const char *t, const char *c) {
+        fprintf(file, "namespace {\n");
+        fprintf(file, "\n");
+        fprintf(file, "static const size_t %s_parser_file_window = 16 << 20; // multiple of the page size\n", t);
+        fprintf(file, "\n");
+        fprintf(file, "// Keeps a file descriptor open for the lifetime of the scope, so every exit path closes it.\n");
+        fprintf(file, "struct %s_parser_file_s {\n", t);
+        fprintf(file, "    int fd;\n");
+        fprintf(file, "    size_t size;\n");
+        fprintf(file, "\n");
+        fprintf(file, "    explicit %s_parser_file_s(const char *path) : fd(open(path, O_RDONLY)), size(0) {\n", t);
+        fprintf(file, "        struct stat st;\n");
+        fprintf(file, "        if (fd < 0 || fstat(fd, &st) != 0) {\n");
+        fprintf(file, "            throw std::runtime_error(std::string(\"cannot open \") + path + \": \" + strerror(errno));\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "        size = static_cast<size_t>(st.st_size);\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "\n");
+        fprintf(file, "    ~%s_parser_file_s() {\n", t);
+        fprintf(file, "        close(fd);\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "\n");
+        fprintf(file, "    const char *map(size_t offset, size_t len) const {\n");
+        fprintf(file, "        void *addr = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, static_cast<off_t>(offset));\n");
+        fprintf(file, "        if (addr == MAP_FAILED) {\n");
+        fprintf(file, "            throw std::runtime_error(std::string(\"cannot map file: \") + strerror(errno));\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "        madvise(addr, len, MADV_SEQUENTIAL);\n");
+        fprintf(file, "        return static_cast<const char *>(addr);\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "};\n");
+        fprintf(file, "\n");
+        fprintf(file, "} // anonymous namespace\n");
+        fprintf(file, "\n");
+        fprintf(file, "%s %s_parse_file(const char *path) {\n", c, t);
+        fprintf(file, "    %s_parser_file_s file(path);\n", t);
+        fprintf(file, "    %s msg;\n", c);
+        fprintf(file, "    if (file.size == 0) {\n");
+        fprintf(file, "        %s_parser_impl_easy(msg, \"\", 0);\n", t);
+        fprintf(file, "        return msg;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    const char *buf = file.map(0, file.size);\n");
+        fprintf(file, "    try {\n");
+        fprintf(file, "        %s_parser_impl_easy(msg, buf, file.size);\n", t);
+        fprintf(file, "    } catch (...) {\n");
+        fprintf(file, "        munmap(const_cast<char *>(buf), file.size);\n");
+        fprintf(file, "        throw;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    munmap(const_cast<char *>(buf), file.size);\n");
+        fprintf(file, "    return msg;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "void %s_stream_file(const char *path, %s_stream_callback callback) {\n", t, t);
+        fprintf(file, "    %s_parser_file_s file(path);\n", t);
+        fprintf(file, "    %s msg;\n", c);
+        fprintf(file, "    %s_parser_state_t state = %s_stream_init(msg, std::move(callback));\n", t, t);
+        fprintf(file, "    int rc = 0;\n");
+        fprintf(file, "    try {\n");
+        fprintf(file, "        for (size_t offset = 0; offset < file.size && rc == 0; offset += %s_parser_file_window) {\n", t);
+        fprintf(file, "            const size_t len = std::min(%s_parser_file_window, file.size - offset);\n", t);
+        fprintf(file, "            const char *window = file.map(offset, len);\n");
+        fprintf(file, "            rc = %s_parser_on_chunk(state, const_cast<char *>(window), len);\n", t);
+        fprintf(file, "            munmap(const_cast<char *>(window), len); // pages of parsed windows do not stay resident\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "        if (rc == 0) {\n");
+        fprintf(file, "            rc = %s_parser_complete(state);\n", t);
+        fprintf(file, "        }\n");
+        fprintf(file, "    } catch (...) {\n");
+        fprintf(file, "        %s_parser_free(state);\n", t);
+        fprintf(file, "        throw;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    if (rc != 0) {\n");
+        fprintf(file, "        char *err = %s_parser_get_error(state);\n", t);
+        fprintf(file, "        std::runtime_error ex(err);\n");
+        fprintf(file, "        %s_parser_free_error(state, err);\n", t);
+        fprintf(file, "        %s_parser_free(state);\n", t);
+        fprintf(file, "        throw ex;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    %s_parser_free(state);\n", t);
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+    }
+
+    // Splits the input into segments at newlines or between array elements and parses them with the streaming api of
+    // the backend, so it works the same for all of them.
+    void printParallelImpl(FILE *file, const char *t, const char *c) {
+        fprintf(file, "namespace {\n");
+        fprintf(file, "\n");
+        fprintf(file, "static const size_t %s_parser_parallel_segments_per_thread = 8;\n", t);
+        fprintf(file, "\n");
+        fprintf(file, "struct %s_parser_parallel_span_s {\n", t);
+        fprintf(file, "    const char *data;\n");
+        fprintf(file, "    size_t size;\n");
+        fprintf(file, "};\n");
+        fprintf(file, "\n");
+        fprintf(file, "// Unit of work for one thread: the spans are fed into one streaming state in order.\n");
+        fprintf(file, "struct %s_parser_parallel_segment_s {\n", t);
+        fprintf(file, "    std::vector<%s_parser_parallel_span_s> spans;\n", t);
+        fprintf(file, "    ::google::protobuf::RepeatedPtrField<%s> msgs;\n", c);
+        fprintf(file, "    std::string error;\n");
+        fprintf(file, "    bool failed = false;\n");
+        fprintf(file, "};\n");
+        fprintf(file, "\n");
+        fprintf(file, "// Splits newline delimited json at the first newline after every count-th part of the buffer. Newlines cannot\n");
+        fprintf(file, "// occur inside of json strings, so every newline is a safe split point.\n");
+        fprintf(file, "%svoid %s_parser_parallel_split_lines(const char *buf, size_t bufLen, size_t count,\n", linkage, t);
+        fprintf(file, "                                           std::vector<%s_parser_parallel_segment_s> &segments) {\n", t);
+        fprintf(file, "    const char *p = buf;\n");
+        fprintf(file, "    const char *end = buf + bufLen;\n");
+        fprintf(file, "    for (size_t i = 1; p < end; ++i) {\n");
+        fprintf(file, "        const char *target = i < count ? std::max(p, buf + bufLen / count * i) : end;\n");
+        fprintf(file, "        const char *nl = target < end ? static_cast<const char *>(memchr(target, '\\n', end - target)) : nullptr;\n");
+        fprintf(file, "        const char *segEnd = nl ? nl + 1 : end;\n");
+        fprintf(file, "        segments.emplace_back();\n");
+        fprintf(file, "        segments.back().spans.push_back({p, static_cast<size_t>(segEnd - p)});\n");
+        fprintf(file, "        p = segEnd;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "// Finds the objects of a top-level array with a structural scan, which only tracks strings and nesting, and\n");
+        fprintf(file, "// distributes them evenly over count segments.\n");
+        fprintf(file, "%sbool %s_parser_parallel_split_array(const char *buf, size_t bufLen, size_t count,\n", linkage, t);
+        fprintf(file, "                                           std::vector<%s_parser_parallel_segment_s> &segments, std::string *error) {\n", t);
+        fprintf(file, "    std::vector<%s_parser_parallel_span_s> spans;\n", t);
+        fprintf(file, "    const char *p = static_cast<const char *>(memchr(buf, '[', bufLen)) + 1;\n");
+        fprintf(file, "    const char *end = buf + bufLen;\n");
+        fprintf(file, "    const char *elem = nullptr;\n");
+        fprintf(file, "    size_t depth = 0;\n");
+        fprintf(file, "    bool inString = false;\n");
+        fprintf(file, "    bool escaped = false;\n");
+        fprintf(file, "    bool needComma = false;\n");
+        fprintf(file, "    bool closed = false;\n");
+        fprintf(file, "    const char *err = nullptr;\n");
+        fprintf(file, "    for (; p < end && !closed && !err; ++p) {\n");
+        fprintf(file, "        const char ch = *p;\n");
+        fprintf(file, "        if (inString) {\n");
+        fprintf(file, "            if (escaped) {\n");
+        fprintf(file, "                escaped = false;\n");
+        fprintf(file, "            } else if (ch == '\\\\') {\n");
+        fprintf(file, "                escaped = true;\n");
+        fprintf(file, "            } else if (ch == '\"') {\n");
+        fprintf(file, "                inString = false;\n");
+        fprintf(file, "            }\n");
+        fprintf(file, "        } else if (depth > 0) {\n");
+        fprintf(file, "            if (ch == '\"') {\n");
+        fprintf(file, "                inString = true;\n");
+        fprintf(file, "            } else if (ch == '{' || ch == '[') {\n");
+        fprintf(file, "                ++depth;\n");
+        fprintf(file, "            } else if ((ch == '}' || ch == ']') && --depth == 0) {\n");
+        fprintf(file, "                spans.push_back({elem, static_cast<size_t>(p + 1 - elem)});\n");
+        fprintf(file, "                needComma = true;\n");
+        fprintf(file, "            }\n");
+        fprintf(file, "        } else if (ch == '{' && !needComma) {\n");
+        fprintf(file, "            elem = p;\n");
+        fprintf(file, "            depth = 1;\n");
+        fprintf(file, "        } else if (ch == ',' && needComma) {\n");
+        fprintf(file, "            needComma = false;\n");
+        fprintf(file, "        } else if (ch == ']' && (needComma || spans.empty())) {\n");
+        fprintf(file, "            closed = true;\n");
+        fprintf(file, "        } else if (ch != ' ' && ch != '\\n' && ch != '\\r' && ch != '\\t') {\n");
+        fprintf(file, "            err = \"unallowed token at this point in JSON text\";\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    for (; p < end && !err; ++p) {\n");
+        fprintf(file, "        if (*p != ' ' && *p != '\\n' && *p != '\\r' && *p != '\\t') {\n");
+        fprintf(file, "            err = \"trailing garbage\";\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    if (!err && !closed) {\n");
+        fprintf(file, "        err = \"premature EOF\";\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    if (err) {\n");
+        fprintf(file, "        if (error) {\n");
+        fprintf(file, "            *error = std::string(\"parse error: \") + err + \" at offset \" + std::to_string(p - 1 - buf) + \"\\n\";\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "        return false;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    const size_t perSegment = (spans.size() + count - 1) / count;\n");
+        fprintf(file, "    for (size_t i = 0; i < spans.size(); i += perSegment) {\n");
+        fprintf(file, "        segments.emplace_back();\n");
+        fprintf(file, "        segments.back().spans.assign(spans.begin() + i, spans.begin() + std::min(spans.size(), i + perSegment));\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    return true;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "%svoid %s_parser_parallel_parse_segment(%s_parser_parallel_segment_s &segment) {\n", linkage, t, t);
+        fprintf(file, "    %s msg;\n", c);
+        fprintf(file, "    auto &msgs = segment.msgs;\n");
+        fprintf(file, "    %s_parser_state_t state = %s_stream_init(msg, [&msgs](%s &m) { msgs.Add()->Swap(&m); });\n", t, t, c);
+        fprintf(file, "    for (const auto &span : segment.spans) {\n");
+        fprintf(file, "        if (%s_parser_on_chunk(state, const_cast<char *>(span.data), span.size) != 0) {\n", t);
+        fprintf(file, "            segment.failed = true;\n");
+        fprintf(file, "            break;\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    if (segment.failed || %s_parser_complete(state) != 0) {\n", t);
+        fprintf(file, "        char *err = %s_parser_get_error(state);\n", t);
+        fprintf(file, "        segment.error = err;\n");
+        fprintf(file, "        %s_parser_free_error(state, err);\n", t);
+        fprintf(file, "        segment.failed = true;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    %s_parser_free(state);\n", t);
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "%sint %s_parser_parallel_impl(const char *buf, size_t bufLen, unsigned threads,\n", linkage, t);
+        fprintf(file, "                                  std::vector<%s_parser_parallel_segment_s> &segments, std::string *error) {\n", t);
+        fprintf(file, "    if (threads == 0) {\n");
+        fprintf(file, "        threads = std::max(1u, std::thread::hardware_concurrency());\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    // several segments per thread, so threads which are done early pick up the remaining work\n");
+        fprintf(file, "    const size_t count = threads * %s_parser_parallel_segments_per_thread;\n", t);
+        fprintf(file, "    const char *first = buf;\n");
+        fprintf(file, "    while (first < buf + bufLen && (*first == ' ' || *first == '\\n' || *first == '\\r' || *first == '\\t')) {\n");
+        fprintf(file, "        ++first;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    if (first < buf + bufLen && *first == '[') {\n");
+        fprintf(file, "        if (!%s_parser_parallel_split_array(buf, bufLen, count, segments, error)) {\n", t);
+        fprintf(file, "            return 1;\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "    } else {\n");
+        fprintf(file, "        %s_parser_parallel_split_lines(buf, bufLen, count, segments);\n", t);
+        fprintf(file, "    }\n");
+        fprintf(file, "\n");
+        fprintf(file, "    std::atomic<size_t> next(0);\n");
+        fprintf(file, "    auto work = [&segments, &next]() {\n");
+        fprintf(file, "        for (size_t i = next++; i < segments.size(); i = next++) {\n");
+        fprintf(file, "            %s_parser_parallel_parse_segment(segments[i]);\n", t);
+        fprintf(file, "        }\n");
+        fprintf(file, "    };\n");
+        fprintf(file, "    std::vector<std::thread> workers;\n");
+        fprintf(file, "    for (unsigned i = 1; i < threads && i < segments.size(); ++i) {\n");
+        fprintf(file, "        workers.emplace_back(work);\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    work();\n");
+        fprintf(file, "    for (auto &worker : workers) {\n");
+        fprintf(file, "        worker.join();\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "\n");
+        fprintf(file, "    for (const auto &segment : segments) {\n");
+        fprintf(file, "        if (segment.failed) {\n");
+        fprintf(file, "            if (error) {\n");
+        fprintf(file, "                *error = segment.error;\n");
+        fprintf(file, "            }\n");
+        fprintf(file, "            return 1;\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    return 0;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "} // anonymous namespace\n");
+        fprintf(file, "\n");
+        fprintf(file, "int %s_parser_parallel(const char *buf, size_t bufLen, ::google::protobuf::RepeatedPtrField<%s> &out,\n", t, c);
+        fprintf(file, "                      unsigned threads, std::string *error) {\n");
+        fprintf(file, "    std::vector<%s_parser_parallel_segment_s> segments;\n", t);
+        fprintf(file, "    if (%s_parser_parallel_impl(buf, bufLen, threads, segments, error) != 0) {\n", t);
+        fprintf(file, "        return 1;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    int size = out.size();\n");
+        fprintf(file, "    for (const auto &segment : segments) {\n");
+        fprintf(file, "        size += segment.msgs.size();\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    out.Reserve(size);\n");
+        fprintf(file, "    for (auto &segment : segments) {\n");
+        fprintf(file, "        for (auto &msg : segment.msgs) {\n");
+        fprintf(file, "            out.Add()->Swap(&msg);\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    return 0;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "int %s_parser_parallel(const char *buf, size_t bufLen, const %s_stream_callback &callback,\n", t, t);
+        fprintf(file, "                      unsigned threads, std::string *error) {\n");
+        fprintf(file, "    std::vector<%s_parser_parallel_segment_s> segments;\n", t);
+        fprintf(file, "    if (%s_parser_parallel_impl(buf, bufLen, threads, segments, error) != 0) {\n", t);
+        fprintf(file, "        return 1;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    for (auto &segment : segments) {\n");
+        fprintf(file, "        for (auto &msg : segment.msgs) {\n");
+        fprintf(file, "            callback(msg);\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    return 0;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+    }
+
+    // Prints an exact match of the key against the names of the given nodes without hashing or allocating: a switch
+    // over the key length and a fixed-width memcmp per candidate of that length. The body printed by onMatch has to
+    // leave the switch itself (return, goto, ...), a key without match falls out of the switch.
+    void printKeySwitch(FILE *file, const std::vector<Node*>& nodes, const char *key, const char *keyLen,
+                        const std::string &indent, const std::function<void(const Node&, const std::string&)> &onMatch) {
+        std::map<size_t, std::vector<const Node*>> buckets;
+        for (const auto& node : nodes) {
+            buckets[node->name.size()].push_back(node);
+        }
+        if (buckets.empty()) {
+            return;
+        }
+        const char *i = indent.c_str();
+        fprintf(file, "%sswitch (%s) {\n", i, keyLen);
+        for (const auto& bucket : buckets) {
+            fprintf(file, "%s    case %zu:\n", i, bucket.first);
+            for (const auto& node : bucket.second) {
+                fprintf(file, "%s        if (memcmp(%s, \"%s\", %zu) == 0) { // %s\n", i, key, node->name.c_str(),
+                        bucket.first, node->name.c_str());
+                onMatch(*node, indent + "            ");
+                fprintf(file, "%s        }\n", i);
+            }
+            fprintf(file, "%s        break;\n", i);
+        }
+        fprintf(file, "%s}\n", i);
+    }
+
+    // With a field mask the parser stops as soon as every selected key of the root object has been parsed once, the
+    // rest of the document cannot contribute to the output anymore.
+    static bool hasEarlyExit(const Graph &graph) {
+        return !graph.fieldMask.empty() && graph.root.children.size() <= 64;
+    }
+
+    static uint64_t getEarlyExitMask(const Graph &graph) {
+        const auto count = graph.root.children.size();
+        return count == 64 ? ~static_cast<uint64_t>(0) : (static_cast<uint64_t>(1) << count) - 1;
+    }
+
+    // suffix of the number conversion for a field, its C++ type is the suffix with _t. Booleans accept 0 and 1.
+    static const char *getNumberKind(const FieldDescriptor &field) {
+        switch (field.cpp_type()) {
+            case FieldDescriptor::CPPTYPE_INT32:
+            case FieldDescriptor::CPPTYPE_ENUM:
+                return "int32";
+            case FieldDescriptor::CPPTYPE_UINT32:
+                return "uint32";
+            case FieldDescriptor::CPPTYPE_UINT64:
+                return "uint64";
+            case FieldDescriptor::CPPTYPE_FLOAT:
+            case FieldDescriptor::CPPTYPE_DOUBLE:
+                return "double";
+            default:
+                return "int64";
+        }
+    }
+
+    // value nodes of map fields insert into the map of the message holding the field, see Graph::injectMapValueNode
+    static bool isMapValue(const Node &node) {
+        return node.parent && node.parent->type == NodeType::MAP;
+    }
+
+    static const FieldDescriptor &getMapKey(const Node &node) {
+        const Node &mapNode = isMapValue(node) ? *node.parent : node;
+        return *mapNode.field->message_type()->map_key();
+    }
+
+    static std::string getMapKeyType(const FieldDescriptor &key) {
+        switch (key.cpp_type()) {
+            case FieldDescriptor::CPPTYPE_STRING:
+                return "std::string";
+            case FieldDescriptor::CPPTYPE_BOOL:
+                return "bool";
+            default:
+                return std::string(getNumberKind(key)) + "_t";
+        }
+    }
+
+    // Converts the json key of a map entry into target, which has the type of getMapKeyType. Integer and boolean keys
+    // are quoted in json and have to match exactly, the code printed by fail has to leave the function.
+    void printMapKey(FILE *file, const FieldDescriptor &key, const char *t, const char *keyExpr, const char *keyLen,
+                     const char *target, const std::string &indent, const std::function<void(const std::string&)> &fail) {
+        const char *i = indent.c_str();
+        switch (key.cpp_type()) {
+            case FieldDescriptor::CPPTYPE_STRING:
+                fprintf(file, "%s%s.assign(%s, %s);\n", i, target, keyExpr, keyLen);
+                return;
+            case FieldDescriptor::CPPTYPE_BOOL:
+                fprintf(file, "%sif (%s == 4 && memcmp(%s, \"true\", 4) == 0) {\n", i, keyLen, keyExpr);
+                fprintf(file, "%s    %s = true;\n", i, target);
+                fprintf(file, "%s} else if (%s == 5 && memcmp(%s, \"false\", 5) == 0) {\n", i, keyLen, keyExpr);
+                fprintf(file, "%s    %s = false;\n", i, target);
+                fprintf(file, "%s} else {\n", i);
+                break;
+            default:
+                fprintf(file, "%sif (!%s_parser_number_%s(%s, %s, %s)) {\n", i, t, getNumberKind(key), keyExpr, keyLen, target);
+                break;
+        }
+        fail(indent + "    ");
+        fprintf(file, "%s}\n", i);
+    }
+
+    // message type handled at an object node, the root has no field
+    static const Descriptor *getMessageDesc(const Node &node) {
+        return node.parent ? node.field->message_type() : node.desc;
+    }
+
+    template <typename Descriptor>
+    static std::string get_full_cpp_type_name(const Descriptor& desc) {
+        return "::" + replace_all(desc.full_name(), ".", "::");
+    }
 };
 
 } // namespace protog
@@ -8,6 +8,10 @@ namespace protog {
 struct YajlWriter : public Writer {
     virtual ~YajlWriter() {}
 
+    // dispatch the callbacks through label tables (computed goto) instead of switch statements
+    bool threaded = false;
+    std::vector<int> cases; // states handled by the callback being generated
+
     virtual void write(const Graph &graph, const char* proto_header) override {
         auto name_lower = graph.root.desc->name();
         std::transform(name_lower.begin(), name_lower.end(), name_lower.begin(), ::tolower);
@@ -15,114 +19,429 @@ struct YajlWriter : public Writer {
         const auto res_name_prefix = name_lower + "_parser.pb";
 
         const auto header_name = res_name_prefix + ".h";
-        FILE *header = fopen(header_name.c_str(), "w");
+        FILE *header = openOutput();
         printHeader(header, graph, name_lower.c_str(), cpp_type.c_str(), proto_header);
-        fclose(header);
+        closeOutput(header, header_name);
 
         const auto source_name = res_name_prefix + ".cc";
-        FILE *source = fopen(source_name.c_str(), "w");
+        FILE *source = openOutput();
         printSource(source, graph, name_lower.c_str(), cpp_type.c_str());
-        fclose(source);
-    }
-
-    void printHeader(FILE *file, const Graph &graph, const char *t, const char *c, const char* h) {
-        fprintf(file, "#pragma once\n\n");
-        fprintf(file, "#include \"%s\"\n\n", h);
-        printNamespaceBegin(file, graph);
-        fprintf(file, "typedef struct %s_parser_state_s *%s_parser_state_t;\n", t, t);
-        fprintf(file, "\n");
-        fprintf(file, "%s %s_parser_easy(const std::string &json);\n", c, t);
-        fprintf(file, "%s %s_parser_easy(const char *buf, size_t bufLen);\n", c, t);
-        fprintf(file, "\n");
-        fprintf(file, "%s_parser_state_t %s_parser_init(%s &msg);\n", t, t, c);
-        fprintf(file, "void %s_parser_free(%s_parser_state_t state);\n", t, t);
-        fprintf(file, "int %s_parser_on_chunk(%s_parser_state_t state, char *chunk, size_t chunkLen);\n", t, t);
-        fprintf(file, "int %s_parser_complete(%s_parser_state_t state);\n", t, t);
-        fprintf(file, "int %s_parser_reset(%s_parser_state_t state);\n", t, t);
-        fprintf(file, "char *%s_parser_get_error(%s_parser_state_t state);\n", t, t);
-        fprintf(file,
-                "char *%s_parser_get_error(%s_parser_state_t state, int verbose, const char *chunk, size_t chunkLen);\n",
-                t, t);
-        fprintf(file, "void %s_parser_free_error(%s_parser_state_t state, char *err);\n", t, t);
-        fprintf(file, "\n");
-        printNamespaceEnd(file, graph);
+        closeOutput(source, source_name);
     }
 
     void printSource(FILE *file, const Graph &graph, const char *t, const char *c) {
         printSourceIncludes(file, t);
         printNamespaceBegin(file, graph);
-        printTypeDefinition(file, t, c);
+        printTypeDefinition(file, graph, t, c);
         fprintf(file, "namespace {\n\n");
+        printAllocator(file, t);
+        printProfileImpl(file, graph, t);
+        printHintsImpl(file, graph, t);
+        printNumberImpl(file, t);
         printSourceImpl(file, graph, t, c);
         printYajlCallbacks(file, t);
+        printHandleImpl(file, t);
         fprintf(file, "} // anonymous namespace\n\n");
         printApiImpl(file, t, c);
+        printPoolImpl(file, graph, t, c);
+        printElementCallbackImpl(file, graph, t);
+        printProfileApiImpl(file, t);
+        printParallelImpl(file, t, c);
+        printFileImpl(file, t, c);
         printNamespaceEnd(file, graph);
     }
 
     void printSourceIncludes(FILE *file, const char *t) {
         fprintf(file, "#include \"%s_parser.pb.h\"\n\n", t);
+        fprintf(file, "#include <errno.h>\n");
+        fprintf(file, "#include <fcntl.h>\n");
+        fprintf(file, "#include <math.h>\n");
+        fprintf(file, "#include <stdint.h>\n");
         fprintf(file, "#include <stdlib.h>\n");
-        fprintf(file, "#include <stdio.h>\n\n");
+        fprintf(file, "#include <stdio.h>\n");
+        fprintf(file, "#include <string.h>\n");
+        fprintf(file, "#include <sys/mman.h>\n");
+        fprintf(file, "#include <sys/stat.h>\n");
+        fprintf(file, "#include <unistd.h>\n\n");
+        fprintf(file, "#if defined(__SSSE3__)\n");
+        fprintf(file, "#include <immintrin.h>\n");
+        fprintf(file, "#endif\n");
+        fprintf(file, "#if defined(PROTOG_PROFILE) && (defined(__x86_64__) || defined(__i386__))\n");
+        fprintf(file, "#include <x86intrin.h>\n");
+        fprintf(file, "#endif\n\n");
+        fprintf(file, "#include <algorithm>\n");
+        fprintf(file, "#include <atomic>\n");
+        fprintf(file, "#include <chrono>\n");
         fprintf(file, "#include <functional>\n");
-        fprintf(file, "#include <string>\n\n");
+        fprintf(file, "#include <stdexcept>\n");
+        fprintf(file, "#include <string>\n");
+        fprintf(file, "#include <thread>\n");
+        fprintf(file, "#include <vector>\n\n");
         fprintf(file, "#include <yajl/yajl_parse.h>\n");
         fprintf(file, "\n");
     }
 
-    void printTypeDefinition(FILE *file, const char *t, const char *c) {
-        fprintf(file, "struct %s_parser_config_s {\n", t);
-        fprintf(file, "    bool checkInitialized;\n");
+    void printTypeDefinition(FILE *file, const Graph &graph, const char *t, const char *c) {
+        if (!graph.shareTypes) {
+            fprintf(file, "static const size_t %s_parser_max_depth = %d;\n", t, graph.getMaxMessageDepth());
+        }
+        fprintf(file, "static const size_t %s_parser_alloc_initial_size = 8192;\n", t);
+        fprintf(file, "static const size_t %s_parser_skip_location = static_cast<size_t>(-1); // inside an unknown value\n", t);
+        fprintf(file, "\n");
+        fprintf(file, "struct %s_parser_config_s : %s_parser_config {\n", t, t);
+        fprintf(file, "    bool stream = false; // accept multiple top-level values\n");
         fprintf(file, "};\n");
         fprintf(file, "\n");
+        if (graph.shareTypes) {
+            printFrameStack(file, t);
+        } else {
+            fprintf(file, "// Inline stack of the messages currently being filled, sized by the deepest message nesting of the schema.\n");
+            fprintf(file, "// The innermost message is cached in top, so value callbacks load their target with a single access.\n");
+            fprintf(file, "struct %s_parser_msg_stack_s {\n", t);
+            fprintf(file, "    ::google::protobuf::Message *items[%s_parser_max_depth + 1] = {}; // items[0] stays null\n", t);
+            fprintf(file, "    ::google::protobuf::Message *top = nullptr;\n");
+            fprintf(file, "    size_t size = 0;\n");
+            fprintf(file, "\n");
+            fprintf(file, "    ::google::protobuf::Message *back() const { return top; }\n");
+            fprintf(file, "    void push_back(::google::protobuf::Message *msg) { assert(size < %s_parser_max_depth); items[++size] = msg; top = msg; }\n", t);
+            fprintf(file, "    void pop_back() { top = items[--size]; }\n");
+            fprintf(file, "    bool empty() const { return size == 0; }\n");
+            fprintf(file, "    void clear() { size = 0; top = nullptr; }\n");
+            fprintf(file, "};\n");
+            fprintf(file, "\n");
+        }
+        fprintf(file, "// Bump allocator backing the yajl handle. yajl handles cannot be reused after complete or error, so they are\n");
+        fprintf(file, "// recreated on reset. Once the region is large enough for a typical document this does not touch the heap anymore.\n");
+        fprintf(file, "struct %s_parser_alloc_s {\n", t);
+        fprintf(file, "    char *region = nullptr;\n");
+        fprintf(file, "    size_t regionSize = 0;\n");
+        fprintf(file, "    size_t used = 0;\n");
+        fprintf(file, "    size_t overflow = 0; // bytes which did not fit into the region since the last rewind\n");
+        fprintf(file, "};\n");
+        fprintf(file, "\n");
+        printProfileDefinition(file, graph, t);
         fprintf(file, "struct %s_parser_state_s {\n", t);
-        fprintf(file, "    %s_parser_state_s(%s &req) : req(req) { }\n\n", t, c);
+        fprintf(file, "    %s_parser_state_s(%s &req) : req(&req) { }\n", t, c);
+        fprintf(file, "\n");
         fprintf(file, "    %s_parser_config_s config;\n", t);
         fprintf(file, "    yajl_handle handle = NULL;\n");
         fprintf(file, "    size_t location = 0;\n");
-        fprintf(file, "    %s &req;\n", c);
-        fprintf(file, "    std::vector<::google::protobuf::Message *> msgStack;\n\n");
+        fprintf(file, "    size_t skipReturn = 0; // location to continue at after the skipped value\n");
+        fprintf(file, "    size_t skipDepth = 0;\n");
+        fprintf(file, "    uint64_t seen = 0; // keys of the root object, used to stop early with a field mask\n");
+        fprintf(file, "    bool done = false;\n");
+        fprintf(file, "    size_t consumed = 0; // bytes of the chunks before the current one\n");
+        fprintf(file, "    unsigned char utf8Tail[4]; // start of a utf-8 sequence split by the end of the last chunk\n");
+        fprintf(file, "    size_t utf8TailLen = 0;\n");
+        fprintf(file, "    %s_parser_error_s error = {};\n", t);
+        if (!graph.map_nodes.empty()) {
+            fprintf(file, "    std::string mapKey; // key of the map entry whose value comes next, integer keys are converted once\n");
+            fprintf(file, "    int64_t mapKeyInt = 0;\n");
+            fprintf(file, "    uint64_t mapKeyUint = 0; // also booleans\n");
+        }
+        fprintf(file, "    %s *req;\n", c);
+        fprintf(file, "    %s_parser_msg_stack_s msgStack;\n", t);
+        fprintf(file, "    %s_parser_alloc_s alloc;\n", t);
+        fprintf(file, "    %s_stream_callback callback;\n", t);
+        if (graph.elementNode) {
+            fprintf(file, "    %s_element_callback elementCallback;\n", t);
+        }
+        fprintf(file, "#if defined(PROTOG_PROFILE)\n");
+        fprintf(file, "    %s_parser_profile_s profile;\n", t);
+        fprintf(file, "#endif\n");
+        fprintf(file, "\n");
         fprintf(file, "    void reset() {\n");
         fprintf(file, "        location = 0;\n");
-        fprintf(file, "        req.Clear();\n");
+        fprintf(file, "        skipDepth = 0;\n");
+        fprintf(file, "        seen = 0;\n");
+        fprintf(file, "        done = false;\n");
+        fprintf(file, "        consumed = 0;\n");
+        fprintf(file, "        utf8TailLen = 0;\n");
+        fprintf(file, "        error = {};\n");
+        fprintf(file, "        req->Clear();\n");
         fprintf(file, "        msgStack.clear();\n");
         fprintf(file, "    }\n");
         fprintf(file, "};\n");
         fprintf(file, "\n");
     }
 
+    void printFrameStack(FILE *file, const char *t) {
+        fprintf(file, "// Stack of the messages currently being filled. Message types share their states, so every frame also keeps the\n");
+        fprintf(file, "// location to continue at once its object is closed. It grows with the nesting of recursive messages and keeps\n");
+        fprintf(file, "// its capacity across documents.\n");
+        fprintf(file, "struct %s_parser_frame_s {\n", t);
+        fprintf(file, "    ::google::protobuf::Message *msg;\n");
+        fprintf(file, "    size_t ret;\n");
+        fprintf(file, "};\n");
+        fprintf(file, "\n");
+        fprintf(file, "struct %s_parser_msg_stack_s {\n", t);
+        fprintf(file, "    std::vector<%s_parser_frame_s> frames;\n", t);
+        fprintf(file, "\n");
+        fprintf(file, "    ::google::protobuf::Message *back() const { return frames.back().msg; }\n");
+        fprintf(file, "    size_t ret() const { return frames.back().ret; }\n");
+        fprintf(file, "    void push_back(::google::protobuf::Message *msg, size_t ret = 0) { frames.push_back({msg, ret}); }\n");
+        fprintf(file, "    void pop_back() { frames.pop_back(); }\n");
+        fprintf(file, "    bool empty() const { return frames.empty(); }\n");
+        fprintf(file, "    void clear() { frames.clear(); }\n");
+        fprintf(file, "};\n");
+        fprintf(file, "\n");
+    }
+
+    void printAllocator(FILE *file, const char *t) {
+        fprintf(file, "static const size_t %s_parser_alloc_header = 16; // keeps the size of a block, maintains 16 byte alignment\n", t);
+        fprintf(file, "\n");
+        fprintf(file, "static inline bool %s_parser_alloc_owns(const %s_parser_alloc_s &alloc, const void *ptr) {\n", t, t);
+        fprintf(file, "    return ptr >= alloc.region && ptr < alloc.region + alloc.regionSize;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "static void *%s_parser_alloc_malloc(void *ctx, size_t sz) {\n", t);
+        fprintf(file, "    %s_parser_alloc_s &alloc = *static_cast<%s_parser_alloc_s *>(ctx);\n", t, t);
+        fprintf(file, "    const size_t need = %s_parser_alloc_header + ((sz + 15) & ~static_cast<size_t>(15));\n", t);
+        fprintf(file, "    if (alloc.regionSize - alloc.used < need) {\n");
+        fprintf(file, "        alloc.overflow += need;\n");
+        fprintf(file, "        return malloc(sz);\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    char *block = alloc.region + alloc.used;\n");
+        fprintf(file, "    alloc.used += need;\n");
+        fprintf(file, "    *reinterpret_cast<size_t *>(block) = need;\n");
+        fprintf(file, "    return block + %s_parser_alloc_header;\n", t);
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "static void %s_parser_alloc_free(void *ctx, void *ptr) {\n", t);
+        fprintf(file, "    %s_parser_alloc_s &alloc = *static_cast<%s_parser_alloc_s *>(ctx);\n", t, t);
+        fprintf(file, "    if (!%s_parser_alloc_owns(alloc, ptr)) {\n", t);
+        fprintf(file, "        free(ptr);\n");
+        fprintf(file, "        return;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    char *block = static_cast<char *>(ptr) - %s_parser_alloc_header;\n", t);
+        fprintf(file, "    if (block + *reinterpret_cast<size_t *>(block) == alloc.region + alloc.used) {\n");
+        fprintf(file, "        alloc.used = block - alloc.region; // most recent block, give it back\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "static void *%s_parser_alloc_realloc(void *ctx, void *ptr, size_t sz) {\n", t);
+        fprintf(file, "    %s_parser_alloc_s &alloc = *static_cast<%s_parser_alloc_s *>(ctx);\n", t, t);
+        fprintf(file, "    if (!ptr) {\n");
+        fprintf(file, "        return %s_parser_alloc_malloc(ctx, sz);\n", t);
+        fprintf(file, "    }\n");
+        fprintf(file, "    if (!%s_parser_alloc_owns(alloc, ptr)) {\n", t);
+        fprintf(file, "        return realloc(ptr, sz);\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    char *block = static_cast<char *>(ptr) - %s_parser_alloc_header;\n", t);
+        fprintf(file, "    const size_t have = *reinterpret_cast<size_t *>(block);\n");
+        fprintf(file, "    const size_t need = %s_parser_alloc_header + ((sz + 15) & ~static_cast<size_t>(15));\n", t);
+        fprintf(file, "    if (need <= have) {\n");
+        fprintf(file, "        return ptr;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    if (block + have == alloc.region + alloc.used && alloc.regionSize - (block - alloc.region) >= need) {\n");
+        fprintf(file, "        alloc.used = block - alloc.region + need; // most recent block, grow in place\n");
+        fprintf(file, "        *reinterpret_cast<size_t *>(block) = need;\n");
+        fprintf(file, "        return ptr;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    void *res = %s_parser_alloc_malloc(ctx, sz);\n", t);
+        fprintf(file, "    if (res) {\n");
+        fprintf(file, "        memcpy(res, ptr, have - %s_parser_alloc_header);\n", t);
+        fprintf(file, "        %s_parser_alloc_free(ctx, ptr);\n", t);
+        fprintf(file, "    }\n");
+        fprintf(file, "    return res;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "// Rewinds the region after the handle got freed and grows it if the last document did not fit.\n");
+        fprintf(file, "static void %s_parser_alloc_rewind(%s_parser_alloc_s &alloc) {\n", t, t);
+        fprintf(file, "    const size_t wanted = alloc.used + alloc.overflow;\n");
+        fprintf(file, "    if (!alloc.region || wanted > alloc.regionSize) {\n");
+        fprintf(file, "        free(alloc.region);\n");
+        fprintf(file, "        alloc.regionSize = std::max(wanted * 2, %s_parser_alloc_initial_size);\n", t);
+        fprintf(file, "        alloc.region = static_cast<char *>(malloc(alloc.regionSize));\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    alloc.used = 0;\n");
+        fprintf(file, "    alloc.overflow = 0;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+    }
+
     void printSourceImpl(FILE *file, const Graph &graph, const char *t, const char *c) {
+        printFailImpl(file, t);
+        printUtf8Impl(file, t);
+        printUtf8ChunkImpl(file, t);
         printNullImpl(file, t, c, graph.null_nodes);
         printPodImpl(file, t, c, "boolean", "int", graph.bool_nodes);
-        printPodImpl(file, t, c, "integer", "long long", graph.long_nodes);
-        printPodImpl(file, t, c, "double", "double", graph.double_nodes);
+        printNumberCallbackImpl(file, t, graph.long_nodes);
+        if (hasBytesFields(graph)) {
+            printBase64Impl(file, t);
+        }
         printStringImpl(file, t, c, graph.string_nodes);
-        printMapStartImpl(file, graph.object_nodes, t, c);
-        printMapKeyImpl(file, t, c, graph.object_nodes);
-        printMapEndImpl(file, t, c, graph.object_nodes);
-        printArrayStartImpl(file, t, c, graph.array_nodes);
-        printArrayEndImpl(file, t, c, graph.array_nodes);
+        printMapStartImpl(file, graph, t, c);
+        printMapKeyImpl(file, graph, t, c);
+        printMapEndImpl(file, graph, t, c);
+        printArrayStartImpl(file, graph, t, c);
+        printArrayEndImpl(file, graph, t, c);
+    }
+
+    void printUtf8ChunkImpl(FILE *file, const char *t) {
+        fprintf(file, "// Validates the utf-8 of a chunk before yajl sees it and returns the offset of the first invalid sequence, or -1.\n");
+        fprintf(file, "// A sequence cut off by the end of the chunk is kept back and completed with the first bytes of the next one.\n");
+        fprintf(file, "static size_t %s_parser_impl_check_utf8(%s_parser_state_s &state, const char *chunk, size_t chunkLen) {\n", t, t);
+        fprintf(file, "    size_t i = 0;\n");
+        fprintf(file, "    if (state.utf8TailLen > 0) {\n");
+        fprintf(file, "        const size_t held = state.utf8TailLen;\n");
+        fprintf(file, "        const unsigned char lead = state.utf8Tail[0];\n");
+        fprintf(file, "        const size_t n = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : 2;\n");
+        fprintf(file, "        while (state.utf8TailLen < n && i < chunkLen) {\n");
+        fprintf(file, "            state.utf8Tail[state.utf8TailLen++] = chunk[i++];\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "        if (state.utf8TailLen < n) {\n");
+        fprintf(file, "            return static_cast<size_t>(-1);\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "        state.utf8TailLen = 0;\n");
+        fprintf(file, "        if (%s_parser_utf8_check(reinterpret_cast<const char *>(state.utf8Tail), n) != n) {\n", t);
+        fprintf(file, "            return state.consumed - held;\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    size_t end = chunkLen;\n");
+        fprintf(file, "    size_t k = end;\n");
+        fprintf(file, "    while (k > i && end - k < 3 && (static_cast<unsigned char>(chunk[k - 1]) & 0xC0) == 0x80) {\n");
+        fprintf(file, "        --k;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    if (k > i && static_cast<unsigned char>(chunk[k - 1]) >= 0xC0) {\n");
+        fprintf(file, "        const unsigned char lead = static_cast<unsigned char>(chunk[k - 1]);\n");
+        fprintf(file, "        const size_t n = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : 2;\n");
+        fprintf(file, "        if (end - (k - 1) < n) {\n");
+        fprintf(file, "            state.utf8TailLen = end - (k - 1);\n");
+        fprintf(file, "            memcpy(state.utf8Tail, chunk + k - 1, state.utf8TailLen);\n");
+        fprintf(file, "            end = k - 1;\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    const size_t valid = %s_parser_utf8_check(chunk + i, end - i);\n", t);
+        fprintf(file, "    if (valid != end - i) {\n");
+        fprintf(file, "        return state.consumed + i + valid;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    return static_cast<size_t>(-1);\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+    }
+
+    // Callbacks only record why they stopped, returning 0 makes yajl give up right away. The offset is added once yajl
+    // returns, the message is only formatted by get_error.
+    void printFailImpl(FILE *file, const char *t) {
+        fprintf(file, "static int %s_parser_impl_fail(%s_parser_state_s &state, %s_parser_error_code code) {\n", t, t, t);
+        fprintf(file, "    state.error.code = code;\n");
+        fprintf(file, "    state.error.state = state.location;\n");
+        fprintf(file, "    return 0;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "static int %s_parser_impl_error(%s_parser_state_s &state, size_t offset) {\n", t, t);
+        fprintf(file, "    if (state.error.code == %s_parser_error_none) {\n", t);
+        fprintf(file, "        state.error.code = %s_parser_error_syntax;\n", t);
+        fprintf(file, "        state.error.state = state.location;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    state.error.offset = state.consumed + offset;\n");
+        fprintf(file, "    return 1;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+    }
+
+    void printProfileScope(FILE *file, const char *t, const char *callback) {
+        fprintf(file, "#if defined(PROTOG_PROFILE)\n");
+        fprintf(file, "    %s_parser_profile_scope profileScope(state.profile, state.location, %d); // yajl_%s\n", t,
+                static_cast<int>(getProfileCallback(callback)), callback);
+        fprintf(file, "#endif\n");
     }
 
     void printNullImpl(FILE* file, const char* t, const char* c, const std::vector<Node*>& nodes) {
         fprintf(file, "static int %s_parser_impl_parse_null(void *ctx) {\n", t);
         fprintf(file, "    %s_parser_state_s &state = *static_cast<%s_parser_state_t>(ctx);\n", t, t);
-        fprintf(file, "    switch (state.location) {\n");
-        for (const auto& node : nodes) {
-            assert(node);
-            printNullStateImpl(file, *node);
-        }
-        fprintf(file, "        default:\n");
-        fprintf(file, "            fprintf(stderr, \"State %%zu does not allow null\\n\", state.location);\n");
-        fprintf(file, "            exit(1);\n");
-        fprintf(file, "    }\n");
+        printProfileScope(file, t, "null");
+        printSkipCheck(file, t, 0);
+        printDispatch(file, t, [&](FILE *file) {
+            for (const auto& node : nodes) {
+                assert(node);
+                printNullStateImpl(file, *node);
+            }
+        }, [&](FILE *file) {
+            fprintf(file, "            return %s_parser_impl_fail(state, %s_parser_error_type);\n", t, t);
+        });
         fprintf(file, "    return 1;\n");
         fprintf(file, "}\n\n");
     }
 
+    // Emits the dispatch over state.location of a callback. The threaded variant numbers the states handled by this
+    // callback densely, maps locations to those numbers with a small table and jumps through a table of label
+    // addresses. Every callback gets its own indirect jump, which predicts better than the shared switch prologue and
+    // avoids the range checks of sparse switch statements. Cases end with break, which leaves the loop around them.
+    void printDispatch(FILE *file, const char *t, const std::function<void(FILE *)> &printCases,
+                       const std::function<void(FILE *)> &printDefault) {
+        if (!threaded) {
+            fprintf(file, "    switch (state.location) {\n");
+            printCases(file);
+            fprintf(file, "        default:\n");
+            printDefault(file);
+            fprintf(file, "    }\n");
+            return;
+        }
+        cases.clear();
+        char *body = nullptr;
+        size_t bodyLen = 0;
+        FILE *bodyFile = open_memstream(&body, &bodyLen);
+        printCases(bodyFile);
+        fclose(bodyFile);
+        const int size = cases.empty() ? 1 : *std::max_element(cases.begin(), cases.end()) + 1;
+        std::vector<int> index(size, 0);
+        for (size_t i = 0; i < cases.size(); ++i) {
+            index[cases[i]] = static_cast<int>(i + 1);
+        }
+        fprintf(file, "    static const %s index[%d] = {", cases.size() < 256 ? "uint8_t" : "uint16_t", size);
+        for (int i = 0; i < size; ++i) {
+            fprintf(file, i % 32 == 0 ? "\n        %d," : " %d,", index[i]);
+        }
+        fprintf(file, "\n    };\n");
+        fprintf(file, "    static void *const labels[] = {&&fail");
+        for (const int state : cases) {
+            fprintf(file, ", &&s%d", state);
+        }
+        fprintf(file, "};\n");
+        fprintf(file, "    for (;;) {\n");
+        fprintf(file, "        goto *labels[state.location < %d ? index[state.location] : 0];\n", size);
+        fwrite(body, 1, bodyLen, file);
+        free(body);
+        fprintf(file, "        fail:\n");
+        printDefault(file);
+        fprintf(file, "    }\n");
+    }
+
+    void printCase(FILE *file, int state, const char *what, const char *name) {
+        if (threaded) {
+            cases.push_back(state);
+            fprintf(file, "        s%d: // %s %s\n", state, what, name);
+        } else {
+            fprintf(file, "        case %d: // %s %s\n", state, what, name);
+        }
+    }
+
+    // Values of unknown keys are consumed by the skip location: depth is the nesting change of the callback and the
+    // location from before the key is restored once the value is complete. Keys inside of skipped objects are ignored.
+    void printSkipCheck(FILE *file, const char *t, int depth, bool isValue = true) {
+        if (!skipUnknown) {
+            return;
+        }
+        fprintf(file, "    if (state.location == %s_parser_skip_location) {\n", t);
+        if (isValue) {
+            if (depth > 0) {
+                fprintf(file, "        ++state.skipDepth;\n");
+            } else if (depth < 0) {
+                fprintf(file, "        --state.skipDepth;\n");
+            }
+            fprintf(file, "        if (state.skipDepth == 0) {\n");
+            fprintf(file, "            state.location = state.skipReturn;\n");
+            fprintf(file, "        }\n");
+        }
+        fprintf(file, "        return 1;\n");
+        fprintf(file, "    }\n");
+    }
+
     void printNullStateImpl(FILE* file, const Node& node) {
         const auto cpp_type = get_full_cpp_type_name(*node.desc);
-        fprintf(file, "        case %d: // key %s\n", node.state, node.full_name.c_str());
+        printCase(file, node.state, "key", node.full_name.c_str());
         fprintf(file, "            static_cast<%s *>(state.msgStack.back())->clear_%s();\n", cpp_type.c_str(), node.name.c_str());
         fprintf(file, "            state.location = %d;\n", node.parent->state);
         fprintf(file, "            break;\n");
@@ -131,22 +450,28 @@ struct YajlWriter : public Writer {
     void printPodImpl(FILE* file, const char* t, const char* c, const char* p, const char* pt, const std::vector<Node*>& nodes) {
         fprintf(file, "static int %s_parser_impl_parse_%s(void *ctx, %s v) {\n", t, p, pt);
         fprintf(file, "    %s_parser_state_s &state = *static_cast<%s_parser_state_t>(ctx);\n", t, t);
-        fprintf(file, "    switch (state.location) {\n");
-        for (const auto& node : nodes) {
-            assert(node);
-            printPodStateImpl(file, *node);
-        }
-        fprintf(file, "        default:\n");
-        fprintf(file, "            fprintf(stderr, \"State %%zu does not allow %s\\n\", state.location);\n", p);
-        fprintf(file, "            exit(1);\n");
-        fprintf(file, "    }\n");
+        printProfileScope(file, t, p);
+        printSkipCheck(file, t, 0);
+        printDispatch(file, t, [&](FILE *file) {
+            for (const auto& node : nodes) {
+                assert(node);
+                printPodStateImpl(file, *node);
+            }
+        }, [&](FILE *file) {
+            fprintf(file, "            return %s_parser_impl_fail(state, %s_parser_error_type);\n", t, t);
+        });
         fprintf(file, "    return 1;\n");
         fprintf(file, "}\n\n");
     }
 
     void printPodStateImpl(FILE* file, const Node& node) {
         const auto cpp_type = get_full_cpp_type_name(*node.desc);
-        fprintf(file, "        case %d: // key %s\n", node.state, node.full_name.c_str());
+        printCase(file, node.state, "key", node.full_name.c_str());
+        if (isMapValue(node)) {
+            fprintf(file, "            %s = v != 0;\n", getMapSlot(node).c_str());
+            fprintf(file, "            break;\n");
+            return;
+        }
         fprintf(file, "            static_cast<%s *>(state.msgStack.back())->", cpp_type.c_str());
         if (node.field->is_repeated()) {
             fprintf(file, "add");
@@ -167,19 +492,107 @@ struct YajlWriter : public Writer {
         fprintf(file, "            break;\n");
     }
 
+    // Numbers arrive as raw text and are converted straight into the C++ type of the field, so 64 bit unsigned values
+    // survive and narrow fields are range checked. Doubles and booleans share the callback, as JSON has one number.
+    void printNumberCallbackImpl(FILE* file, const char* t, const std::vector<Node*>& nodes) {
+        std::set<std::string> kinds;
+        for (const auto& node : nodes) {
+            kinds.insert(getNumberKind(*node->field));
+        }
+        fprintf(file, "static int %s_parser_impl_parse_number(void *ctx, const char *num, size_t numLen) {\n", t);
+        fprintf(file, "    %s_parser_state_s &state = *static_cast<%s_parser_state_t>(ctx);\n", t, t);
+        printProfileScope(file, t, "number");
+        printSkipCheck(file, t, 0);
+        for (const auto& kind : kinds) {
+            fprintf(file, "    %s%s %s_v;\n", kind.c_str(), kind == "double" ? "" : "_t", kind.c_str());
+        }
+        printDispatch(file, t, [&](FILE *file) {
+            for (const auto& node : nodes) {
+                assert(node);
+                printNumberStateImpl(file, t, *node);
+            }
+        }, [&](FILE *file) {
+            fprintf(file, "            return %s_parser_impl_fail(state, %s_parser_error_type);\n", t, t);
+        });
+        fprintf(file, "    return 1;\n");
+        fprintf(file, "}\n\n");
+    }
+
+    void printNumberStateImpl(FILE* file, const char* t, const Node& node) {
+        const auto cpp_type = get_full_cpp_type_name(*node.desc);
+        const char *kind = getNumberKind(*node.field);
+        printCase(file, node.state, "key", node.full_name.c_str());
+        fprintf(file, "            if (!%s_parser_number_%s(num, numLen, %s_v)) {\n", t, kind, kind);
+        if (std::string(kind) == "double") {
+            fprintf(file, "                return %s_parser_impl_fail(state, %s_parser_error_range);\n", t, t);
+        } else { // fractions are not allowed for integers at all
+            fprintf(file, "                return %s_parser_impl_fail(state, %s_parser_number_is_integer(num, numLen) ?\n", t, t);
+            fprintf(file, "                        %s_parser_error_range : %s_parser_error_type);\n", t, t);
+        }
+        fprintf(file, "            }\n");
+        if (isMapValue(node)) {
+            fprintf(file, "            %s = ", getMapSlot(node).c_str());
+            if (node.field->type() == FieldDescriptor::TYPE_ENUM) {
+                fprintf(file, "static_cast<%s>(%s_v);\n", get_full_cpp_type_name(*node.field->enum_type()).c_str(), kind);
+            } else if (node.field->type() == FieldDescriptor::TYPE_BOOL) {
+                fprintf(file, "%s_v != 0;\n", kind);
+            } else {
+                fprintf(file, "%s_v;\n", kind);
+            }
+            fprintf(file, "            break;\n");
+            return;
+        }
+        fprintf(file, "            static_cast<%s *>(state.msgStack.back())->", cpp_type.c_str());
+        if (node.field->is_repeated()) {
+            fprintf(file, "add");
+        } else {
+            fprintf(file, "set");
+        }
+        fprintf(file, "_%s(", node.name.c_str());
+        if (node.field->type() == FieldDescriptor::TYPE_ENUM) {
+            const auto enum_type = get_full_cpp_type_name(*node.field->enum_type());
+            fprintf(file, "\n                    static_cast<%s>(%s_v)", enum_type.c_str(), kind);
+        } else if (node.field->type() == FieldDescriptor::TYPE_BOOL) {
+            fprintf(file, "%s_v != 0", kind);
+        } else {
+            fprintf(file, "%s_v", kind);
+        }
+        fprintf(file, ");\n");
+        if (!node.field->is_repeated()) { // in case of array, the closing bracket will clean up
+            fprintf(file, "            state.location = %d;\n", node.parent->state);
+        }
+        fprintf(file, "            break;\n");
+    }
+
     void printStringImpl(FILE* file, const char* t, const char* c, const std::vector<Node*>& nodes) {
         fprintf(file, "static int %s_parser_impl_parse_string(void *ctx, const unsigned char *v, size_t vLen) {\n", t);
         fprintf(file, "    %s_parser_state_s &state = *static_cast<%s_parser_state_t>(ctx);\n", t, t);
+        printProfileScope(file, t, "string");
+        printSkipCheck(file, t, 0);
         fprintf(file, "    std::string *target = nullptr;\n");
-        fprintf(file, "    switch (state.location) {\n");
-        for (const auto& node : nodes) {
-            assert(node);
-            printStringStateImpl(file, *node);
+        const bool bytes = std::any_of(nodes.begin(), nodes.end(), [](const Node *node) {
+            return node->field->type() == FieldDescriptor::TYPE_BYTES;
+        });
+        if (bytes) {
+            fprintf(file, "    bool base64 = false;\n");
+        }
+        printDispatch(file, t, [&](FILE *file) {
+            for (const auto& node : nodes) {
+                assert(node);
+                printStringStateImpl(file, *node);
+            }
+        }, [&](FILE *file) {
+            fprintf(file, "            return %s_parser_impl_fail(state, %s_parser_error_type);\n", t, t);
+        });
+        if (bytes) {
+            fprintf(file, "    if (base64) {\n");
+            fprintf(file, "        target->clear();\n");
+            fprintf(file, "        if (!%s_parser_base64_decode(reinterpret_cast<const char *>(v), vLen, *target)) {\n", t);
+            fprintf(file, "            return %s_parser_impl_fail(state, %s_parser_error_base64);\n", t, t);
+            fprintf(file, "        }\n");
+            fprintf(file, "        return 1;\n");
+            fprintf(file, "    }\n");
         }
-        fprintf(file, "        default:\n");
-        fprintf(file, "            fprintf(stderr, \"State %%zu does not allow string\\n\", state.location);\n");
-        fprintf(file, "            exit(1);\n");
-        fprintf(file, "    }\n");
         fprintf(file, "    if (target) {\n");
         fprintf(file, "        target->resize(vLen, '\\0');\n");
         fprintf(file, "        memcpy(const_cast<char*>(target->c_str()), v, vLen);\n");
@@ -192,176 +605,335 @@ struct YajlWriter : public Writer {
     void printStringStateImpl(FILE* file, const Node& node) {
         const auto cpp_type = get_full_cpp_type_name(*node.desc);
         const char* verb = node.field->is_repeated() ? "add" : "mutable";
-        fprintf(file, "        case %d: // key %s\n", node.state, node.full_name.c_str());
-        fprintf(file, "            target = static_cast<%s *>(state.msgStack.back())->%s_%s();\n", cpp_type.c_str(), verb, node.name.c_str());
-        if (!node.field->is_repeated()) { // in case of array, the closing bracket will clean up
+        printCase(file, node.state, "key", node.full_name.c_str());
+        if (isMapValue(node)) {
+            fprintf(file, "            target = &%s;\n", getMapSlot(node).c_str());
+        } else {
+            fprintf(file, "            target = static_cast<%s *>(state.msgStack.back())->%s_%s();\n", cpp_type.c_str(), verb, node.name.c_str());
+        }
+        if (node.field->type() == FieldDescriptor::TYPE_BYTES) {
+            fprintf(file, "            base64 = true;\n");
+        }
+        if (!node.field->is_repeated() && !isMapValue(node)) { // in case of array, the closing bracket will clean up
             fprintf(file, "            state.location = %d;\n", node.parent->state);
         }
         fprintf(file, "            break;\n");
     }
 
-    void printMapStartImpl(FILE *file, const std::vector<Node *> &nodes, const char *t, const char *c) {
+    void printMapStartImpl(FILE *file, const Graph &graph, const char *t, const char *c) {
         fprintf(file, "static int %s_parser_impl_parse_start_map(void *ctx) {\n", t);
         fprintf(file, "    %s_parser_state_s &state = *static_cast<%s_parser_state_t>(ctx);\n", t, t);
-        fprintf(file, "    switch (state.location) {\n");
-        for (const auto& node : nodes) {
-            assert(node);
-            printMapStartStateImpl(file, *node, t);
-        }
-        fprintf(file, "        default:\n");
-        fprintf(file, "            fprintf(stderr, \"State %%zu does not allow object\\n\", state.location);\n");
-        fprintf(file, "            exit(1);\n");
-        fprintf(file, "    }\n");
+        printProfileScope(file, t, "start_map");
+        printSkipCheck(file, t, 1);
+        printDispatch(file, t, [&](FILE *file) {
+            for (const auto& node : graph.map_nodes) {
+                assert(node->children.size() == 1);
+                printCase(file, node->state, "key", node->full_name.c_str());
+                fprintf(file, "            state.location = %d;\n", node->children[0]->state);
+                fprintf(file, "            break;\n");
+            }
+            if (graph.shareTypes) {
+                printMapStartStateImpl(file, graph.root, t);
+                for (const auto& node : graph.key_nodes) {
+                    printSharedMapStartStateImpl(file, *node);
+                }
+            } else {
+                for (const auto& node : graph.object_nodes) {
+                    assert(node);
+                    printMapStartStateImpl(file, *node, t);
+                }
+            }
+        }, [&](FILE *file) {
+            fprintf(file, "            return %s_parser_impl_fail(state, %s_parser_error_type);\n", t, t);
+        });
         fprintf(file, "    return 1;\n");
         fprintf(file, "}\n\n");
     }
 
     void printMapStartStateImpl(FILE* file, const Node& node, const char* t) {
         if (!node.parent) {
-            fprintf(file, "        case 0: // map .\n");
+            printCase(file, 0, "map", ".");
             fprintf(file, "            state.location = %d;\n", node.state);
             fprintf(file, "            assert(state.msgStack.empty());\n");
-            fprintf(file, "            state.msgStack.push_back(&state.req);\n");
+            fprintf(file, "            state.msgStack.push_back(state.req);\n");
             fprintf(file, "            break;\n");
         } else {
-            const auto cpp_type = get_full_cpp_type_name(*node.desc);
-            const char* verb = node.field->is_repeated() ? "add" : "mutable";
-            fprintf(file, "        case %d: // map %s\n", node.parent->state, node.full_name.c_str());
+            printCase(file, node.parent->state, "map", node.full_name.c_str());
             fprintf(file, "            state.location = %d;\n", node.state);
-            fprintf(file, "            state.msgStack.push_back(static_cast<%s *>(state.msgStack.back())->%s_%s());\n", cpp_type.c_str(), verb, node.name.c_str());
+            fprintf(file, "            state.msgStack.push_back(%s);\n", getMutableMessage(*node.parent).c_str());
             fprintf(file, "            break;\n");
         }
     }
 
-    void printMapKeyImpl(FILE* file, const char* t, const char* c, const std::vector<Node*>& nodes) {
+    // the key node knows which message to descend into and where to continue afterwards, the object node is shared
+    void printSharedMapStartStateImpl(FILE* file, const Node& node) {
+        assert(node.children.size() == 1);
+        const bool inside = node.parent->type == NodeType::ARRAY || node.parent->type == NodeType::MAP;
+        const int ret = inside ? node.state : node.parent->state;
+        printCase(file, node.state, "map", node.full_name.c_str());
+        fprintf(file, "            state.location = %d;\n", node.children[0]->state);
+        fprintf(file, "            state.msgStack.push_back(%s, %d);\n", getMutableMessage(node).c_str(), ret);
+        fprintf(file, "            break;\n");
+    }
+
+    void printMapKeyImpl(FILE* file, const Graph& graph, const char* t, const char* c) {
+        const auto& nodes = graph.object_nodes;
         fprintf(file, "static int %s_parser_impl_parse_map_key(void *ctx, const unsigned char *key_, size_t keyLen) {\n", t);
-        fprintf(file, "    const auto key = std::string{reinterpret_cast<const char *>(key_), keyLen};\n");
         fprintf(file, "    %s_parser_state_s &state = *static_cast<%s_parser_state_t>(ctx);\n", t, t);
-        fprintf(file, "    const auto hash = std::hash<std::string>()(key);\n");
-        fprintf(file, "    switch (state.location) {\n");
-        for (const auto& node : nodes) {
-            assert(node);
-            printMapKeyStateImpl(file, *node);
-        }
-        fprintf(file, "        default:\n");
-        fprintf(file, "            fprintf(stderr, \"Location %%zu does not allow the key %%s\\n\", state.location, key.c_str());\n");
-        fprintf(file, "            exit(1);\n");
-        fprintf(file, "    }\n");
+        printProfileScope(file, t, "map_key");
+        printSkipCheck(file, t, 0, false);
+        printDispatch(file, t, [&](FILE *file) {
+            for (const auto& node : nodes) {
+                assert(node);
+                printMapKeyStateImpl(file, graph, *node, t);
+            }
+            for (const auto& node : graph.map_nodes) {
+                printMapEntryKeyStateImpl(file, *node->children[0], t);
+            }
+        }, [&](FILE *file) {
+            fprintf(file, "            return %s_parser_impl_fail(state, %s_parser_error_key);\n", t, t);
+        });
         fprintf(file, "    return 1;\n");
         fprintf(file, "}\n\n");
     }
 
-    void printMapKeyStateImpl(FILE* file, const Node& node) {
-        fprintf(file, "        case %d: // map %s\n", node.state, node.full_name.c_str());
-        fprintf(file, "            switch (hash) {\n");
-        for (const auto& child : node.children) {
-            const auto hash = std::hash<std::string>()(child->name);
-            fprintf(file, "                case %zuu: // %s\n", hash, child->name.c_str());
-            fprintf(file, "                    state.location = %d;\n", child->state);
-            fprintf(file, "                    break;\n");
+    void printMapKeyStateImpl(FILE* file, const Graph& graph, const Node& node, const char* t) {
+        const bool earlyExit = !node.parent && hasEarlyExit(graph);
+        printCase(file, node.state, "map", node.full_name.c_str());
+        if (earlyExit) {
+            // the previous value is complete once the next key shows up
+            fprintf(file, "            if (state.seen == UINT64_C(%llu) && !state.config.stream) {\n",
+                    static_cast<unsigned long long>(getEarlyExitMask(graph)));
+            fprintf(file, "                state.done = true;\n");
+            fprintf(file, "                return 0;\n");
+            fprintf(file, "            }\n");
         }
-        fprintf(file, "                default:\n");
-        fprintf(file, "                    fprintf(stderr, \"Invalid key %s for %%s\\n\", key.c_str());\n", node.full_name.c_str());
-        fprintf(file, "                    exit(1);\n");
-        fprintf(file, "            }\n");
-        fprintf(file, "            break;\n");
+        printKeySwitch(file, node.children, "key_", "keyLen", "            ", [&](const Node& child, const std::string& indent) {
+            if (earlyExit) {
+                const auto bit = std::find(node.children.begin(), node.children.end(), &child) - node.children.begin();
+                fprintf(file, "%sstate.seen |= UINT64_C(%llu);\n", indent.c_str(), 1ull << bit);
+            }
+            fprintf(file, "%sstate.location = %d;\n", indent.c_str(), child.state);
+            fprintf(file, "%sreturn 1;\n", indent.c_str());
+        });
+        if (skipUnknown) {
+            fprintf(file, "            state.skipReturn = %d;\n", node.state);
+            fprintf(file, "            state.location = %s_parser_skip_location;\n", t);
+            fprintf(file, "            return 1;\n");
+        } else {
+            fprintf(file, "            return %s_parser_impl_fail(state, %s_parser_error_key);\n", t, t);
+        }
+    }
+
+    // the key of a map entry is kept in the state until its value arrives
+    void printMapEntryKeyStateImpl(FILE* file, const Node& node, const char* t) {
+        const auto &key = getMapKey(node);
+        printCase(file, node.state, "map", node.full_name.c_str());
+        const char *target = getMapKeyMember(key);
+        const char *keyExpr = "reinterpret_cast<const char *>(key_)";
+        auto fail = [&](const std::string &indent) {
+            fprintf(file, "%sreturn %s_parser_impl_fail(state, %s_parser_error_key);\n", indent.c_str(), t, t);
+        };
+        if (key.cpp_type() == FieldDescriptor::CPPTYPE_STRING) {
+            printMapKey(file, key, t, keyExpr, "keyLen", target, "            ", fail);
+        } else {
+            // converted into the declared type first, the cases share one scope
+            fprintf(file, "            {\n");
+            fprintf(file, "                %s k;\n", getMapKeyType(key).c_str());
+            printMapKey(file, key, t, keyExpr, "keyLen", "k", "                ", fail);
+            fprintf(file, "                %s = k;\n", target);
+            fprintf(file, "            }\n");
+        }
+        fprintf(file, "            return 1;\n");
     }
 
-    void printMapEndImpl(FILE* file, const char* t, const char* c, const std::vector<Node*>& nodes) {
+    void printMapEndImpl(FILE* file, const Graph& graph, const char* t, const char* c) {
+        const auto& nodes = graph.object_nodes;
         fprintf(file, "static int %s_parser_impl_parse_end_map(void *ctx) {\n", t);
         fprintf(file, "    %s_parser_state_s &state = *static_cast<%s_parser_state_t>(ctx);\n", t, t);
-        fprintf(file, "    if (state.config.checkInitialized) {\n");
-        fprintf(file, "        state.msgStack.back()->CheckInitialized();\n");
-        fprintf(file, "    }\n");
-        fprintf(file, "    switch (state.location) {\n");
-        for (const auto& node : nodes) {
-            assert(node);
-            printMapEndStateImpl(file, *node);
+        printProfileScope(file, t, "end_map");
+        printSkipCheck(file, t, -1);
+        // only the end of a message is checked, maps end in the state of their value
+        if (graph.fieldMask.empty()) { // required fields might not be part of the mask
+            fprintf(file, "    if (state.config.checkInitialized && %s!state.msgStack.back()->IsInitialized()) {\n",
+                    getMapValueCheck(graph).c_str());
+            fprintf(file, "        return %s_parser_impl_fail(state, %s_parser_error_required);\n", t, t);
+            fprintf(file, "    }\n");
         }
-        fprintf(file, "        default:\n");
-        fprintf(file, "            fprintf(stderr, \"State %%zu does not allow closing object\\n\", state.location);\n");
-        fprintf(file, "            exit(1);\n");
-        fprintf(file, "    }\n");
+        printDispatch(file, t, [&](FILE *file) {
+            for (const auto& node : graph.map_nodes) {
+                printCase(file, node->children[0]->state, "map", node->full_name.c_str());
+                fprintf(file, "            state.location = %d;\n", node->parent->state);
+                fprintf(file, "            break;\n");
+            }
+            for (const auto& node : nodes) {
+                assert(node);
+                if (graph.shareTypes) {
+                    printSharedMapEndStateImpl(file, *node);
+                } else {
+                    printMapEndStateImpl(file, graph, *node);
+                }
+            }
+        }, [&](FILE *file) {
+            fprintf(file, "            return %s_parser_impl_fail(state, %s_parser_error_type);\n", t, t);
+        });
         fprintf(file, "    return 1;\n");
         fprintf(file, "}\n\n");
     }
 
-    void printMapEndStateImpl(FILE* file, const Node& node) {
+    void printMapEndStateImpl(FILE* file, const Graph& graph, const Node& node) {
         if (!node.parent || !node.parent->parent) {
-            fprintf(file, "        case %d: // map .\n", node.state);
+            printCase(file, node.state, "map", ".");
             fprintf(file, "            state.location = 0;\n");
             fprintf(file, "            state.msgStack.pop_back();\n");
             fprintf(file, "            assert(state.msgStack.empty());\n");
+            fprintf(file, "            if (state.callback) {\n");
+            fprintf(file, "                state.callback(*state.req);\n");
+            fprintf(file, "                state.req->Clear();\n");
+            fprintf(file, "            }\n");
             fprintf(file, "            break;\n");
         } else {
             const auto cpp_type = get_full_cpp_type_name(*node.desc);
-            fprintf(file, "        case %d: // map %s\n", node.state, node.full_name.c_str());
+            printCase(file, node.state, "map", node.full_name.c_str());
             assert(node.parent && node.parent->parent);
-            if (node.parent && node.parent->parent && node.parent->parent->type == NodeType::ARRAY) {
+            const auto outer = node.parent->parent->type;
+            if (outer == NodeType::ARRAY || outer == NodeType::MAP) {
                 fprintf(file, "            state.location = %d;\n", node.parent->state);
             } else {
                 fprintf(file, "            state.location = %d;\n", node.parent->parent->state);
             }
+            if (node.parent->parent == graph.elementNode) {
+                // the element is the last one of its field, which belongs to the message below it on the stack
+                const auto element = get_full_cpp_type_name(*node.field->message_type());
+                fprintf(file, "            if (state.elementCallback) {\n");
+                fprintf(file, "                state.elementCallback(*static_cast<%s *>(state.msgStack.back()));\n", element.c_str());
+                fprintf(file, "                state.msgStack.pop_back();\n");
+                fprintf(file, "                static_cast<%s *>(state.msgStack.back())->mutable_%s()->RemoveLast();\n",
+                        cpp_type.c_str(), node.name.c_str());
+                fprintf(file, "                break;\n");
+                fprintf(file, "            }\n");
+            }
             fprintf(file, "            state.msgStack.pop_back();\n");
             fprintf(file, "            break;\n");
         }
     }
 
-    void printArrayStartImpl(FILE* file, const char* t, const char* c, const std::vector<Node*>& nodes) {
+    void printSharedMapEndStateImpl(FILE* file, const Node& node) {
+        printCase(file, node.state, "map", node.full_name.c_str());
+        fprintf(file, "            state.location = state.msgStack.ret();\n");
+        fprintf(file, "            state.msgStack.pop_back();\n");
+        if (!node.parent) { // the root type might be nested into itself
+            fprintf(file, "            if (state.msgStack.empty() && state.callback) {\n");
+            fprintf(file, "                state.callback(*state.req);\n");
+            fprintf(file, "                state.req->Clear();\n");
+            fprintf(file, "            }\n");
+        }
+        fprintf(file, "            break;\n");
+    }
+
+    void printArrayStartImpl(FILE* file, const Graph &graph, const char* t, const char* c) {
         fprintf(file, "static int %s_parser_impl_parse_start_array(void *ctx) {\n", t);
         fprintf(file, "    %s_parser_state_s &state = *static_cast<%s_parser_state_t>(ctx);\n", t, t);
-        fprintf(file, "    switch (state.location) {\n");
-        for (const auto& node : nodes) {
-            assert(node);
-            printArrayStartStateImpl(file, *node);
-        }
-        fprintf(file, "        default:\n");
-        fprintf(file, "            fprintf(stderr, \"State %%zu does not allow array\\n\", state.location);\n");
-        fprintf(file, "            exit(1);\n");
-        fprintf(file, "    }\n");
+        printProfileScope(file, t, "start_array");
+        printSkipCheck(file, t, 1);
+        printDispatch(file, t, [&](FILE *file) {
+            for (const auto& node : graph.array_nodes) {
+                assert(node);
+                printArrayStartStateImpl(file, graph, *node, t);
+            }
+        }, [&](FILE *file) {
+            fprintf(file, "            return %s_parser_impl_fail(state, %s_parser_error_type);\n", t, t);
+        });
         fprintf(file, "    return 1;\n");
         fprintf(file, "}\n\n");
     }
 
-    void printArrayStartStateImpl(FILE* file, const Node& node) {
+    void printArrayStartStateImpl(FILE* file, const Graph &graph, const Node& node, const char* t) {
         assert(node.children.size() == 1);
-        fprintf(file, "        case %d: // key %s\n", node.state, node.full_name.c_str());
+        printCase(file, node.state, "key", node.full_name.c_str());
+        printReserveHint(file, graph, node, t, getCurrentMessage(node), "            ");
         fprintf(file, "            state.location = %d;\n", node.children[0]->state);
         fprintf(file, "            break;\n");
     }
 
-    void printArrayEndImpl(FILE* file, const char* t, const char* c, const std::vector<Node*>& nodes) {
+    void printArrayEndImpl(FILE* file, const Graph &graph, const char* t, const char* c) {
         fprintf(file, "static int %s_parser_impl_parse_end_array(void *ctx) {\n", t);
         fprintf(file, "    %s_parser_state_s &state = *static_cast<%s_parser_state_t>(ctx);\n", t, t);
-        fprintf(file, "    switch (state.location) {\n");
-        for (const auto& node : nodes) {
-            assert(node);
-            printArrayEndStateImpl(file, *node);
-        }
-        fprintf(file, "        default:\n");
-        fprintf(file, "            fprintf(stderr, \"State %%zu does not allow closing array\\n\", state.location);\n");
-        fprintf(file, "            exit(1);\n");
-        fprintf(file, "    }\n");
+        printProfileScope(file, t, "end_array");
+        printSkipCheck(file, t, -1);
+        printDispatch(file, t, [&](FILE *file) {
+            for (const auto& node : graph.array_nodes) {
+                assert(node);
+                printArrayEndStateImpl(file, graph, *node, t);
+            }
+        }, [&](FILE *file) {
+            fprintf(file, "            return %s_parser_impl_fail(state, %s_parser_error_type);\n", t, t);
+        });
         fprintf(file, "    return 1;\n");
         fprintf(file, "}\n\n");
     }
 
-    void printArrayEndStateImpl(FILE* file, const Node& node) {
+    void printArrayEndStateImpl(FILE* file, const Graph &graph, const Node& node, const char* t) {
         // TODO: fix arrays in root object case?!
         assert(node.parent);
         assert(node.children.size() == 1);
-        fprintf(file, "        case %d: // key %s\n", node.children[0]->state, node.full_name.c_str());
+        printCase(file, node.children[0]->state, "key", node.full_name.c_str());
+        printUpdateHint(file, graph, node, t, getCurrentMessage(node), "            ");
         fprintf(file, "            state.location = %d;\n", node.parent->state);
         fprintf(file, "            break;\n");
     }
 
+    // message holding the field of node, the innermost one being parsed
+    static std::string getCurrentMessage(const Node &node) {
+        return "static_cast<" + get_full_cpp_type_name(*node.desc) + " *>(state.msgStack.back())";
+    }
+
+    // message to descend into for the key node of a message field
+    std::string getMutableMessage(const Node &node) {
+        if (isMapValue(node)) {
+            return "&" + getMapSlot(node);
+        }
+        const auto cpp_type = get_full_cpp_type_name(*node.desc);
+        const char* verb = node.field->is_repeated() ? "add" : "mutable";
+        return "static_cast<" + cpp_type + " *>(state.msgStack.back())->" + verb + "_" + node.name + "()";
+    }
+
+    // entry of the current key in the map of a map value node, inserted if missing
+    std::string getMapSlot(const Node &node) {
+        const auto cpp_type = get_full_cpp_type_name(*node.desc);
+        const auto &key = getMapKey(node);
+        const bool cast = key.cpp_type() != FieldDescriptor::CPPTYPE_STRING;
+        return "(*static_cast<" + cpp_type + " *>(state.msgStack.back())->mutable_" + node.name + "())[" +
+               (cast ? "static_cast<" + getMapKeyType(key) + ">(" : std::string("")) + getMapKeyMember(key) + (cast ? ")]" : "]");
+    }
+
+    static const char *getMapKeyMember(const FieldDescriptor &key) {
+        switch (key.cpp_type()) {
+            case FieldDescriptor::CPPTYPE_STRING:
+                return "state.mapKey";
+            case FieldDescriptor::CPPTYPE_INT32:
+            case FieldDescriptor::CPPTYPE_INT64:
+                return "state.mapKeyInt";
+            default:
+                return "state.mapKeyUint";
+        }
+    }
+
+    static std::string getMapValueCheck(const Graph &graph) {
+        std::string check;
+        for (const auto &node : graph.map_nodes) {
+            check += "state.location != " + std::to_string(node->children[0]->state) + " && ";
+        }
+        return check;
+    }
+
     void printYajlCallbacks(FILE *file, const char *t) {
         fprintf(file, "static yajl_callbacks %s_parser_impl_callbacks = {\n", t);
         fprintf(file, "        %s_parser_impl_parse_null,\n", t);
         fprintf(file, "        %s_parser_impl_parse_boolean,\n", t);
-        fprintf(file, "        %s_parser_impl_parse_integer,\n", t);
-        fprintf(file, "        %s_parser_impl_parse_double,\n", t);
-        fprintf(file, "        NULL, //number,\n");
+        fprintf(file, "        NULL, // integer\n");
+        fprintf(file, "        NULL, // double\n");
+        fprintf(file, "        %s_parser_impl_parse_number,\n", t);
         fprintf(file, "        %s_parser_impl_parse_string,\n", t);
         fprintf(file, "        %s_parser_impl_parse_start_map,\n", t);
         fprintf(file, "        %s_parser_impl_parse_map_key,\n", t);
@@ -371,44 +943,102 @@ struct YajlWriter : public Writer {
         fprintf(file, "};\n\n");
     }
 
+    void printHandleImpl(FILE *file, const char *t) {
+        fprintf(file, "// (re)creates the yajl handle of the state, all of its memory comes from state.alloc\n");
+        fprintf(file, "static void %s_parser_impl_open(%s_parser_state_s &state) {\n", t, t);
+        fprintf(file, "    if (state.handle) {\n");
+        fprintf(file, "        yajl_free(state.handle);\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    %s_parser_alloc_rewind(state.alloc);\n", t);
+        fprintf(file, "    yajl_alloc_funcs afs = {\n");
+        fprintf(file, "        %s_parser_alloc_malloc,\n", t);
+        fprintf(file, "        %s_parser_alloc_realloc,\n", t);
+        fprintf(file, "        %s_parser_alloc_free,\n", t);
+        fprintf(file, "        &state.alloc,\n");
+        fprintf(file, "    };\n");
+        fprintf(file, "    yajl_handle handle = yajl_alloc(&%s_parser_impl_callbacks, &afs, &state);\n", t);
+        fprintf(file, "    yajl_config(handle, yajl_allow_comments, state.config.allowComments);\n");
+        fprintf(file, "    yajl_config(handle, yajl_dont_validate_strings, 1); // see %s_parser_impl_check_utf8\n", t);
+        fprintf(file, "    yajl_config(handle, yajl_allow_trailing_garbage, state.config.allowTrailingGarbage);\n");
+        fprintf(file, "    yajl_config(handle, yajl_allow_multiple_values, state.config.stream);\n");
+        fprintf(file, "    yajl_config(handle, yajl_allow_partial_values, 0);\n");
+        fprintf(file, "    state.handle = handle;\n");
+        fprintf(file, "}\n\n");
+    }
+
     void printApiImpl(FILE *file, const char *t, const char *c) {
-        fprintf(file, "%s %s_parser_easy(const std::string &json) {\n", c, t);
-        fprintf(file, "    return %s_parser_easy(json.c_str(), json.size());\n", t);
-        fprintf(file, "}\n");
-        fprintf(file, "\n");
-        fprintf(file, "%s %s_parser_easy(const char *buf, size_t bufLen) {\n", c, t);
-        fprintf(file, "    %s msg;\n", c);
-        fprintf(file, "    %s_parser_state_t state = %s_parser_init(msg);\n", t, t);
+        fprintf(file, "static void %s_parser_impl_easy(%s &msg, const char *buf, size_t bufLen) {\n", t, c);
+        fprintf(file, "    %s_parser_state_t state = %s_parser_acquire(msg);\n", t, t);
         fprintf(file, "\n");
         fprintf(file, "    int rc = %s_parser_on_chunk(state, const_cast<char*>(buf), bufLen);\n", t);
+        fprintf(file, "    if (rc == 0) {\n");
+        fprintf(file, "        rc = %s_parser_complete(state);\n", t);
+        fprintf(file, "    }\n");
         fprintf(file, "    if (rc != 0) {\n");
         fprintf(file, "        char *err = %s_parser_get_error(state);\n", t);
-        fprintf(file, "        throw std::runtime_error(err);\n");
+        fprintf(file, "        std::runtime_error ex(err);\n");
+        fprintf(file, "        %s_parser_free_error(state, err);\n", t);
+        fprintf(file, "        %s_parser_release(state);\n", t);
+        fprintf(file, "        throw ex;\n");
         fprintf(file, "    }\n");
         fprintf(file, "\n");
-        fprintf(file, "    rc = %s_parser_complete(state);\n", t);
-        fprintf(file, "    if (rc != 0) {\n");
-        fprintf(file, "        char *err = %s_parser_get_error(state);\n", t);
-        fprintf(file, "        throw std::runtime_error(err);\n");
+        fprintf(file, "    %s_parser_release(state);\n", t);
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "int %s_parser_try_easy(%s &msg, const char *buf, size_t bufLen, %s_parser_error_s *error) {\n", t, c, t);
+        fprintf(file, "    %s_parser_state_t state = %s_parser_acquire(msg);\n", t, t);
+        fprintf(file, "    int rc = %s_parser_on_chunk(state, const_cast<char*>(buf), bufLen);\n", t);
+        fprintf(file, "    if (rc == 0) {\n");
+        fprintf(file, "        rc = %s_parser_complete(state);\n", t);
         fprintf(file, "    }\n");
+        fprintf(file, "    if (rc != 0 && error) {\n");
+        fprintf(file, "        *error = state->error;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    %s_parser_release(state);\n", t);
+        fprintf(file, "    return rc;\n");
+        fprintf(file, "}\n");
         fprintf(file, "\n");
-        fprintf(file, "    %s_parser_free(state);\n", t);
+        fprintf(file, "%s %s_parser_easy(const std::string &json) {\n", c, t);
+        fprintf(file, "    return %s_parser_easy(json.c_str(), json.size());\n", t);
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "%s %s_parser_easy(const char *buf, size_t bufLen) {\n", c, t);
+        fprintf(file, "    %s msg;\n", c);
+        fprintf(file, "    %s_parser_impl_easy(msg, buf, bufLen);\n", t);
+        fprintf(file, "    return msg;\n");
+        fprintf(file, "}\n");
         fprintf(file, "\n");
+        fprintf(file, "%s *%s_parser_easy_arena(::google::protobuf::Arena *arena, const std::string &json) {\n", c, t);
+        fprintf(file, "    return %s_parser_easy_arena(arena, json.c_str(), json.size());\n", t);
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "%s *%s_parser_easy_arena(::google::protobuf::Arena *arena, const char *buf, size_t bufLen) {\n", c, t);
+        fprintf(file, "    %s *msg = ::google::protobuf::Arena::CreateMessage<%s>(arena);\n", c, c);
+        fprintf(file, "    %s_parser_impl_easy(*msg, buf, bufLen);\n", t);
         fprintf(file, "    return msg;\n");
         fprintf(file, "}\n");
         fprintf(file, "\n");
         fprintf(file, "%s_parser_state_t %s_parser_init(%s &msg) {\n", t, t, c);
         fprintf(file, "    %s_parser_state_t state = new %s_parser_state_s(msg);\n", t, t);
         fprintf(file, "    state->config.checkInitialized = true;\n");
+        fprintf(file, "    state->config.stream = false;\n");
+        fprintf(file, "    %s_parser_impl_open(*state);\n", t);
+        fprintf(file, "    return state;\n");
+        fprintf(file, "}\n");
         fprintf(file, "\n");
-        fprintf(file, "    yajl_handle handle = yajl_alloc(&%s_parser_impl_callbacks, NULL, state);\n", t);
-        fprintf(file, "    yajl_config(handle, yajl_allow_comments, 0);\n");
-        fprintf(file, "    yajl_config(handle, yajl_dont_validate_strings, 0);\n");
-        fprintf(file, "    yajl_config(handle, yajl_allow_trailing_garbage, 0);\n");
-        fprintf(file, "    yajl_config(handle, yajl_allow_multiple_values, 0);\n");
-        fprintf(file, "    yajl_config(handle, yajl_allow_partial_values, 0);\n");
-        fprintf(file, "    state->handle = handle;\n");
+        fprintf(file, "%s_parser_state_t %s_parser_init(%s &msg, const %s_parser_config &config) {\n", t, t, c, t);
+        fprintf(file, "    %s_parser_state_t state = new %s_parser_state_s(msg);\n", t, t);
+        fprintf(file, "    static_cast<%s_parser_config &>(state->config) = config;\n", t);
+        fprintf(file, "    %s_parser_impl_open(*state);\n", t);
+        fprintf(file, "    return state;\n");
+        fprintf(file, "}\n");
         fprintf(file, "\n");
+        fprintf(file, "%s_parser_state_t %s_stream_init(%s &msg, %s_stream_callback callback) {\n", t, t, c, t);
+        fprintf(file, "    %s_parser_state_t state = new %s_parser_state_s(msg);\n", t, t);
+        fprintf(file, "    state->config.checkInitialized = true;\n");
+        fprintf(file, "    state->config.stream = true;\n");
+        fprintf(file, "    state->callback = std::move(callback);\n");
+        fprintf(file, "    %s_parser_impl_open(*state);\n", t);
         fprintf(file, "    return state;\n");
         fprintf(file, "}\n");
         fprintf(file, "\n");
@@ -418,6 +1048,7 @@ struct YajlWriter : public Writer {
         fprintf(file, "        if (state->handle) {\n");
         fprintf(file, "            yajl_free(state->handle);\n");
         fprintf(file, "        }\n");
+        fprintf(file, "        free(state->alloc.region);\n");
         fprintf(file, "        delete state;\n");
         fprintf(file, "    }\n");
         fprintf(file, "}\n");
@@ -426,15 +1057,41 @@ struct YajlWriter : public Writer {
         fprintf(file, "    assert(state);\n");
         fprintf(file, "    assert(state->handle);\n");
         fprintf(file, "    const unsigned char *uChunk = reinterpret_cast<const unsigned char *>(chunk);\n");
+        fprintf(file, "    if (state->done) {\n");
+        fprintf(file, "        return 0;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    if (state->config.validateUtf8) {\n");
+        fprintf(file, "        const size_t invalid = %s_parser_impl_check_utf8(*state, chunk, chunkLen);\n", t);
+        fprintf(file, "        if (invalid != static_cast<size_t>(-1)) {\n");
+        fprintf(file, "            %s_parser_impl_fail(*state, %s_parser_error_utf8);\n", t, t);
+        fprintf(file, "            state->error.offset = invalid;\n");
+        fprintf(file, "            return 1;\n");
+        fprintf(file, "        }\n");
+        fprintf(file, "    }\n");
         fprintf(file, "    int stat = yajl_parse(state->handle, uChunk, chunkLen);\n");
-        fprintf(file, "    return stat != yajl_status_ok;\n");
+        fprintf(file, "    if (stat != yajl_status_ok && !state->done) {\n");
+        fprintf(file, "        return %s_parser_impl_error(*state, yajl_get_bytes_consumed(state->handle));\n", t);
+        fprintf(file, "    }\n");
+        fprintf(file, "    state->consumed += chunkLen;\n");
+        fprintf(file, "    return 0;\n");
         fprintf(file, "}\n");
         fprintf(file, "\n");
         fprintf(file, "int %s_parser_complete(%s_parser_state_t state) {\n", t, t);
         fprintf(file, "    assert(state);\n");
         fprintf(file, "    assert(state->handle);\n");
+        fprintf(file, "    if (state->done) {\n");
+        fprintf(file, "        return 0;\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    if (state->utf8TailLen > 0) {\n");
+        fprintf(file, "        %s_parser_impl_fail(*state, %s_parser_error_utf8);\n", t, t);
+        fprintf(file, "        state->error.offset = state->consumed - state->utf8TailLen;\n");
+        fprintf(file, "        return 1;\n");
+        fprintf(file, "    }\n");
         fprintf(file, "    int stat = yajl_complete_parse(state->handle);\n");
-        fprintf(file, "    return stat != yajl_status_ok;\n");
+        fprintf(file, "    if (stat != yajl_status_ok && !state->done) {\n");
+        fprintf(file, "        return %s_parser_impl_error(*state, 0);\n", t);
+        fprintf(file, "    }\n");
+        fprintf(file, "    return 0;\n");
         fprintf(file, "}\n");
         fprintf(file, "\n");
         fprintf(file, "int %s_parser_reset(%s_parser_state_t state) {\n", t, t);
@@ -442,10 +1099,26 @@ struct YajlWriter : public Writer {
         fprintf(file, "    assert(state->handle);\n");
         fprintf(file, "    if (state && state->handle) {\n");
         fprintf(file, "        state->reset();\n");
+        fprintf(file, "        %s_parser_impl_open(*state);\n", t);
         fprintf(file, "    }\n");
         fprintf(file, "    return 0;\n");
         fprintf(file, "}\n");
         fprintf(file, "\n");
+        fprintf(file, "int %s_parser_rebind(%s_parser_state_t state, %s &msg) {\n", t, t, c);
+        fprintf(file, "    assert(state);\n");
+        fprintf(file, "    state->req = &msg;\n");
+        fprintf(file, "    state->location = 0;\n");
+        fprintf(file, "    state->skipDepth = 0;\n");
+        fprintf(file, "    state->seen = 0;\n");
+        fprintf(file, "    state->done = false;\n");
+        fprintf(file, "    state->consumed = 0;\n");
+        fprintf(file, "    state->utf8TailLen = 0;\n");
+        fprintf(file, "    state->error = {};\n");
+        fprintf(file, "    state->msgStack.clear();\n");
+        fprintf(file, "    %s_parser_impl_open(*state);\n", t);
+        fprintf(file, "    return 0;\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
         fprintf(file, "char *%s_parser_get_error(%s_parser_state_t state) {\n", t, t);
         fprintf(file, "    return %s_parser_get_error(state, 0, 0, 0);\n", t);
         fprintf(file, "}\n");
@@ -454,41 +1127,29 @@ struct YajlWriter : public Writer {
         fprintf(file, "                                  size_t chunkLen) {\n");
         fprintf(file, "    assert(state);\n");
         fprintf(file, "    assert(state->handle);\n");
-        fprintf(file, "    const unsigned char *uChunk = reinterpret_cast<const unsigned char *>(chunk);\n");
-        fprintf(file, "    unsigned char *err = nullptr;\n");
-        fprintf(file, "    if (state && state->handle) {\n");
-        fprintf(file, "        err = yajl_get_error(state->handle, verbose, uChunk, chunkLen);\n");
+        fprintf(file, "    const %s_parser_error_s &error = state->error;\n", t);
+        fprintf(file, "    if (error.code != %s_parser_error_none && error.code != %s_parser_error_syntax) {\n", t, t);
+        fprintf(file, "        const std::string err = std::string(\"parse error: \") + %s_parser_error_string(error.code) + \" at offset \" +\n", t);
+        fprintf(file, "                                std::to_string(error.offset) + \" in state \" + std::to_string(error.state) + \"\\n\";\n");
+        fprintf(file, "        return strdup(err.c_str());\n");
         fprintf(file, "    }\n");
-        fprintf(file, "    return reinterpret_cast<char *>(err);\n");
+        fprintf(file, "    const unsigned char *uChunk = reinterpret_cast<const unsigned char *>(chunk);\n");
+        fprintf(file, "    unsigned char *yajlErr = yajl_get_error(state->handle, verbose, uChunk, chunkLen);\n");
+        fprintf(file, "    char *err = strdup(reinterpret_cast<char *>(yajlErr));\n");
+        fprintf(file, "    yajl_free_error(state->handle, yajlErr);\n");
+        fprintf(file, "    return err;\n");
         fprintf(file, "}\n");
         fprintf(file, "\n");
         fprintf(file, "void %s_parser_free_error(%s_parser_state_t state, char *err) {\n", t, t);
+        fprintf(file, "    free(err);\n");
+        fprintf(file, "}\n");
+        fprintf(file, "\n");
+        fprintf(file, "%s_parser_error_s %s_parser_last_error(%s_parser_state_t state) {\n", t, t, t);
         fprintf(file, "    assert(state);\n");
-        fprintf(file, "    assert(state->handle);\n");
-        fprintf(file, "    if (state && state->handle) {\n");
-        fprintf(file, "        yajl_free_error(state->handle, reinterpret_cast<unsigned char *>(err));\n");
-        fprintf(file, "    }\n");
-        fprintf(file, "}\n\n");
-    }
-
-    void printNamespaceBegin(FILE *file, const Graph &graph) {
-        const auto ns = split(graph.fileDesc->package(), '.');
-        for (auto it = ns.begin(); it != ns.end(); ++it) {
-            fprintf(file, "namespace %s {\n", it->c_str());
-        }
+        fprintf(file, "    return state->error;\n");
+        fprintf(file, "}\n");
         fprintf(file, "\n");
-    }
-
-    void printNamespaceEnd(FILE *file, const Graph &graph) {
-        const auto ns = split(graph.fileDesc->package(), '.');
-        for (auto it = ns.rbegin(); it != ns.rend(); ++it) {
-            fprintf(file, "} // namespace %s\n", it->c_str());
-        }
-    }
-
-    template <typename Descriptor>
-    static std::string get_full_cpp_type_name(const Descriptor& desc) {
-        return "::" + replace_all(desc.full_name(), ".", "::");
+        printErrorStringImpl(file, t);
     }
 };
 
@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "exportmessage_parser.pb.h"
+#include "messages.pb.h"
+
+namespace protog {
+namespace test {
+
+TEST(export_message, should_pass_elements_to_callback) {
+    std::string json = R"*({"id":"x","records":[{"a":"r1"},{"a":"r2","b":[1,2]},{}],"count":3})*";
+    ExportMessage msg;
+    std::vector<std::string> records;
+    auto state = exportmessage_parser_init(msg);
+    exportmessage_parser_set_element_callback(state, [&](NestedMessage::InnerMessage &record) {
+        records.push_back(record.a() + ":" + std::to_string(record.b_size()));
+    });
+    ASSERT_EQ(0, exportmessage_parser_on_chunk(state, &json[0], json.size()));
+    ASSERT_EQ(0, exportmessage_parser_complete(state));
+    ASSERT_EQ((std::vector<std::string>{"r1:0", "r2:2", ":0"}), records);
+    ASSERT_EQ("x", msg.id());
+    ASSERT_EQ(3, msg.count());
+    ASSERT_EQ(0, msg.records_size());
+    exportmessage_parser_free(state);
+}
+
+TEST(export_message, should_keep_elements_without_callback) {
+    const auto msg = exportmessage_parser_easy(R"*({"records":[{"a":"r1"},{"a":"r2"}]})*");
+    ASSERT_EQ(2, msg.records_size());
+    ASSERT_EQ("r2", msg.records(1).a());
+}
+
+TEST(export_message, should_recycle_elements) {
+    std::string json = R"*({"records":[)*";
+    for (int i = 0; i < 10000; ++i) {
+        json += std::string(i ? "," : "") + R"*({"a":"record","b":[)*" + std::to_string(i) + "]}";
+    }
+    json += "]}";
+    ExportMessage msg;
+    int count = 0;
+    double sum = 0;
+    auto state = exportmessage_parser_init(msg);
+    exportmessage_parser_set_element_callback(state, [&](NestedMessage::InnerMessage &record) {
+        ++count;
+        sum += record.b(0);
+    });
+    ASSERT_EQ(0, exportmessage_parser_on_chunk(state, &json[0], json.size()));
+    ASSERT_EQ(0, exportmessage_parser_complete(state));
+    ASSERT_EQ(10000, count);
+    ASSERT_EQ(49995000, sum);
+    ASSERT_EQ(0, msg.records_size());
+    ASSERT_LT(msg.records().Capacity(), 16);
+    exportmessage_parser_free(state);
+}
+
+} // namespace test
+} // namespace protog
@@ -0,0 +1,66 @@
+#include <gtest/gtest.h>
+
+#include <google/protobuf/util/message_differencer.h>
+
+#include <string>
+
+#include "mapmessage_inline.pb.h"
+#include "mapmessage_parser.pb.h"
+#include "messages.pb.h"
+#include "nestedmessage_inline.pb.h"
+#include "nestedmessage_parser.pb.h"
+#include "simplemessage_inline.pb.h"
+#include "treemessage_inline.pb.h"
+#include "treemessage_parser.pb.h"
+#include "wiremessage_inline.pb.h"
+#include "wiremessage_parser.pb.h"
+
+namespace protog {
+namespace test {
+
+template <typename Msg>
+Msg parse_inline(const std::string &json) {
+    Msg msg;
+    parse_error error;
+    EXPECT_EQ(0, parse(msg, json.data(), json.size(), &error)) << error.message;
+    return msg;
+}
+
+TEST(inline, should_match_message_parser) {
+    const std::string nested = R"*({"id":"a","my_inner":{"a":"b","b":[1.5,-2]},"my_list":[{"a":"c"},{}]})*";
+    ASSERT_EQ(nestedmessage_parser_easy(nested).SerializeAsString(),
+              parse_inline<NestedMessage>(nested).SerializeAsString());
+
+    const std::string wire = R"*({"my_sint64":-4000000000,"my_float":0.25,"my_bool":true,"kind":1,)*"
+                             R"*("my_uint32":4294967295,"packed":[1,-1,300],"blobs":["Zm9vYg==",""]})*";
+    ASSERT_EQ(wiremessage_parser_easy(wire).SerializeAsString(), parse_inline<WireMessage>(wire).SerializeAsString());
+
+    const std::string tree = R"*({"name":"a","children":[{"left":{"name":"b"}},{}],"first":{"b":[1]}})*";
+    ASSERT_EQ(treemessage_parser_easy(tree).SerializeAsString(), parse_inline<TreeMessage>(tree).SerializeAsString());
+
+    const std::string map = R"*({"counts":{"a":1},"names":{"-5":"x"},"inners":{"9":{"b":[1]}},"kinds":{"2":1}})*";
+    ASSERT_TRUE(google::protobuf::util::MessageDifferencer::Equals(mapmessage_parser_easy(map),
+                                                                    parse_inline<MapMessage>(map)));
+}
+
+TEST(inline, should_report_errors) {
+    const std::string json = R"*({"id":"a","my_inner":{"a":1}})*";
+    NestedMessage msg;
+    parse_error error;
+    ASSERT_EQ(1, parse(msg, json.data(), json.size(), &error));
+    ASSERT_EQ(parse_error_type, error.code);
+    ASSERT_EQ(26u, error.offset);
+    ASSERT_STREQ(".my_inner.", parse_state_name<NestedMessage>(error.state));
+    ASSERT_EQ(nullptr, parse_state_name<NestedMessage>(1000));
+
+    const std::string garbage = R"*({"id":"a"} x)*";
+    SimpleMessage simple;
+    ASSERT_EQ(1, parse(simple, garbage.data(), garbage.size()));
+    parse_config config;
+    config.allowTrailingGarbage = true;
+    ASSERT_EQ(0, parse(simple, garbage.data(), garbage.size(), nullptr, config));
+    ASSERT_EQ("a", simple.id());
+}
+
+} // namespace test
+} // namespace protog
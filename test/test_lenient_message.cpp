@@ -0,0 +1,54 @@
+#include <gtest/gtest.h>
+
+#include "lenientmessage_parser.pb.h"
+#include "messages.pb.h"
+
+namespace protog {
+namespace test {
+
+TEST(lenient_message, should_skip_unknown_keys) {
+    const auto json = R"*({
+        "unknown_string": "with \"escaped\" quotes and } brackets ]",
+        "id": "foo",
+        "unknown_number": -1.5e3,
+        "unknown_literals": [true, false, null],
+        "inner": { "a": "bar", "ext": { "deeply": [{ "nested": [[], {}] }] }, "b": [1, 2] },
+        "unknown_object": { "id": "not me", "values": [42] },
+        "values": [1, 2, 3],
+        "unknown_empty": {}
+    })*";
+    const auto msg = lenientmessage_parser_easy(json);
+    ASSERT_EQ("foo", msg.id());
+    ASSERT_EQ("bar", msg.inner().a());
+    ASSERT_EQ(2, msg.inner().b_size());
+    ASSERT_EQ(3, msg.values_size());
+    ASSERT_EQ(3, msg.values(2));
+}
+
+TEST(lenient_message, should_fail_on_truncated_unknown_value) {
+    ASSERT_THROW(lenientmessage_parser_easy(R"*({ "unknown": { "a": [1, 2 )*"), std::runtime_error);
+    ASSERT_THROW(lenientmessage_parser_easy(R"*({ "unknown": "abc)*"), std::runtime_error);
+}
+
+TEST(lenient_message, should_fail_on_malformed_unknown_value) {
+    for (const char *unknown : {"garbage", "{]", "[1,2}", "{\"k\" 1 2 3}", "tru", "nul", "-", "1.", "[1 2]", "{\"k\":1 \"l\":2}",
+                                "{\"k\"}", "{1:2}", "[1,]", "{\"k\":1,}", "\"\\q\"", "[{]}", "/* c */ 1"}) {
+        const std::string json = std::string(R"*({"unknown": )*") + unknown + R"*(, "id": "a"})*";
+        ASSERT_THROW(lenientmessage_parser_easy(json), std::runtime_error) << unknown;
+    }
+}
+
+TEST(lenient_message, should_allow_comments_in_unknown_value) {
+    std::string json = "{\"unknown\": [1, /* a */ {\"k\" // b\n : true}], \"id\": \"a\"}";
+    lenientmessage_parser_config config;
+    config.allowComments = true;
+    LenientMessage msg;
+    auto state = lenientmessage_parser_init(msg, config);
+    ASSERT_EQ(0, lenientmessage_parser_on_chunk(state, &json[0], json.size()));
+    ASSERT_EQ(0, lenientmessage_parser_complete(state));
+    lenientmessage_parser_free(state);
+    ASSERT_EQ("a", msg.id());
+}
+
+} // namespace test
+} // namespace protog
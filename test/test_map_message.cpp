@@ -0,0 +1,63 @@
+#include <gtest/gtest.h>
+
+#include <stdexcept>
+#include <string>
+
+#include "mapmessage_parser.pb.h"
+#include "messages.pb.h"
+
+namespace protog {
+namespace test {
+
+TEST(map_message, should_parse_maps) {
+    const auto json = R"*({
+        "id": "maps",
+        "counts": { "a": 1, "b": -2, "": 3 },
+        "names": { "-9000000000": "neg", "7": "seven" },
+        "inners": { "1": { "a": "x", "b": [0.5] }, "4294967295": {} },
+        "flags": { "true": 1.5, "false": -1 },
+        "blobs": { "foo": "Zm9vYg==" },
+        "kinds": { "-3": 1 }
+    })*";
+    const auto msg = mapmessage_parser_easy(json);
+    ASSERT_EQ("maps", msg.id());
+    ASSERT_EQ(3u, msg.counts().size());
+    ASSERT_EQ(-2, msg.counts().at("b"));
+    ASSERT_EQ(3, msg.counts().at(""));
+    ASSERT_EQ("neg", msg.names().at(-9000000000LL));
+    ASSERT_EQ("seven", msg.names().at(7));
+    ASSERT_EQ("x", msg.inners().at(1).a());
+    ASSERT_EQ(0.5, msg.inners().at(1).b(0));
+    ASSERT_EQ(1u, msg.inners().count(4294967295u));
+    ASSERT_EQ(1.5, msg.flags().at(true));
+    ASSERT_EQ(-1, msg.flags().at(false));
+    ASSERT_EQ("foob", msg.blobs().at("foo"));
+    ASSERT_EQ(WireMessage::SECOND, msg.kinds().at(-3));
+}
+
+TEST(map_message, should_keep_last_duplicate_key) {
+    const auto msg = mapmessage_parser_easy(R"*({"counts":{"a":1,"a":2},"inners":{"1":{"a":"x"},"1":{"b":[1]}}})*");
+    ASSERT_EQ(1u, msg.counts().size());
+    ASSERT_EQ(2, msg.counts().at("a"));
+    ASSERT_EQ(1u, msg.inners().size());
+    ASSERT_EQ(1, msg.inners().at(1).b_size());
+}
+
+TEST(map_message, should_parse_empty_and_null_maps) {
+    const auto msg = mapmessage_parser_easy(R"*({"counts":{},"names":null,"inners":{"2":{}}})*");
+    ASSERT_TRUE(msg.counts().empty());
+    ASSERT_TRUE(msg.names().empty());
+    ASSERT_EQ(1u, msg.inners().size());
+}
+
+TEST(map_message, should_fail_on_invalid_keys) {
+    EXPECT_THROW(mapmessage_parser_easy(R"*({"names":{"x":"a"}})*"), std::runtime_error);
+    EXPECT_THROW(mapmessage_parser_easy(R"*({"names":{"1.5":"a"}})*"), std::runtime_error);
+    EXPECT_THROW(mapmessage_parser_easy(R"*({"inners":{"-1":{}}})*"), std::runtime_error);
+    EXPECT_THROW(mapmessage_parser_easy(R"*({"flags":{"1":1}})*"), std::runtime_error);
+    EXPECT_THROW(mapmessage_parser_easy(R"*({"counts":{"a":"b"}})*"), std::runtime_error);
+    EXPECT_THROW(mapmessage_parser_easy(R"*({"counts":[1]})*"), std::runtime_error);
+}
+
+} // namespace test
+} // namespace protog
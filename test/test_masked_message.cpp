@@ -0,0 +1,37 @@
+#include <gtest/gtest.h>
+
+#include "maskedmessage_parser.pb.h"
+#include "messages.pb.h"
+
+namespace protog {
+namespace test {
+
+TEST(masked_message, should_only_parse_selected_fields) {
+    const auto json = R"*({
+        "ignored": "foo",
+        "inner": { "a": "bar", "b": [1, 2] },
+        "unknown": { "id": "baz" },
+        "list": [{ "a": "qux", "b": [3] }, {}],
+        "id": "id"
+    })*";
+    const auto msg = maskedmessage_parser_easy(json);
+    ASSERT_EQ("id", msg.id());
+    ASSERT_EQ("bar", msg.inner().a());
+    ASSERT_EQ(0, msg.inner().b_size());
+    ASSERT_EQ(2, msg.list_size());
+    ASSERT_FALSE(msg.list(0).has_a());
+    ASSERT_EQ(3, msg.list(0).b(0));
+    ASSERT_FALSE(msg.has_ignored());
+    ASSERT_FALSE(msg.IsInitialized());
+}
+
+TEST(masked_message, should_stop_once_all_selected_fields_are_parsed) {
+    const auto json = R"*({ "list": [], "inner": { "a": "bar" }, "id": "id", "ignored": "foo", this is never looked at)*";
+    const auto msg = maskedmessage_parser_easy(json);
+    ASSERT_EQ("id", msg.id());
+    ASSERT_EQ("bar", msg.inner().a());
+    ASSERT_FALSE(msg.has_ignored());
+}
+
+} // namespace test
+} // namespace protog
@@ -1,5 +1,7 @@
 #include <gtest/gtest.h>
 
+#include <string>
+
 #include "messages.pb.h"
 #include "nestedmessage_parser.pb.h"
 
@@ -45,5 +47,66 @@ TEST(nested_message, should_parse_fields_in_inner_message) {
     ASSERT_EQ(inner.b(1), 23);
 }
 
+TEST(nested_message, should_parse_into_arena) {
+    google::protobuf::Arena arena;
+    const auto json = R"*({ "id": "foo", "my_inner": { "a": "bar" }, "my_list": [{ "b": [1] }] })*";
+    const auto msg = nestedmessage_parser_easy_arena(&arena, json);
+    ASSERT_EQ(msg->GetArena(), &arena);
+    ASSERT_EQ(msg->id(), "foo");
+    ASSERT_EQ(msg->my_inner().GetArena(), &arena);
+    ASSERT_EQ(msg->my_inner().a(), "bar");
+    ASSERT_EQ(msg->my_list_size(), 1);
+    ASSERT_EQ(msg->my_list(0).GetArena(), &arena);
+    ASSERT_EQ(msg->my_list(0).b(0), 1);
+}
+
+TEST(nested_message, should_parse_in_parallel_and_keep_order) {
+    std::string lines;
+    std::string array = "[";
+    for (int i = 0; i < 1000; ++i) {
+        const auto json = R"*({ "id": ")*" + std::to_string(i) + R"*(\"}", "my_list": [{ "b": [)*" +
+                          std::to_string(i) + "] }] }";
+        lines += json + "\n";
+        array += (i ? ",\n" : "") + json;
+    }
+    array += "]";
+    for (const auto &json : {lines, array}) {
+        google::protobuf::RepeatedPtrField<NestedMessage> msgs;
+        ASSERT_EQ(0, nestedmessage_parser_parallel(json.data(), json.size(), msgs, 4));
+        ASSERT_EQ(1000, msgs.size());
+        for (int i = 0; i < msgs.size(); ++i) {
+            ASSERT_EQ(std::to_string(i) + "\"}", msgs.Get(i).id());
+            ASSERT_EQ(i, msgs.Get(i).my_list(0).b(0));
+        }
+    }
+}
+
+TEST(nested_message, should_report_errors_of_parallel_parsing) {
+    std::string error;
+    google::protobuf::RepeatedPtrField<NestedMessage> msgs;
+    const std::string lines = "{}\n{\"id\":\"a\" \"b\"}\n{}\n";
+    ASSERT_NE(0, nestedmessage_parser_parallel(lines.data(), lines.size(), msgs, 2, &error));
+    ASSERT_FALSE(error.empty());
+    const std::string array = "[{}, {}";
+    ASSERT_NE(0, nestedmessage_parser_parallel(array.data(), array.size(), msgs, 2, &error));
+    const std::string empty = " [ ] ";
+    int count = 0;
+    ASSERT_EQ(0, nestedmessage_parser_parallel(empty.data(), empty.size(), [&](NestedMessage &) { ++count; }));
+    ASSERT_EQ(0, count);
+}
+
+TEST(nested_message, should_reserve_array_sizes_of_earlier_parses) {
+    std::string json = R"*({"my_inner":{"b":[0)*";
+    for (int i = 1; i < 100; ++i) {
+        json += "," + std::to_string(i);
+    }
+    json += "]},\"my_list\":[{},{},{},{},{},{},{},{},{},{}]}";
+    ASSERT_EQ(100, nestedmessage_parser_easy(json).my_inner().b_size());
+    const auto msg = nestedmessage_parser_easy(R"*({"my_inner":{"b":[1]},"my_list":[{}]})*");
+    ASSERT_EQ(1, msg.my_inner().b_size());
+    ASSERT_GE(msg.my_inner().b().Capacity(), 100);
+    ASSERT_GE(msg.my_list().Capacity(), 10);
+}
+
 } // namespace test
 } // namespace protog
@@ -0,0 +1,135 @@
+#include <gtest/gtest.h>
+
+#include <dirent.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include <string>
+#include <vector>
+
+#include "output.h"
+
+namespace protog {
+namespace test {
+
+// runs the protog executable of this build on the test messages, writing into a fresh temporary directory
+class protog_output : public ::testing::Test {
+protected:
+    std::string dir;
+
+    void SetUp() override {
+        char path[] = "/tmp/protog_output_XXXXXX";
+        ASSERT_NE(nullptr, mkdtemp(path));
+        dir = path;
+    }
+
+    void TearDown() override {
+        ASSERT_EQ(0, system(("rm -rf " + dir).c_str()));
+    }
+
+    int protog(const std::string &options) const {
+        const auto command = std::string(PROTOG_EXECUTABLE) + " -p " PROTOG_TEST_PROTO " -i messages.pb.h" +
+                             " -m protog.test.SimpleMessage -o " + dir + " " + options;
+        return system(command.c_str());
+    }
+
+    // moves the modification time of path into the past, so a rewrite within the same second is noticed
+    void age(const std::string &path) const {
+        struct utimbuf times = {1000000000, 1000000000};
+        ASSERT_EQ(0, utime(path.c_str(), &times));
+    }
+
+    time_t modified(const std::string &path) const {
+        struct stat st;
+        return stat(path.c_str(), &st) == 0 ? st.st_mtime : 0;
+    }
+
+    std::vector<std::string> entries(const std::string &cache) const {
+        std::vector<std::string> names;
+        if (DIR *d = opendir(cache.c_str())) {
+            while (const dirent *entry = readdir(d)) {
+                if (entry->d_name[0] != '.') {
+                    names.push_back(entry->d_name);
+                }
+            }
+            closedir(d);
+        }
+        return names;
+    }
+};
+
+TEST_F(protog_output, should_only_rewrite_changed_files) {
+    const auto path = dir + "/file";
+    ASSERT_EQ(1, writeIfChanged(path, "a"));
+    age(path);
+    ASSERT_EQ(0, writeIfChanged(path, "a"));
+    ASSERT_EQ(1000000000, modified(path));
+    ASSERT_EQ(1, writeIfChanged(path, "b"));
+    ASSERT_NE(1000000000, modified(path));
+    std::string content;
+    ASSERT_TRUE(readFile(path, content));
+    ASSERT_EQ("b", content);
+}
+
+TEST_F(protog_output, should_leave_files_of_identical_reruns_untouched) {
+    ASSERT_EQ(0, protog("-s"));
+    const auto parser = dir + "/simplemessage_parser.pb.cc";
+    const auto serializer = dir + "/simplemessage_serializer.pb.h";
+    std::string first;
+    ASSERT_TRUE(readFile(parser, first));
+    age(parser);
+    age(serializer);
+    ASSERT_EQ(0, protog("-s"));
+    ASSERT_EQ(1000000000, modified(parser));
+    ASSERT_EQ(1000000000, modified(serializer));
+    ASSERT_EQ(0, protog("-s -u"));
+    ASSERT_NE(1000000000, modified(parser));
+    ASSERT_EQ(1000000000, modified(serializer));
+}
+
+TEST_F(protog_output, should_reuse_cached_files_of_the_same_inputs) {
+    const auto cache = dir + "/cache";
+    const auto header = dir + "/simplemessage_parser.pb.h";
+    ASSERT_EQ(0, protog("-c " + cache));
+    const auto stored = entries(cache);
+    ASSERT_EQ(1u, stored.size());
+
+    // a hit copies the entry as it is, so changing it shows whether it was used
+    OutputCache outputCache{cache};
+    const uint64_t key = strtoull(stored[0].c_str(), nullptr, 16);
+    Outputs outputs;
+    ASSERT_TRUE(outputCache.load(key, outputs));
+    ASSERT_EQ(2u, outputs.size());
+    for (auto &output : outputs) {
+        output.second = "// cached " + output.first + "\n";
+    }
+    ASSERT_TRUE(outputCache.store(key, outputs));
+    ASSERT_EQ(0, protog("-c " + cache));
+    std::string content;
+    ASSERT_TRUE(readFile(header, content));
+    ASSERT_EQ("// cached simplemessage_parser.pb.h\n", content);
+    ASSERT_EQ(1u, entries(cache).size());
+
+    // other options miss and add an entry of their own
+    ASSERT_EQ(0, protog("-u -c " + cache));
+    ASSERT_TRUE(readFile(header, content));
+    ASSERT_NE("// cached simplemessage_parser.pb.h\n", content);
+    ASSERT_EQ(2u, entries(cache).size());
+
+    // without the cache the files are generated again
+    ASSERT_EQ(0, protog(""));
+    ASSERT_TRUE(readFile(header, content));
+    ASSERT_NE("// cached simplemessage_parser.pb.h\n", content);
+}
+
+TEST_F(protog_output, should_reject_field_masks_with_views) {
+    ASSERT_NE(0, protog("-v -f id 2>/dev/null"));
+    ASSERT_NE(0, access((dir + "/simplemessage_view.pb.h").c_str(), F_OK));
+    ASSERT_EQ(0, protog("-v"));
+    ASSERT_EQ(0, access((dir + "/simplemessage_view.pb.h").c_str(), F_OK));
+}
+
+} // namespace test
+} // namespace protog
@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+
+#include <google/protobuf/util/message_differencer.h>
+
+#include <limits>
+
+#include "mapmessage_parser.pb.h"
+#include "mapmessage_serializer.pb.h"
+#include "messages.pb.h"
+#include "nestedmessage_parser.pb.h"
+#include "nestedmessage_serializer.pb.h"
+#include "simplemessage_parser.pb.h"
+#include "simplemessage_serializer.pb.h"
+
+namespace protog {
+namespace test {
+
+TEST(serializer, should_serialize_empty_message) {
+    SimpleMessage msg;
+    ASSERT_EQ("{}", simplemessage_serialize(msg));
+}
+
+TEST(serializer, should_serialize_set_fields_only) {
+    SimpleMessage msg;
+    msg.set_id("foo");
+    msg.set_my_double(42.23);
+    ASSERT_EQ(R"*({"id":"foo","my_double":42.23})*", simplemessage_serialize(msg));
+}
+
+TEST(serializer, should_append_to_given_buffer) {
+    SimpleMessage msg;
+    msg.set_my_int32(-42);
+    std::string out = "x";
+    simplemessage_serialize(msg, out);
+    ASSERT_EQ(R"*(x{"my_int32":-42})*", out);
+}
+
+TEST(serializer, should_escape_strings) {
+    SimpleMessage msg;
+    msg.set_id("a\"b\\c\n\x01\xc3\xa4");
+    ASSERT_EQ(R"*({"id":"a\"b\\c\n\u0001)*" "\xc3\xa4" R"*("})*", simplemessage_serialize(msg));
+}
+
+TEST(serializer, should_encode_bytes_as_base64) {
+    SimpleMessage msg;
+    for (const char *bytes : {"", "f", "fo", "foo", "foob"}) {
+        msg.set_my_bytes(bytes);
+        const auto json = simplemessage_serialize(msg);
+        ASSERT_EQ(bytes, simplemessage_parser_easy(json).my_bytes()) << json;
+    }
+    msg.set_my_bytes(std::string("\0\xfb\xff", 3));
+    ASSERT_EQ(R"*({"my_bytes":"APv/"})*", simplemessage_serialize(msg));
+}
+
+TEST(serializer, should_serialize_nested_and_repeated_fields) {
+    NestedMessage msg;
+    msg.mutable_my_inner()->set_a("foo");
+    msg.mutable_my_inner()->add_b(1.5);
+    msg.mutable_my_inner()->add_b(-2);
+    msg.add_my_list();
+    msg.add_my_list()->add_b(1e-7);
+    ASSERT_EQ(R"*({"my_inner":{"a":"foo","b":[1.5,-2]},"my_list":[{},{"b":[1e-7]}]})*", nestedmessage_serialize(msg));
+}
+
+TEST(serializer, should_round_trip_with_parser) {
+    NestedMessage msg;
+    msg.set_id("round \"trip\"");
+    msg.mutable_my_inner()->set_a("");
+    for (double d : {0.1, 1.0 / 3, -0.0, 1e300, 5e-324, std::numeric_limits<double>::max()}) {
+        msg.mutable_my_inner()->add_b(d);
+        msg.add_my_list()->add_b(-d);
+    }
+    const auto parsed = nestedmessage_parser_easy(nestedmessage_serialize(msg));
+    ASSERT_EQ(msg.SerializeAsString(), parsed.SerializeAsString());
+}
+
+TEST(serializer, should_serialize_maps) {
+    MapMessage msg;
+    (*msg.mutable_names())[-5] = "x";
+    (*msg.mutable_flags())[true] = 0.5;
+    (*msg.mutable_inners())[3].set_a("y");
+    ASSERT_EQ(R"*({"names":{"-5":"x"},"inners":{"3":{"a":"y"}},"flags":{"true":0.5}})*", mapmessage_serialize(msg));
+    (*msg.mutable_counts())["a\"b"] = 1;
+    (*msg.mutable_counts())["c"] = 2;
+    (*msg.mutable_blobs())["k"] = "foob";
+    (*msg.mutable_kinds())[-1] = WireMessage::SECOND;
+    const auto parsed = mapmessage_parser_easy(mapmessage_serialize(msg));
+    ASSERT_TRUE(google::protobuf::util::MessageDifferencer::Equals(msg, parsed));
+}
+
+} // namespace test
+} // namespace protog
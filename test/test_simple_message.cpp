@@ -1,5 +1,14 @@
 #include <gtest/gtest.h>
 
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
 #include "messages.pb.h"
 #include "simplemessage_parser.pb.h"
 
@@ -44,6 +53,145 @@ TEST(simple_message, should_allow_any_order) {
     ASSERT_FALSE(msg.has_my_double());
 }
 
+TEST(simple_message, should_decode_escaped_strings) {
+    const auto json = R"*({ "id": "a\"b\\c\/d\n\u00e4\ud83d\ude00" })*";
+    const auto msg = simplemessage_parser_easy(json);
+    ASSERT_EQ("a\"b\\c/d\n\xc3\xa4\xf0\x9f\x98\x80", msg.id());
+}
+
+TEST(simple_message, should_reuse_state_after_complete_and_error) {
+    SimpleMessage msg;
+    auto state = simplemessage_parser_init(msg);
+    std::string json = R"*({ "id": "foo" })*";
+    ASSERT_EQ(0, simplemessage_parser_on_chunk(state, &json[0], json.size()));
+    ASSERT_EQ(0, simplemessage_parser_complete(state));
+    ASSERT_EQ("foo", msg.id());
+
+    simplemessage_parser_reset(state);
+    ASSERT_FALSE(msg.has_id());
+    json = "{";
+    simplemessage_parser_on_chunk(state, &json[0], json.size());
+    ASSERT_NE(0, simplemessage_parser_complete(state));
+
+    SimpleMessage other;
+    simplemessage_parser_rebind(state, other);
+    json = R"*({ "my_int32": 42 })*";
+    ASSERT_EQ(0, simplemessage_parser_on_chunk(state, &json[0], json.size()));
+    ASSERT_EQ(0, simplemessage_parser_complete(state));
+    ASSERT_EQ(42, other.my_int32());
+    simplemessage_parser_free(state);
+}
+
+TEST(simple_message, should_reuse_pooled_states) {
+    std::string json(4096, ' ');
+    json += R"*({ "id": ")*" + std::string(10000, 'x') + R"*(" })*";
+    for (int i = 0; i < 3; ++i) {
+        SimpleMessage msg;
+        auto state = simplemessage_parser_acquire(msg);
+        ASSERT_EQ(0, simplemessage_parser_on_chunk(state, &json[0], json.size() / 2));
+        ASSERT_EQ(0, simplemessage_parser_on_chunk(state, &json[json.size() / 2], json.size() - json.size() / 2));
+        ASSERT_EQ(0, simplemessage_parser_complete(state));
+        ASSERT_EQ(10000u, msg.id().size());
+        simplemessage_parser_release(state);
+    }
+}
+
+TEST(simple_message, should_not_pass_config_or_callback_of_released_states_on) {
+    SimpleMessage streamed;
+    int count = 0;
+    simplemessage_parser_release(simplemessage_stream_init(streamed, [&](SimpleMessage &) { ++count; }));
+    auto msg = simplemessage_parser_easy(R"*({"id": "foo", "my_int32": 1})*");
+    ASSERT_EQ(0, count);
+    ASSERT_EQ("foo", msg.id());
+    ASSERT_EQ(1, msg.my_int32());
+
+    simplemessage_parser_config config;
+    config.validateUtf8 = false;
+    config.allowComments = true;
+    simplemessage_parser_release(simplemessage_parser_init(streamed, config));
+    ASSERT_THROW(simplemessage_parser_easy("{\"id\": \"\xff\xfe\"}"), std::runtime_error);
+    ASSERT_THROW(simplemessage_parser_easy("{\"id\": /* c */ \"a\"}"), std::runtime_error);
+    SimpleMessage other;
+    auto state = simplemessage_parser_acquire(other);
+    std::string json = "{\"id\": \"\xff\"}";
+    const int rc = simplemessage_parser_on_chunk(state, &json[0], json.size());
+    ASSERT_NE(0, rc == 0 ? simplemessage_parser_complete(state) : rc);
+    simplemessage_parser_release(state);
+}
+
+TEST(simple_message, should_stream_newline_delimited_messages) {
+    std::string json = "{\"id\":\"a}\",\"my_int32\":1}\n{\"my_int32\":2}\n\n{ \"id\": \"c\\\"{\" }\n";
+    SimpleMessage msg;
+    std::vector<std::string> ids;
+    std::vector<int> ints;
+    auto state = simplemessage_stream_init(msg, [&](SimpleMessage &m) {
+        ids.push_back(m.id());
+        ints.push_back(m.my_int32());
+    });
+    for (size_t i = 0; i < json.size(); i += 5) {
+        ASSERT_EQ(0, simplemessage_parser_on_chunk(state, &json[i], std::min<size_t>(5, json.size() - i)));
+    }
+    ASSERT_EQ(0, simplemessage_parser_complete(state));
+    ASSERT_EQ((std::vector<std::string>{"a}", "", "c\"{"}), ids);
+    ASSERT_EQ((std::vector<int>{1, 2, 0}), ints);
+    simplemessage_parser_free(state);
+}
+
+TEST(simple_message, should_fail_stream_on_truncated_or_invalid_message) {
+    SimpleMessage msg;
+    int count = 0;
+    auto state = simplemessage_stream_init(msg, [&](SimpleMessage &) { ++count; });
+    std::string json = "{}\n{\"id\":";
+    ASSERT_EQ(0, simplemessage_parser_on_chunk(state, &json[0], json.size()));
+    ASSERT_NE(0, simplemessage_parser_complete(state));
+    ASSERT_EQ(1, count);
+    simplemessage_parser_free(state);
+
+    state = simplemessage_stream_init(msg, [&](SimpleMessage &) { ++count; });
+    json = "{}\n{\"my_int32\":1 2}\n{}\n";
+    ASSERT_NE(0, simplemessage_parser_on_chunk(state, &json[0], json.size()));
+    ASSERT_EQ(2, count);
+    simplemessage_parser_free(state);
+}
+
+TEST(simple_message, should_report_stream_errors_at_their_offset_in_the_whole_input) {
+    std::string json = "{\"id\":\"a\"}\n{\"id\":\"b\",\n \"my_int32\":1 2}\n";
+    const size_t invalid = json.find(" 2"); // the backends differ in how far past it they report
+    for (size_t chunk = 1; chunk <= json.size(); ++chunk) {
+        SimpleMessage msg;
+        std::vector<std::string> ids;
+        auto state = simplemessage_stream_init(msg, [&](SimpleMessage &m) { ids.push_back(m.id()); });
+        int rc = 0;
+        for (size_t i = 0; i < json.size() && rc == 0; i += chunk) {
+            rc = simplemessage_parser_on_chunk(state, &json[i], std::min(chunk, json.size() - i));
+        }
+        ASSERT_NE(0, rc) << chunk;
+        ASSERT_EQ(std::vector<std::string>{"a"}, ids) << chunk;
+        ASSERT_GE(simplemessage_parser_last_error(state).offset, invalid) << chunk;
+        ASSERT_LE(simplemessage_parser_last_error(state).offset, invalid + 3) << chunk;
+        simplemessage_parser_free(state);
+    }
+}
+
+TEST(simple_message, should_parse_files) {
+    char path[] = "/tmp/protog_test_XXXXXX";
+    const int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    const std::string json = "{\"id\":\"a\"}\n{\"id\":\"b\",\"my_int32\":2}\n";
+    ASSERT_EQ(static_cast<ssize_t>(json.size()), write(fd, json.data(), json.size()));
+    close(fd);
+
+    std::vector<std::string> ids;
+    simplemessage_stream_file(path, [&](SimpleMessage &msg) { ids.push_back(msg.id()); });
+    ASSERT_EQ((std::vector<std::string>{"a", "b"}), ids);
+    ASSERT_THROW(simplemessage_parse_file(path), std::runtime_error);
+
+    ASSERT_EQ(0, truncate(path, json.find('\n')));
+    ASSERT_EQ("a", simplemessage_parse_file(path).id());
+    unlink(path);
+    ASSERT_THROW(simplemessage_parse_file(path), std::runtime_error);
+}
+
 // TODO: test every single type conversion!
 
 TEST(simple_message, should_allow_int_as_double) {
@@ -53,5 +201,206 @@ TEST(simple_message, should_allow_int_as_double) {
     ASSERT_EQ(42.0, msg.my_double());
 }
 
+TEST(simple_message, should_parse_integers_without_loss) {
+    auto msg = simplemessage_parser_easy(R"*({ "my_int32": -2147483648, "my_uint64": 18446744073709551615 })*");
+    ASSERT_EQ(INT32_MIN, msg.my_int32());
+    ASSERT_EQ(UINT64_MAX, msg.my_uint64());
+    msg = simplemessage_parser_easy(R"*({ "my_int32": 2147483647, "my_uint64": 9007199254740993 })*");
+    ASSERT_EQ(INT32_MAX, msg.my_int32());
+    ASSERT_EQ(9007199254740993ull, msg.my_uint64());
+}
+
+TEST(simple_message, should_reject_integers_out_of_range) {
+    EXPECT_THROW(simplemessage_parser_easy(R"*({ "my_int32": 2147483648 })*"), std::runtime_error);
+    EXPECT_THROW(simplemessage_parser_easy(R"*({ "my_int32": -2147483649 })*"), std::runtime_error);
+    EXPECT_THROW(simplemessage_parser_easy(R"*({ "my_uint64": 18446744073709551616 })*"), std::runtime_error);
+    EXPECT_THROW(simplemessage_parser_easy(R"*({ "my_uint64": -1 })*"), std::runtime_error);
+}
+
+TEST(simple_message, should_round_doubles_correctly) {
+    for (const char *num : {"0.1", "-42.23", "1e22", "1.7976931348623157e308", "2.2250738585072014e-308", "5e-324",
+                            "9007199254740993", "123456789012345678901234567890", "0.30000000000000004"}) {
+        const auto msg = simplemessage_parser_easy(std::string("{\"my_double\":") + num + "}");
+        ASSERT_EQ(strtod(num, nullptr), msg.my_double()) << num;
+    }
+    EXPECT_THROW(simplemessage_parser_easy(R"*({ "my_double": 1e400 })*"), std::runtime_error);
+}
+
+static std::string base64(const std::string &bytes) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    for (size_t i = 0; i < bytes.size(); i += 3) {
+        uint32_t w = static_cast<unsigned char>(bytes[i]) << 16;
+        w |= i + 1 < bytes.size() ? static_cast<unsigned char>(bytes[i + 1]) << 8 : 0;
+        w |= i + 2 < bytes.size() ? static_cast<unsigned char>(bytes[i + 2]) : 0;
+        out += alphabet[w >> 18];
+        out += alphabet[(w >> 12) & 0x3F];
+        out += i + 1 < bytes.size() ? alphabet[(w >> 6) & 0x3F] : '=';
+        out += i + 2 < bytes.size() ? alphabet[w & 0x3F] : '=';
+    }
+    return out;
+}
+
+TEST(simple_message, should_decode_base64_bytes) {
+    ASSERT_EQ("foob", simplemessage_parser_easy(R"*({ "my_bytes": "Zm9vYg==" })*").my_bytes());
+    ASSERT_EQ("foob", simplemessage_parser_easy(R"*({ "my_bytes": "Zm9vYg" })*").my_bytes());
+    ASSERT_EQ("foo", simplemessage_parser_easy(R"*({ "my_bytes": "Zm9v" })*").my_bytes());
+    ASSERT_EQ("", simplemessage_parser_easy(R"*({ "my_bytes": "" })*").my_bytes());
+    ASSERT_EQ("\xfb\xff\xbf", simplemessage_parser_easy(R"*({ "my_bytes": "+\/+\/" })*").my_bytes());
+    ASSERT_EQ("\xfb\xff\xbf", simplemessage_parser_easy(R"*({ "my_bytes": "-_-_" })*").my_bytes());
+    std::string bytes;
+    for (int i = 0; i < 1000; ++i) {
+        bytes += static_cast<char>(i * 7);
+    }
+    for (size_t len : {15, 16, 47, 48, 49, 1000}) {
+        const auto blob = bytes.substr(0, len);
+        const auto msg = simplemessage_parser_easy("{\"my_bytes\":\"" + base64(blob) + "\"}");
+        ASSERT_EQ(blob, msg.my_bytes()) << len;
+    }
+}
+
+TEST(simple_message, should_reject_invalid_base64) {
+    for (const char *text : {"Zm9vY", "Zm9v!mI=", "Zm9vYg===", "Zm=vYg==", "Zm9vYmFy\u00e4"}) {
+        EXPECT_THROW(simplemessage_parser_easy(std::string("{\"my_bytes\":\"") + text + "\"}"), std::runtime_error)
+            << text;
+    }
+    std::string blob(64, 'A');
+    for (size_t i : {0, 20, 40, 63}) {
+        std::string invalid = blob;
+        invalid[i] = '*';
+        EXPECT_THROW(simplemessage_parser_easy("{\"my_bytes\":\"" + invalid + "\"}"), std::runtime_error) << i;
+    }
+}
+
+TEST(simple_message, should_report_error_codes_without_throwing) {
+    const std::vector<std::pair<std::string, simplemessage_parser_error_code>> cases = {
+        {R"*({ "id": "foo", "unknown": 1 })*", simplemessage_parser_error_key},
+        {R"*({ "my_int32": "x" })*", simplemessage_parser_error_type},
+        {R"*({ "my_int32": 1.5 })*", simplemessage_parser_error_type},
+        {R"*({ "my_int32": 2147483648 })*", simplemessage_parser_error_range},
+        {R"*({ "my_double": 1e400 })*", simplemessage_parser_error_range},
+        {R"*({ "my_bytes": "Zm9vY" })*", simplemessage_parser_error_base64},
+        {R"*({ "id": "foo" )*", simplemessage_parser_error_syntax},
+        {R"*({ "id" "foo" })*", simplemessage_parser_error_syntax},
+    };
+    for (const auto &c : cases) {
+        SimpleMessage msg;
+        simplemessage_parser_error_s error = {};
+        ASSERT_NE(0, simplemessage_parser_try_easy(msg, c.first.data(), c.first.size(), &error)) << c.first;
+        ASSERT_EQ(c.second, error.code) << c.first;
+        ASSERT_LE(error.offset, c.first.size()) << c.first;
+        ASSERT_STRNE("", simplemessage_parser_error_string(error.code));
+    }
+    SimpleMessage msg;
+    const std::string json = R"*({ "id": "foo", "my_int32": 42 })*";
+    ASSERT_EQ(0, simplemessage_parser_try_easy(msg, json.data(), json.size()));
+    ASSERT_EQ(42, msg.my_int32());
+}
+
+TEST(simple_message, should_keep_last_error_of_state) {
+    SimpleMessage msg;
+    auto state = simplemessage_parser_init(msg);
+    std::string json = R"*({ "id": "foo", "unknown": 1 })*";
+    ASSERT_TRUE(simplemessage_parser_on_chunk(state, &json[0], json.size()) != 0 || simplemessage_parser_complete(state) != 0);
+    const auto error = simplemessage_parser_last_error(state);
+    ASSERT_EQ(simplemessage_parser_error_key, error.code);
+    ASSERT_GE(error.offset, json.find("unknown"));
+    ASSERT_LE(error.offset, json.size());
+    char *message = simplemessage_parser_get_error(state);
+    ASSERT_NE(nullptr, strstr(message, ("at offset " + std::to_string(error.offset)).c_str())) << message;
+    simplemessage_parser_free_error(state, message);
+    simplemessage_parser_reset(state);
+    ASSERT_EQ(simplemessage_parser_error_none, simplemessage_parser_last_error(state).code);
+    simplemessage_parser_free(state);
+}
+
+// feeds json in two chunks split at the given offset
+static int parse_split(SimpleMessage &msg, std::string json, size_t split, const simplemessage_parser_config &config,
+                       simplemessage_parser_error_s &error) {
+    auto state = simplemessage_parser_init(msg, config);
+    int rc = simplemessage_parser_on_chunk(state, &json[0], split);
+    if (rc == 0) {
+        rc = simplemessage_parser_on_chunk(state, &json[split], json.size() - split);
+    }
+    if (rc == 0) {
+        rc = simplemessage_parser_complete(state);
+    }
+    error = simplemessage_parser_last_error(state);
+    simplemessage_parser_free(state);
+    return rc;
+}
+
+TEST(simple_message, should_validate_utf8_across_chunks) {
+    const std::string text = "\xc3\xa4\xe2\x82\xac\xf0\x9f\x98\x80" + std::string(40, 'x') + "\xf4\x8f\xbf\xbf\xef\xbf\xbf";
+    const std::string json = "{\"id\":\"" + text + "\"}";
+    for (size_t split = 0; split <= json.size(); ++split) {
+        SimpleMessage msg;
+        simplemessage_parser_error_s error;
+        ASSERT_EQ(0, parse_split(msg, json, split, simplemessage_parser_config(), error)) << split;
+        ASSERT_EQ(text, msg.id());
+    }
+    for (const char *invalid : {"\xc3", "\x80", "\xc0\xaf", "\xe0\x80\xaf", "\xed\xa0\x80", "\xf4\x90\x80\x80", "\xff"}) {
+        for (size_t prefix : {0, 3, 40}) {
+            const std::string bad = "{\"id\":\"" + std::string(prefix, 'y') + invalid + "\"}";
+            for (size_t split = 0; split <= bad.size(); ++split) {
+                SimpleMessage msg;
+                simplemessage_parser_error_s error;
+                ASSERT_NE(0, parse_split(msg, bad, split, simplemessage_parser_config(), error)) << prefix << " " << split;
+                ASSERT_EQ(simplemessage_parser_error_utf8, error.code);
+                ASSERT_EQ(7 + prefix, error.offset) << prefix << " " << split;
+            }
+        }
+    }
+}
+
+TEST(simple_message, should_apply_parser_config) {
+    simplemessage_parser_config config;
+    simplemessage_parser_error_s error;
+    SimpleMessage msg;
+    const std::string invalid = "{\"id\":\"\xff\xfe\"}";
+    ASSERT_NE(0, parse_split(msg, invalid, 0, config, error));
+    config.validateUtf8 = false;
+    ASSERT_EQ(0, parse_split(msg, invalid, 0, config, error));
+    ASSERT_EQ("\xff\xfe", msg.id());
+
+    const std::string commented = "/* a */ {\"id\": // b\n \"x\" /* } */, \"my_int32\": 1} // c";
+    ASSERT_NE(0, parse_split(msg, commented, 0, config, error));
+    config.allowComments = true;
+    ASSERT_EQ(0, parse_split(msg, commented, 10, config, error));
+    ASSERT_EQ("x", msg.id());
+    ASSERT_EQ(1, msg.my_int32());
+
+    const std::string trailing = "{\"id\":\"y\"} and more";
+    ASSERT_NE(0, parse_split(msg, trailing, 0, config, error));
+    config.allowTrailingGarbage = true;
+    ASSERT_EQ(0, parse_split(msg, trailing, 0, config, error));
+    ASSERT_EQ("y", msg.id());
+}
+
+TEST(simple_message, should_count_profile_hits_only_when_enabled) {
+    SimpleMessage msg;
+    auto state = simplemessage_parser_init(msg);
+    std::string json = R"*({ "id": "foo", "my_int32": 42, "my_double": 1.5 })*";
+    ASSERT_EQ(0, simplemessage_parser_on_chunk(state, &json[0], json.size()));
+    ASSERT_EQ(0, simplemessage_parser_complete(state));
+    const auto entries = simplemessage_parser_profile_dump(state);
+#if defined(PROTOG_PROFILE)
+    std::map<std::string, uint64_t> hits;
+    for (const auto &entry : entries) {
+        hits[entry.name] = entry.hits;
+    }
+    ASSERT_EQ(1, hits[".id"]);
+    ASSERT_EQ(1, hits[".my_int32"]);
+    ASSERT_EQ(1, hits[".my_double"]);
+    ASSERT_EQ(0, hits.count(".my_bytes"));
+    ASSERT_LT(0, hits["."]);
+    simplemessage_parser_profile_reset(state);
+    ASSERT_TRUE(simplemessage_parser_profile_dump(state).empty());
+#else
+    ASSERT_TRUE(entries.empty());
+#endif
+    simplemessage_parser_free(state);
+}
+
 } // namespace test
 } // namespace protog
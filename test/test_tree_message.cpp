@@ -0,0 +1,66 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "messages.pb.h"
+#include "treemessage_parser.pb.h"
+
+namespace protog {
+namespace test {
+
+TEST(tree_message, should_parse_recursive_messages) {
+    const auto json = R"*({
+        "name": "root",
+        "first": { "a": "x" },
+        "children": [
+            { "name": "c1", "left": { "name": "c1l", "rest": [{ "b": [1] }, {}] } },
+            { "name": "c2", "children": [{ "name": "c2c", "first": { "b": [2, 3] } }] }
+        ],
+        "left": { "left": { "name": "ll" } },
+        "rest": [{ "a": "y" }]
+    })*";
+    const auto msg = treemessage_parser_easy(json);
+    ASSERT_EQ("root", msg.name());
+    ASSERT_EQ("x", msg.first().a());
+    ASSERT_EQ(2, msg.children_size());
+    ASSERT_EQ("c1l", msg.children(0).left().name());
+    ASSERT_EQ(2, msg.children(0).left().rest_size());
+    ASSERT_EQ(1, msg.children(0).left().rest(0).b(0));
+    ASSERT_EQ("c2c", msg.children(1).children(0).name());
+    ASSERT_EQ(3, msg.children(1).children(0).first().b(1));
+    ASSERT_EQ("ll", msg.left().left().name());
+    ASSERT_EQ("y", msg.rest(0).a());
+}
+
+TEST(tree_message, should_parse_deep_nesting) {
+    std::string json;
+    for (int i = 0; i < 100; ++i) {
+        json += "{\"left\":";
+    }
+    json += "{\"name\":\"leaf\"}";
+    for (int i = 0; i < 100; ++i) {
+        json += "}";
+    }
+    auto msg = treemessage_parser_easy(json);
+    const TreeMessage *node = &msg;
+    for (int i = 0; i < 100; ++i) {
+        ASSERT_TRUE(node->has_left());
+        node = &node->left();
+    }
+    ASSERT_EQ("leaf", node->name());
+}
+
+TEST(tree_message, should_only_stream_outermost_messages) {
+    std::string json = "{\"name\":\"a\",\"left\":{\"name\":\"b\"}}\n{\"children\":[{\"name\":\"c\"}]}\n";
+    TreeMessage msg;
+    std::vector<std::string> names;
+    auto state = treemessage_stream_init(msg, [&](TreeMessage &m) { names.push_back(m.name()); });
+    ASSERT_EQ(0, treemessage_parser_on_chunk(state, &json[0], json.size()));
+    ASSERT_EQ(0, treemessage_parser_complete(state));
+    ASSERT_EQ((std::vector<std::string>{"a", ""}), names);
+    treemessage_parser_free(state);
+}
+
+} // namespace test
+} // namespace protog
@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+
+#include <google/protobuf/util/message_differencer.h>
+
+#include <string>
+
+#include "mapmessage_parser.pb.h"
+#include "mapmessage_view.pb.h"
+#include "messages.pb.h"
+#include "nestedmessage_parser.pb.h"
+#include "nestedmessage_view.pb.h"
+#include "simplemessage_view.pb.h"
+
+namespace protog {
+namespace test {
+
+TEST(view, should_point_into_buffer) {
+    const std::string json = R"*({"id":"foo","my_double":1.5})*";
+    simplemessage_view view;
+    ASSERT_EQ(0, simplemessage_view_parse(view, json.data(), json.size()));
+    ASSERT_TRUE(view.has_id());
+    ASSERT_EQ(json.data() + 7, view.id.data);
+    ASSERT_EQ("foo", view.id.str());
+    ASSERT_FALSE(view.has_my_int32());
+    ASSERT_TRUE(view.has_my_double());
+    ASSERT_EQ(1.5, view.my_double);
+}
+
+TEST(view, should_decode_bytes_into_storage) {
+    const std::string json = R"*({"my_bytes":"Zm9vYg=="})*";
+    simplemessage_view view;
+    ASSERT_EQ(0, simplemessage_view_parse(view, json.data(), json.size()));
+    ASSERT_TRUE(view.my_bytes == "foob");
+    ASSERT_EQ(1, view.storage_.size());
+}
+
+TEST(view, should_copy_escaped_strings) {
+    const std::string json = R"*({"id":"a\nb","my_inner":{"a":"\u00e4"}})*";
+    nestedmessage_view view;
+    ASSERT_EQ(0, nestedmessage_view_parse(view, json.data(), json.size()));
+    ASSERT_TRUE(view.id == "a\nb");
+    ASSERT_TRUE(view.my_inner.a == "\xc3\xa4");
+    ASSERT_EQ(2, view.storage_.size());
+}
+
+TEST(view, should_spill_repeated_fields_to_heap) {
+    const std::string json = R"*({"my_list":[{"b":[1,2,3,4,5,6]},{},{"a":"x"}]})*";
+    nestedmessage_view view;
+    ASSERT_EQ(0, nestedmessage_view_parse(view, json.data(), json.size()));
+    ASSERT_EQ(3, view.my_list.size());
+    ASSERT_EQ(6, view.my_list[0].b.size());
+    double sum = 0;
+    for (double b : view.my_list[0].b) {
+        sum += b;
+    }
+    ASSERT_EQ(21, sum);
+    ASSERT_TRUE(view.my_list[2].a == "x");
+}
+
+TEST(view, should_convert_to_message) {
+    const std::string json = R"*({"id":"foo","my_inner":{"b":[0.5]},"my_list":[{"a":"x\"y","b":[1,2]},{}]})*";
+    nestedmessage_view view;
+    ASSERT_EQ(0, nestedmessage_view_parse(view, json.data(), json.size()));
+    NestedMessage msg;
+    nestedmessage_view_to_message(view, msg);
+    ASSERT_EQ(nestedmessage_parser_easy(json).SerializeAsString(), msg.SerializeAsString());
+}
+
+TEST(view, should_keep_map_entries_in_order) {
+    const std::string json = R"*({"counts":{"a":1,"b":2,"a":3},"inners":{"7":{"a":"x"}},"flags":{"true":0.5}})*";
+    mapmessage_view view;
+    ASSERT_EQ(0, mapmessage_view_parse(view, json.data(), json.size()));
+    ASSERT_EQ(3u, view.counts.size());
+    ASSERT_TRUE(view.counts[2].key == "a");
+    ASSERT_EQ(3, view.counts[2].value);
+    ASSERT_EQ(7u, view.inners[0].key);
+    ASSERT_TRUE(view.inners[0].value.a == "x");
+    ASSERT_TRUE(view.flags[0].key);
+    MapMessage msg;
+    mapmessage_view_to_message(view, msg);
+    ASSERT_TRUE(google::protobuf::util::MessageDifferencer::Equals(mapmessage_parser_easy(json), msg));
+}
+
+TEST(view, should_report_errors) {
+    const std::string json = R"*({"id":"foo","unknown":1})*";
+    simplemessage_view view;
+    std::string error;
+    ASSERT_EQ(1, simplemessage_view_parse(view, json.data(), json.size(), &error));
+    ASSERT_FALSE(error.empty());
+}
+
+} // namespace test
+} // namespace protog
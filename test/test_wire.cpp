@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+
+#include <google/protobuf/util/message_differencer.h>
+
+#include <string>
+
+#include "mapmessage_parser.pb.h"
+#include "mapmessage_wire.pb.h"
+#include "messages.pb.h"
+#include "nestedmessage_parser.pb.h"
+#include "nestedmessage_wire.pb.h"
+#include "simplemessage_wire.pb.h"
+#include "treemessage_parser.pb.h"
+#include "treemessage_serializer.pb.h"
+#include "treemessage_wire.pb.h"
+#include "wiremessage_parser.pb.h"
+#include "wiremessage_wire.pb.h"
+
+namespace protog {
+namespace test {
+
+TEST(wire, should_encode_scalars) {
+    const std::string json = R"*({"id":"foo","my_int32":-1,"my_double":1.5})*";
+    std::string out;
+    ASSERT_EQ(0, simplemessage_wire_transcode(json.data(), json.size(), out));
+    SimpleMessage msg;
+    msg.set_id("foo");
+    msg.set_my_int32(-1);
+    msg.set_my_double(1.5);
+    ASSERT_EQ(msg.SerializeAsString(), out);
+}
+
+TEST(wire, should_match_message_parser) {
+    const std::string json = R"*({"my_sint32":-3,"my_sint64":-4000000000,"my_fixed32":7,"my_sfixed64":-8,)*"
+                             R"*("my_float":0.25,"my_bool":true,"kind":1,"my_uint32":4294967295,"packed":[1,-1,300],)*"
+                             R"*("unpacked":[5,6],"blobs":["Zm9vYg==","",")*" + std::string(200, 'A') + R"*("],"nested":{"id":"x","my_inner":{"b":[]},"my_list":[{"a":"y"},{}]}})*";
+    std::string out;
+    ASSERT_EQ(0, wiremessage_wire_transcode(json.data(), json.size(), out));
+    WireMessage msg;
+    ASSERT_TRUE(msg.ParseFromString(out));
+    ASSERT_EQ(wiremessage_parser_easy(json).SerializeAsString(), msg.SerializeAsString());
+}
+
+TEST(wire, should_backfill_long_lengths) {
+    const std::string a(200, 'a');
+    const std::string json = R"*({"my_inner":{"a":")*" + a + R"*("},"my_list":[{"a":")*" + a + a + R"*("}]})*";
+    std::string out = "prefix";
+    ASSERT_EQ(0, nestedmessage_wire_transcode(json.data(), json.size(), out));
+    NestedMessage msg;
+    ASSERT_TRUE(msg.ParseFromString(out.substr(6)));
+    ASSERT_EQ(nestedmessage_parser_easy(json).SerializeAsString(), msg.SerializeAsString());
+    ASSERT_EQ(msg.SerializeAsString(), out.substr(6));
+}
+
+TEST(wire, should_encode_recursive_messages) {
+    const std::string json = R"*({"name":"a","children":[{"left":{"name":"b"}},{}],"first":{"b":[1]}})*";
+    std::string out;
+    ASSERT_EQ(0, treemessage_wire_transcode(json.data(), json.size(), out));
+    const auto msg = treemessage_parser_easy(json);
+    ASSERT_EQ(msg.SerializeAsString(), out);
+    ASSERT_EQ(json, treemessage_serialize(msg));
+}
+
+TEST(wire, should_encode_map_entries) {
+    const std::string json = R"*({"id":"m","counts":{"a":1,"b\"":-2},"names":{"-5":"x"},"inners":{"9":{"a":"y","b":[1]}},)*"
+                             R"*("flags":{"false":0.5},"blobs":{"k":"Zm9vYg=="},"kinds":{"-1":1,"2":0}})*";
+    std::string out;
+    ASSERT_EQ(0, mapmessage_wire_transcode(json.data(), json.size(), out));
+    MapMessage msg;
+    ASSERT_TRUE(msg.ParseFromString(out));
+    ASSERT_TRUE(google::protobuf::util::MessageDifferencer::Equals(mapmessage_parser_easy(json), msg));
+}
+
+TEST(wire, should_restore_output_on_error) {
+    const std::string json = R"*({"my_inner":{"a":"x","unknown":1}})*";
+    std::string out = "prefix";
+    std::string error;
+    ASSERT_EQ(1, nestedmessage_wire_transcode(json.data(), json.size(), out, &error));
+    ASSERT_EQ("prefix", out);
+    ASSERT_FALSE(error.empty());
+}
+
+} // namespace test
+} // namespace protog